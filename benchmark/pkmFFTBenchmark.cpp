@@ -0,0 +1,101 @@
+/*
+ *  pkmFFTBenchmark.cpp
+ *
+ *  Times the native real FFT (pkmRealFFT) for every instruction set this
+ *  machine supports against the scalar reference, for sizes 64 .. 65536,
+ *  and reports ns per forward transform and the largest deviation from the
+ *  scalar output.
+ *
+ *  Build (from the repository root):
+ *
+ *  c++ -O2 -std=c++11 -I. benchmark/pkmFFTBenchmark.cpp -o pkmFFTBenchmark
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "pkmRealFFT.h"
+
+static double timeForward(pkmRealFFT *engine, float *realp, float *imagp, int size)
+{
+	// roughly 16M samples worth of transforms per measurement
+	int reps = (1 << 24) / size;
+	if (reps < 16)
+		reps = 16;
+
+	for (int i = 0; i < 4; i++)
+		engine->forward(realp, imagp);
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < reps; i++)
+		engine->forward(realp, imagp);
+	std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::nano>(stop - start).count() / (double)reps;
+}
+
+static void fillSignal(float *realp, float *imagp, int size)
+{
+	srand(1);
+	for (int i = 0; i < size/2; i++) {
+		realp[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+		imagp[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+	}
+}
+
+int main()
+{
+	printf("%8s", "size");
+	for (int isa = PKM_FFT_ISA_SCALAR; isa < PKM_FFT_ISA_COUNT; isa++) {
+		if (pkmFFTISASupported((pkmFFTISA)isa))
+			printf("  %12s", pkmFFTISAName((pkmFFTISA)isa));
+	}
+	printf("  %10s  %10s\n", "speedup", "max err");
+
+	for (int size = 64; size <= 65536; size *= 2)
+	{
+		float *realp = (float *)malloc(sizeof(float) * size/2);
+		float *imagp = (float *)malloc(sizeof(float) * size/2);
+		float *refRealp = (float *)malloc(sizeof(float) * size/2);
+		float *refImagp = (float *)malloc(sizeof(float) * size/2);
+
+		pkmRealFFT reference(size, PKM_FFT_ISA_SCALAR);
+		fillSignal(refRealp, refImagp, size);
+		reference.forward(refRealp, refImagp);
+
+		double scalarNs = 0, bestNs = 0, maxErr = 0;
+
+		printf("%8d", size);
+		for (int isa = PKM_FFT_ISA_SCALAR; isa < PKM_FFT_ISA_COUNT; isa++)
+		{
+			if (!pkmFFTISASupported((pkmFFTISA)isa))
+				continue;
+
+			pkmRealFFT engine(size, (pkmFFTISA)isa);
+
+			fillSignal(realp, imagp, size);
+			engine.forward(realp, imagp);
+			for (int i = 0; i < size/2; i++) {
+				maxErr = fmax(maxErr, fabs(realp[i] - refRealp[i]));
+				maxErr = fmax(maxErr, fabs(imagp[i] - refImagp[i]));
+			}
+
+			double ns = timeForward(&engine, realp, imagp, size);
+			if (isa == PKM_FFT_ISA_SCALAR)
+				scalarNs = ns;
+			if (bestNs == 0 || ns < bestNs)
+				bestNs = ns;
+			printf("  %12.1f", ns);
+		}
+		printf("  %9.2fx  %10.2e\n", scalarNs / bestNs, maxErr);
+
+		free(realp);
+		free(imagp);
+		free(refRealp);
+		free(refImagp);
+	}
+
+	return 0;
+}
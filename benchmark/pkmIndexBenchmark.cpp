@@ -0,0 +1,165 @@
+/*
+ *  pkmIndexBenchmark.cpp
+ *
+ *  Recall against queries per second for the index backends (pkmKDTree,
+ *  and pkmHNSW and pkmIVFPQ over their search knobs).  The exact k nearest come
+ *  from pkmBruteForce's batched search, which is timed too, one query at a
+ *  time and in one batch, for every instruction set this machine has.
+ *  The data is a mixture of gaussians, roughly how MFCC frames of a few
+ *  dozen sounds spread; the queries are fresh draws from the same mixture.
+ *  recall@k is the fraction of the true k nearest found.
+ *
+ *  Build (from the repository root):
+ *
+ *  c++ -O2 -std=c++11 -I. benchmark/pkmIndexBenchmark.cpp -o pkmIndexBenchmark
+ *
+ *  ./pkmIndexBenchmark [frames = 100000] [dimensions = 13] [k = 10]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include "pkmKDTree.h"
+#include "pkmHNSW.h"
+#include "pkmIVFPQ.h"
+#include "pkmBruteForce.h"
+
+#define NUM_QUERIES 1000
+#define NUM_CLUSTERS 64
+
+typedef std::chrono::high_resolution_clock benchClock;
+
+static double secondsSince(benchClock::time_point start)
+{
+	return std::chrono::duration<double>(benchClock::now() - start).count();
+}
+
+static void fillMixture(std::vector<pkmIndexCoord> &centres, int count, int dim,
+						std::mt19937 &rng, std::vector<pkmIndexCoord> &out)
+{
+	std::normal_distribution<double> gauss(0.0, 1.0);
+	out.resize((size_t)count * dim);
+	for (int i = 0; i < count; i++) {
+		int c = (int)(rng() % NUM_CLUSTERS);
+		for (int j = 0; j < dim; j++)
+			out[(size_t)i * dim + j] = centres[(size_t)c * dim + j] + gauss(rng);
+	}
+}
+
+// searches every query, prints recall@k and queries per second
+static void measure(const char *name, const char *knob, int value,
+					const pkmIndexSegment &segment, const pkmIndexParams &params,
+					const std::vector<pkmIndexCoord> &rows, const std::vector<pkmIndexCoord> &queries, int dim, int k,
+					const std::vector<int> &truth)
+{
+	pkmIndexScratch scratch;
+	segment.reserve(scratch, k, params);
+	std::vector<int> found(k);
+	std::vector<pkmIndexDist> dists(k);
+
+	int hits = 0;
+	benchClock::time_point start = benchClock::now();
+	for (int q = 0; q < NUM_QUERIES; q++) {
+		int n = segment.search(&rows[0], &queries[(size_t)q * dim], k, &found[0], &dists[0], params, scratch);
+		const int *t = &truth[(size_t)q * k];
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < k; j++)
+				if (found[i] == t[j]) {
+					hits++;
+					break;
+				}
+	}
+	double seconds = secondsSince(start);
+	printf("%-8s  %-10s %6d  %8.4f  %10.0f\n", name, knob, value,
+		   (double)hits / ((double)NUM_QUERIES * k), NUM_QUERIES / seconds);
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 100000;
+	int dim = argc > 2 ? atoi(argv[2]) : 13;
+	int k = argc > 3 ? atoi(argv[3]) : 10;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> spread(-8.0, 8.0);
+	std::vector<pkmIndexCoord> centres((size_t)NUM_CLUSTERS * dim);
+	for (size_t i = 0; i < centres.size(); i++)
+		centres[i] = spread(rng);
+	std::vector<pkmIndexCoord> rows, queries;
+	fillMixture(centres, n, dim, rng, rows);
+	fillMixture(centres, NUM_QUERIES, dim, rng, queries);
+
+	std::vector<int> frames(n);
+	for (int i = 0; i < n; i++)
+		frames[i] = i;
+
+	printf("%d frames, %d dimensions, %d queries, k = %d\n\n", n, dim, NUM_QUERIES, k);
+	printf("%-8s  %-10s %6s  %8s  %10s\n", "index", "knob", "value", "recall", "queries/s");
+
+	// ground truth
+	std::vector<int> truth((size_t)NUM_QUERIES * k);
+	std::vector<pkmIndexDist> truthDists((size_t)NUM_QUERIES * k);
+	{
+		pkmBruteForce exact(&rows[0], n, dim);
+		exact.searchBatch(&queries[0], NUM_QUERIES, k, &truth[0], &truthDists[0]);
+	}
+
+	// value is the batch size
+	std::vector<int> batchFrames((size_t)NUM_QUERIES * k);
+	std::vector<pkmIndexDist> batchDists((size_t)NUM_QUERIES * k);
+	benchClock::time_point start;
+	for (int isa = PKM_BRUTEFORCE_ISA_SCALAR; isa < PKM_BRUTEFORCE_ISA_COUNT; isa++) {
+		if (!pkmBruteForceISASupported((pkmBruteForceISA)isa))
+			continue;
+		const char *isaName = pkmBruteForceISAName((pkmBruteForceISA)isa);
+		pkmBruteForce exact(&rows[0], n, dim, PKM_DISTANCE_L2, (pkmBruteForceISA)isa);
+		measure("exact", isaName, 1, exact, pkmIndexParams(), rows, queries, dim, k, truth);
+		start = benchClock::now();
+		exact.searchBatch(&queries[0], NUM_QUERIES, k, &batchFrames[0], &batchDists[0]);
+		double seconds = secondsSince(start);
+		int hits = 0;
+		for (size_t i = 0; i < batchFrames.size(); i++)
+			hits += batchFrames[i] == truth[i];
+		printf("%-8s  %-10s %6d  %8.4f  %10.0f\n", "exact", isaName, NUM_QUERIES,
+			   (double)hits / batchFrames.size(), NUM_QUERIES / seconds);
+	}
+
+	{
+		pkmIndexParams params;
+		pkmKDTree kd(&rows[0], frames, dim);
+		measure("kd-tree", "eps", 0, kd, params, rows, queries, dim, k, truth);
+	}
+
+	{
+		pkmIndexParams params;
+		start = benchClock::now();
+		pkmHNSW hnsw(&rows[0], frames, dim, params);
+		printf("\nhnsw built in %.2f s (M = %d, efConstruction = %d)\n", secondsSince(start),
+			   params.hnswM, params.hnswEfConstruction);
+		for (int ef = k; ef <= 512; ef *= 2) {
+			params.hnswEfSearch = ef;
+			measure("hnsw", "efSearch", ef, hnsw, params, rows, queries, dim, k, truth);
+		}
+	}
+
+	{
+		pkmIndexParams params;
+		params.ivfMinFrames = 0;
+		start = benchClock::now();
+		pkmIVFPQ ivf(&rows[0], frames, dim, params);
+		printf("\nivf-pq built in %.2f s (%d lists, %d subspaces)\n", secondsSince(start),
+			   ivf.getNumLists(), ivf.getNumSubspaces());
+		for (int probes = 1; probes <= 64; probes *= 2) {
+			params.ivfProbes = probes;
+			params.ivfRerank = 0;
+			measure("ivf-pq", "probes", probes, ivf, params, rows, queries, dim, k, truth);
+			params.ivfRerank = 8 * k;
+			measure("ivf-pq", "+rerank", probes, ivf, params, rows, queries, dim, k, truth);
+		}
+	}
+
+	return 0;
+}
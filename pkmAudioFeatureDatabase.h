@@ -9,43 +9,249 @@
 
 #pragma once
 #include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <condition_variable>
+#include <stdint.h>
 using namespace std;
 #include "pkmAudioFeatures.h"
 #include "pkmAudioFileAnalyzer.h"
 #include "pkmMatrix.h"
 #include "pkmAudioFile.h"
-#include "ANN.h"						// kd-tree
-#include <Accelerate/Accelerate.h>
+#include "ANN.h"						// ANNcoord, ANNidx, ANNdist
+#include "pkmDSP.h"
+#include "pkmSampleTypes.h"
+#include "pkmFeatureStore.h"
+#include "pkmIncrementalIndex.h"
+#include "pkmEpoch.h"
+#include "pkmRealtime.h"
+#include "pkmThreadPool.h"
+#include "pkmMappedFile.h"
+#include "pkmAudioStore.h"
+#include "pkmDatabaseFile.h"
 
-// include removal of sound from database and freeing memory
 // segmentation based on average segment's distance to database
-// write segments to extaf, and load from disk using ptr
 
+// when each sound was last matched, on the database's query clock, for
+// evicting the least recently used: stamped by the query threads (relaxed
+// atomics), and a copy takes the stamps along
+struct pkmSoundUses
+{
+	pkmSoundUses() : uses(NULL), size(0) {}
+	pkmSoundUses(const pkmSoundUses &rhs) : uses(NULL), size(0)
+	{
+		resize(rhs.size, 0);
+		for (int i = 0; i < size; i++)
+			set(i, rhs.get(i));
+	}
+	~pkmSoundUses()
+	{
+		delete [] uses;
+	}
+	
+	// keeps the stamps of the first n, new sounds get stamp
+	void resize(int n, uint64_t stamp)
+	{
+		atomic<uint64_t> *grown = n ? new atomic<uint64_t>[n] : NULL;
+		for (int i = 0; i < n; i++)
+			grown[i].store(i < size ? get(i) : stamp, memory_order_relaxed);
+		delete [] uses;
+		uses = grown;
+		size = n;
+	}
+	
+	inline void touch(int s, uint64_t stamp) const
+	{
+		if (s >= 0 && s < size) {
+			uses[s].store(stamp, memory_order_relaxed);
+		}
+	}
+	inline void set(int s, uint64_t stamp)		{ touch(s, stamp); }
+	inline uint64_t get(int s) const			{ return s >= 0 && s < size ? uses[s].load(memory_order_relaxed) : 0; }
+	
+private:
+	pkmSoundUses & operator=(const pkmSoundUses &);
+	
+	atomic<uint64_t>		*uses;
+	int						size;
+};
+
+// what getNearestFrame reads: built by the writer, published whole with an
+// atomic swap and never modified afterwards (but for the use stamps)
+struct pkmAudioFeatureSnapshot
+{
+	pkmIncrementalIndex		index;
+	vector<int>				soundFrames;	// first frame of every sound, ascending
+	vector<pkmAudioFile>	sounds;			// buffer and length of every sound
+	pkmSoundUses			soundUses;		// per sound, for eviction
+	
+	int						numNeighbors;
+	
+	// query scratch, sized here by the writer so the query thread (the
+	// only one writing it) never has to grow it
+	mutable vector<ANNidx>	nearestFrames;
+	mutable vector<ANNdist>	nearestDists;
+	mutable pkmIndexScratch	scratch;
+	
+	pkmAudioFeatureSnapshot(int dim) : index(dim), numNeighbors(0) {}
+	
+	// the next version; not the query scratch, the query thread may be in it
+	pkmAudioFeatureSnapshot(const pkmAudioFeatureSnapshot &rhs)
+	: index(rhs.index), soundFrames(rhs.soundFrames), sounds(rhs.sounds), 
+	  soundUses(rhs.soundUses), numNeighbors(0) {}
+	
+	void reserveQuery(int k)
+	{
+		numNeighbors = k;
+		nearestFrames.resize(k);
+		nearestDists.resize(k);
+		index.reserveScratch(scratch, k);
+	}
+	
+	// which sound a frame is of
+	inline int soundOf(int frame) const
+	{
+		return (int)(upper_bound(soundFrames.begin(), soundFrames.end(), frame) - soundFrames.begin()) - 1;
+	}
+	
+	// the audio of a frame, as audio_database has it
+	pkmAudioFile audioFrame(int frame, int hop_size) const
+	{
+		int s = soundOf(frame);
+		pkmAudioFile p = sounds[s];
+		p.offset = (frame - soundFrames[s]) * hop_size;
+		return p;
+	}
+	
+	static void release(void *snapshot)
+	{
+		delete (pkmAudioFeatureSnapshot *)snapshot;
+	}
+};
+
+// queryBatch's result: row f holds query frame f's nearest database
+// frames, closest first
+struct pkmAudioFeatureMatches
+{
+	int						numFrames,
+							k;
+	vector<int>				frames;			// numFrames x k, -1 past found[f]
+	vector<ANNdist>			distances;		// numFrames x k, squared as in getNearestFrames
+	vector<int>				found;			// per query frame
+	
+	pkmAudioFeatureMatches(int num_frames = 0, int num_neighbors = 0)
+	: numFrames(num_frames), k(num_neighbors), 
+	  frames((size_t)num_frames * num_neighbors, -1), 
+	  distances((size_t)num_frames * num_neighbors, 0), 
+	  found(num_frames, 0) {}
+	
+	inline int frame(int f, int i) const			{ return frames[(size_t)f * k + i]; }
+	inline ANNdist distance(int f, int i) const		{ return distances[(size_t)f * k + i]; }
+};
+
+// Threading: addSound/removeSound/buildIndex/compact (writers, serialized
+// on writerMutex) build a new snapshot off the audio thread and publish it
+// atomically; getNearestFrame (one audio thread) never blocks or frees
+// anything; the replaced snapshots and feature blocks are reclaimed
+// through pkmEpoch.  One getNearestFrames thread at a time: its search
+// scratch lives in the snapshot.
+//
+// Removed (or evicted) sounds drop out of the index at once, as
+// tombstones; compact() then reclaims their features and renumbers the
+// frames, on a background thread if setAutoCompact() or
+// setEvictionLimits() asked for it.  Their audio goes once no
+// pkmAudioPlayer holds it (see removeSound).  Sound ids (from addSound) are stable
+// across compactions, frame numbers are not.
 class pkmAudioFeatureDatabase
 {
 public:
 	pkmAudioFeatureDatabase(int sample_rate = 44100, 
-							int fft_size = 512)
+							int fft_size = 512,
+							int num_threads = 0,		// for queryBatch and addSounds, 0 = every core
+							int hop_size = 0,			// between database frames, 0 = fft_size
+							bool pad_tail = false)		// zero pad the last frame of each sound
 	{
 		sampleRate = sample_rate;
 		fftN = fft_size;
 		bBuiltIndex = false;
-		analyzer = new pkmAudioFileAnalyzer(sampleRate, fftN);
+		analyzer = new pkmAudioFileAnalyzer(sampleRate, fftN, hop_size, pad_tail);
+		hopN = analyzer->getHopSize();
+		queryAnalyzer = new pkmAudioFileAnalyzer(sampleRate, fftN);
+		batchAnalyzer = new pkmAudioFileAnalyzer(sampleRate, fftN);
+		batchPool = NULL;
+		ingestPool = NULL;
+		numBatchThreads = num_threads;
+		numFeatures = analyzer->mfccAnalyzer->getNumCoefficients();
+		numFrames = 0;
+		feature_database.setNumFeatures(numFeatures);
+		widened_features.setNumFeatures(numFeatures);
+		// moved blocks may still be read through the published snapshot
+		feature_database.setReleaseCallback([this](void *block) { releasedBlocks.push_back(block); });
+		widened_features.setReleaseCallback([this](void *block) { releasedBlocks.push_back(block); });
+		snapshot.store(NULL);
+		indexedFrames = 0;
+		indexBackend = PKM_INDEX_KDTREE;
+		mapped = NULL;
+		audioStore.setCacheSize(128, fftN);
+		nextSoundId = 0;
+		numRemovedSounds = 0;
+		numRemovedFrames = 0;
+		residentSamples = 0;
+		useClock.store(0);
+		nearestQueries.store(0);
+		maxFrames = 0;
+		maxBytes = 0;
+		compactFraction = 0;
+		compactor = NULL;
+		bCompactRequested = false;
+		bStopCompactor = false;
 		
 		k				= 1;								// number of nearest neighbors
-		nnIdx			= new ANNidx[k];					// allocate near neighbor indices
-		dists			= new ANNdist[k];					// allocate near neighbor dists	
+		dim				= numFeatures;
+		queryPt			= annAllocPt(dim);
+		queryFeatures	= (pkmFeature *)malloc(sizeof(pkmFeature) * dim);
 		
 	}
 	~pkmAudioFeatureDatabase()
 	{
+		if (compactor) {
+			{
+				lock_guard<mutex> lock(compactorMutex);
+				bStopCompactor = true;
+			}
+			compactorWake.notify_one();
+			compactor->join();
+			delete compactor;
+		}
 		delete analyzer;
+		delete queryAnalyzer;
+		delete batchAnalyzer;
+		delete batchPool;
+		delete ingestPool;
+		for (size_t i = 0; i < ingestAnalyzers.size(); i++) {
+			delete ingestAnalyzers[i];
+		}
+		delete snapshot.load();
+		annDeallocPt(queryPt);
+		free(queryFeatures);
 		
 		// we free here because in upper level the segmenter allocates this data
 		// this is really stupid but a solution for now.
 		for (int i = 0; i < unique_buffers.size(); i++) {
 			free(unique_buffers[i]);
 		}
+		for (size_t i = 0; i < sound_files.size(); i++) {
+			delete sound_files[i].pins;
+		}
+		// no player may outlive the database
+		for (size_t i = 0; i < parkedBuffers.size(); i++) {
+			free(parkedBuffers[i].buffer);
+			delete parkedBuffers[i].pins;
+		}
+		delete mapped;
 	}
 	
 	bool bShouldSegment(float *&buf, int size)
@@ -54,10 +260,10 @@ public:
 	}
 
 	
-	void addSound(float *&buf_copy, int size)
+	// takes buf_copy (malloc'd) and returns the sound's id
+	int addSound(float *&buf_copy, int size)
 	{
-		
-		vector<double * >		feature_matrix;
+		lock_guard<mutex>		lock(writerMutex);
 		vector<pkmAudioFile>	sound_lut;
 		int						num_frames, num_features;
 		
@@ -68,161 +274,1056 @@ public:
 		*/
 		
 		
-		// get the features for this buffer for every frame
+		// get the features for this buffer for every frame, appended to
+		// the feature store
 		analyzer->analyzeFile(buf_copy, 
 							  size, 
-							  feature_matrix,				// every audio frames mfccs
+							  feature_database,				// every audio frames mfccs
 							  sound_lut,					// every audio frame has a reference to the buffer, the offset, and the length of the buffer
 							  num_frames,					// total number of frames for this audio file
 							  num_features);				// number of coefficients
 		
-		/*
-		// concatenate features to our database
-		feature_database.insert(feature_database.end(),		// append it to the end of the feature database
-								feature_matrix.begin(), 
-								feature_matrix.end());
-		
 		// and the pointer to the audio frames
-		audio_database.insert(audio_database.end(),			// and the audio database
+		audio_database.insert(audio_database.end(),
 							  sound_lut.begin(), 
 							  sound_lut.end());
-		*/
-		
-		for (int i = 0; i < feature_matrix.size(); i++) {
-			feature_database.push_back(feature_matrix[i]);
-			audio_database.push_back(sound_lut[i]);
-		}
 		
 		//printf("features: %d, audio-frames: %d\n", feature_database.size(), audio_database.size());
+		sound_frames.push_back(numFrames);
+		sound_files.push_back(pkmAudioFile(buf_copy, 0, size));
+		sound_files.back().pins = new atomic<int>(0);
 		numFrames = feature_database.size();
 		numFeatures = num_features;
 		
 		// keep the buffer pointers for deallocation
 		unique_buffers.push_back(buf_copy);
+		residentSamples += size;
+		
+		return addedSound();
+	}
+	
+	// a sound left in audioStore (e.g. from audioStore.addFile()) rather
+	// than in memory: analyzed a block at a time, its frames refer to the
+	// store, so only what is played is ever paged in.  Returns its id, or
+	// -1 if source isn't in the store.
+	int addSound(int source)
+	{
+		lock_guard<mutex>		lock(writerMutex);
+		vector<pkmAudioFile>	sound_lut;
+		int						num_frames = 0, num_features = numFeatures;
+		
+		int size = audioStore.getNumSamples(source);
+		if (analyzer->getNumFrames(size) == 0) {
+			printf("[ERROR] pkmAudioFeatureDatabase: audio store source %d is not a sound\n", source);
+			return -1;
+		}
+		sound_frames.push_back(numFrames);
+		analyzer->analyzeSource(audioStore, source, feature_database, sound_lut, num_frames, num_features);
+		audio_database.insert(audio_database.end(), sound_lut.begin(), sound_lut.end());
+		sound_files.push_back(pkmAudioFile(&audioStore, source, 0, size));
+		numFrames = feature_database.size();
+		numFeatures = num_features;
+		
+		return addedSound();
 	}
 	
+	// a library at once: the sounds are analyzed in parallel, a bounded
+	// window at a time, each worker with its own analyzer, and committed
+	// in the order given while the next window is analyzed, so frame
+	// numbers and ids are the same as adding them one by one (and the
+	// index is updated once per window).  Takes
+	// the buffers as addSound does; returns the ids.
+	vector<int> addSounds(vector<float *> &buffers, const vector<int> &sizes)
+	{
+		vector<IngestJob> jobs(MIN(buffers.size(), sizes.size()));
+		for (size_t i = 0; i < jobs.size(); i++) {
+			jobs[i].buffer = buffers[i];
+			jobs[i].size = sizes[i];
+		}
+		return ingest(jobs);
+	}
+	
+	// the same for sounds in audioStore (see addSound(int source)), each
+	// streamed through its worker's analyzer; -1 for the ids of sources
+	// that aren't sounds
+	vector<int> addSounds(const vector<int> &sources)
+	{
+		vector<IngestJob> jobs(sources.size());
+		for (size_t i = 0; i < jobs.size(); i++) {
+			jobs[i].source = sources[i];
+			jobs[i].size = audioStore.getNumSamples(sources[i]);
+		}
+		return ingest(jobs);
+	}
+	
+	// takes a sound out of every search from the next query on (its frames
+	// are tombstoned in the index); its features go at the next compact().
+	// Its audio stays while a pkmAudioPlayer plays it: a frame from
+	// getNearestFrames (or getAudioFrame) stays playable if a player is
+	// made from it before the query thread's next getNearestFrames.
+	bool removeSound(int id)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		int s = soundPosition(id);
+		if (s < 0) {
+			printf("[ERROR] pkmAudioFeatureDatabase: no sound %d\n", id);
+			return false;
+		}
+		markRemoved(s);
+		if (bBuiltIndex) {
+			updateIndex();
+		}
+		requestCompaction(false);
+		return true;
+	}
+	
+	// reclaims the removed sounds' feature rows (and the audio no player
+	// holds) now, renumbering the frames and rebuilding the index over them
+	// (writers wait, the audio thread doesn't)
+	void compact()
+	{
+		lock_guard<mutex> lock(writerMutex);
+		compactRemoved();
+	}
+	
+	// compact() on a background thread whenever removed frames reach
+	// dead_fraction of the database; 0 (the default) leaves it to compact()
+	void setAutoCompact(float dead_fraction)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		compactFraction = MAX(dead_fraction, 0.0f);
+		requestCompaction(false);
+	}
+	
+	// once the live sounds are over max_frames frames or max_bytes of
+	// features (with the index's widened copy, if it keeps one) and
+	// in-memory audio (0 for no limit), addSound evicts the
+	// least recently matched sounds (never the one just added) and
+	// compacts in the background
+	void setEvictionLimits(int max_frames, size_t max_bytes = 0)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		maxFrames = MAX(max_frames, 0);
+		maxBytes = max_bytes;
+		evict(-1);
+	}
+	
+	// the id of the sound a frame (e.g. from queryBatch) is of, -1 if none
+	int getSoundId(int frame)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		int s = (int)(upper_bound(sound_frames.begin(), sound_frames.end(), frame) - sound_frames.begin()) - 1;
+		if (s < 0 || frame >= numFrames || sound_removed[s]) {
+			return -1;
+		}
+		return sound_ids[s];
+	}
+	
+	// indexes every frame added so far; only the frames since the last
+	// call are inserted, the existing index segments are kept
 	void buildIndex()
 	{
+		lock_guard<mutex> lock(writerMutex);
 
 		dim				= numFeatures;						// dimension of data (x,y,z)
 		pts				= numFrames;						// maximum number of data points
 		
-		if(bBuiltIndex)
-		{
-			delete kdTree;
-			bBuiltIndex = false;
-			annDeallocPts(positions);
+		updateIndex();
+		bBuiltIndex = true;
+		
+	}
+	
+	
+	// real-time safe nearest frames for the audio callback: writes up to
+	// num_nearest (at most getNumNeighbors()) frames into nearest, closest
+	// first, and returns how many.  No heap, stdio or locks, whatever the
+	// backend; searches whichever snapshot is published without waiting
+	// on writers.  One query thread at a time.
+	int getNearestFrames(float *frame, int bufferSize, pkmAudioFile *nearest, int num_nearest)
+	{
+		pkmRealtimeScope realtime;
+		if (bufferSize != fftN || num_nearest <= 0) {
+			return 0;
 		}
-
-		positions = annAllocPts(pts, dim);
-		for (int i = 0; i < pts; i++) 
-		{
-			for (int j = 0; j < dim; j++)
+		// the frames the last call handed out are in players (pinned) or
+		// dropped by now; publishes the pins to releaseParkedBuffers
+		nearestQueries.fetch_add(1, memory_order_acq_rel);
+		
+		int slot = epoch.enter();
+		const pkmAudioFeatureSnapshot *current = snapshot.load();
+		if (current == NULL) {
+			// First build the index with buildIndex()
+			epoch.exit(slot);
+			return 0;
+		}
+		
+		queryAnalyzer->mfccAnalyzer->computeMFCC(frame, queryFeatures);
+		for (int j = 0; j < dim; j++) {
+			queryPt[j] = (double)queryFeatures[j];
+		}
+		
+		int found = current->index.search(queryPt,		// query point
+										  MIN(num_nearest, current->numNeighbors),
+										  &current->nearestFrames[0],	// nearest frames (returned)
+										  &current->nearestDists[0],	// distance (returned)
+										  current->scratch);
+		
+		float sumDists = 0;
+		uint64_t now = useClock.fetch_add(1, memory_order_relaxed) + 1;
+		for (int i = 0; i < found; i++) {
+			sumDists += current->nearestDists[i];
+			current->soundUses.touch(current->soundOf(current->nearestFrames[i]), now);
+		}
+		for (int i = 0; i < found; i++) {
+			nearest[i] = current->audioFrame(current->nearestFrames[i], hopN);
+			if (found == 1) {
+				nearest[i].weight = 1.0;
+			}
+			else
 			{
-				positions[i][j] = feature_database[i][j];
+				nearest[i].weight = 1.0 - (current->nearestDists[i] / sumDists);
 			}
 		}
+		epoch.exit(slot);
 		
-		kdTree = new ANNkd_tree(							// build search structure
-								positions,//(ANNpointArray)&(feature_database[0]),		// the data points
-								pts,						// number of points
-								dim);						// dimension of space
-		bBuiltIndex = true;
+		return found;
+	}
+	
+	// the k nearest database frames of each of the numFrames consecutive
+	// fftN sample frames in buffer, e.g. a whole segment to resynthesize.
+	// The MFCCs of every frame come from one batched pass and the frames
+	// are searched together, split over the thread pool, alongside
+	// getNearestFrames if need be.  Offline use: allocates and blocks.
+	pkmAudioFeatureMatches queryBatch(float *buffer, int numFrames, int k)
+	{
+		pkmAudioFeatureMatches matches(MAX(numFrames, 0), MAX(k, 0));
+		if (numFrames <= 0 || k <= 0) {
+			return matches;
+		}
+		
+		lock_guard<mutex> lock(batchMutex);
+		batchFeatures.resize((size_t)numFrames * dim);
+		batchAnalyzer->mfccAnalyzer->computeMFCCBatch(buffer, fftN, numFrames, &batchFeatures[0]);
+		
+		int slot = epoch.enter();
+		const pkmAudioFeatureSnapshot *current = snapshot.load();
+		if (current == NULL) {
+			epoch.exit(slot);
+			printf("[ERROR] pkmAudioFeatureDatabase: First build the index with buildIndex()\n");
+			return matches;
+		}
 		
+		const pkmIncrementalIndex &index = current->index;
+		if (batchPool == NULL) {
+			batchPool = new pkmThreadPool(numBatchThreads);
+		}
+		int numChunks = index.isReentrant() ? MIN(numFrames, batchPool->getNumThreads() * 4) : 1;
+		int chunkFrames = (numFrames + numChunks - 1) / numChunks;
+		batchPool->run(numChunks, [&](int chunk, int) {
+			int first = chunk * chunkFrames;
+			int count = MIN(chunkFrames, numFrames - first);
+			if (count > 0) {
+				index.searchBatch(&batchFeatures[(size_t)first * dim], count, k,
+								  &matches.frames[(size_t)first * k],
+								  &matches.distances[(size_t)first * k],
+								  &matches.found[first]);
+			}
+		});
+		uint64_t now = useClock.fetch_add(1, memory_order_relaxed) + 1;
+		for (size_t i = 0; i < matches.frames.size(); i++) {
+			if (matches.frames[i] >= 0) {
+				current->soundUses.touch(current->soundOf(matches.frames[i]), now);
+			}
+		}
+		epoch.exit(slot);
+		
+		return matches;
 	}
 	
+	// the audio of a database frame, e.g. from queryBatch
+	pkmAudioFile getAudioFrame(int frame)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		int s = (int)(upper_bound(sound_frames.begin(), sound_frames.end(), frame) - sound_frames.begin()) - 1;
+		if (s < 0 || frame >= numFrames) {
+			return pkmAudioFile(fftN);
+		}
+		pkmAudioFile p = sound_files[s];
+		p.offset = (frame - sound_frames[s]) * hopN;
+		return p;
+	}
 	
-	// get called in the audio requested thread at audio rate
+	// get called in the audio requested thread at audio rate; allocates the
+	// returned vector, use getNearestFrames in the callback itself
 	vector<pkmAudioFile> getNearestFrame(float *&frame, int bufferSize)
 	{
-		vector<pkmAudioFile> nearestAudioFrames;
-		if (bufferSize != fftN) {
-			//printf("[ERROR] Buffer size does not match database settings");
-			return nearestAudioFrames;
+		vector<pkmAudioFile> nearestAudioFrames(k);
+		nearestAudioFrames.resize(getNearestFrames(frame, bufferSize, &nearestAudioFrames[0], k));
+		return nearestAudioFrames;
+	}
+	
+	// k for the next published index (takes effect on the next update)
+	void setNumNeighbors(int num_neighbors)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		k = MAX(num_neighbors, 1);
+		if (bBuiltIndex) {
+			updateIndex();
 		}
-		if (!bBuiltIndex) {
-			//printf("[ERROR] First build the index with buildIndex()");
-			return nearestAudioFrames;
+	}
+	
+	inline int getNumNeighbors()
+	{
+		return k;
+	}
+	
+	// which search structure the index is made of (PKM_INDEX_KDTREE by
+	// default; HNSW or IVF-PQ trade exactness for speed on large
+	// databases) and its knobs.  A new backend rebuilds the index on this
+	// thread; new search knobs only republish it.
+	void setIndexBackend(pkmIndexBackend backend, const pkmIndexParams &params = pkmIndexParams())
+	{
+		lock_guard<mutex> lock(writerMutex);
+		indexBackend = backend;
+		indexParams = params;
+		if (bBuiltIndex) {
+			updateIndex();
 		}
-		vector<double * > feature_matrix;
-		vector<pkmAudioFile> audio_instance;
-		int num_frames, num_features;
-		analyzer->analyzeFile(frame, 
-							  bufferSize, 
-							  feature_matrix,				// every audio frames mfccs
-							  audio_instance,				// every audio frame has a reference to the buffer, the offset, and the length of the buffer
-							  num_frames,					// total number of frames for this audio file
-							  num_features);				// number of coefficients
-
-
-		// just the first frame
-		ANNpoint queryPt = feature_matrix[0];
+	}
+	
+	inline pkmIndexBackend getIndexBackend()
+	{
+		return indexBackend;
+	}
+	
+	// writes the features, sounds, frame table and index to path (through
+	// a temporary file renamed over it, so a crash leaves the old file) in
+	// the pkmDatabaseFile.h layout, for load().  16 bit pcm_formats halve
+	// the audio on disk; load() decodes them through audioStore.
+	bool save(const char *path, pkmAudioSampleFormat pcm_format = PKM_AUDIO_FLOAT32)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		// removed sounds aren't saved
+		compactRemoved();
 		
-		kdTree->annkSearch(							// search
-						   queryPt,					// query point
-						   k,						// number of near neighbors
-						   nnIdx,					// nearest neighbors (returned)
-						   dists,					// distance (returned)
-						   0.0000001);				// error bound
+		pkmDatabaseHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, PKM_DATABASE_MAGIC, sizeof(PKM_DATABASE_MAGIC));
+		header.version = PKM_DATABASE_VERSION;
+		header.byteOrder = PKM_DATABASE_BYTE_ORDER;
+		header.headerBytes = sizeof(header);
+		strncpy(header.featureType, PKM_DATABASE_STRINGIFY(PKM_FEATURE_TYPE), sizeof(header.featureType) - 1);
+		header.featureBytes = sizeof(pkmFeature);
+		header.featureLayout = feature_database.getLayout();
+		header.numFeatures = numFeatures;
+		header.sampleRate = sampleRate;
+		header.fftSize = fftN;
+		header.hopSize = hopN;
+		header.numFrames = numFrames;
+		header.numSounds = (int32_t)sound_files.size();
+		header.numNeighbors = k;
+		header.bBuiltIndex = bBuiltIndex;
+		header.indexedFrames = indexedFrames;
+		header.pcmFormat = pcm_format;
 		
+		vector<pkmDatabaseSound> sounds(sound_files.size());
+		uint64_t samples = 0;
+		for (size_t s = 0; s < sounds.size(); s++) {
+			sounds[s].sample = samples;
+			sounds[s].length = sound_files[s].length;
+			sounds[s].firstFrame = sound_frames[s];
+			samples += sound_files[s].length;
+		}
+		vector<pkmDatabaseFrame> frames(numFrames);
+		for (int i = 0, s = 0; i < numFrames; i++) {
+			while (s + 1 < (int)sound_frames.size() && sound_frames[s + 1] <= i) {
+				s++;
+			}
+			frames[i].sound = s;
+			frames[i].offset = audio_database[i].offset;
+			frames[i].length = audio_database[i].length;
+		}
+		pkmIndexBlob index;
+		pkmAudioFeatureSnapshot *current = snapshot.load();
+		if (bBuiltIndex && current) {
+			current->index.save(index);
+		}
 		
-		float sumDists = 0;
-		int i = 0;
-		while (i < k) {
-			sumDists += dists[i];
-			i++;
+		uint64_t sectionBytes[PKM_DATABASE_NUM_SECTIONS];
+		sectionBytes[PKM_DATABASE_FEATURES] = (uint64_t)numFrames * numFeatures * sizeof(pkmFeature);
+		sectionBytes[PKM_DATABASE_SOUNDS] = sounds.size() * sizeof(pkmDatabaseSound);
+		sectionBytes[PKM_DATABASE_FRAMES] = frames.size() * sizeof(pkmDatabaseFrame);
+		sectionBytes[PKM_DATABASE_PCM] = samples * pkmAudioSampleBytes(pcm_format);
+		sectionBytes[PKM_DATABASE_INDEX] = index.bytes.size();
+		uint64_t offset = pkmDatabaseAlign(sizeof(header));
+		for (int i = 0; i < PKM_DATABASE_NUM_SECTIONS; i++) {
+			header.sections[i].offset = offset;
+			header.sections[i].bytes = sectionBytes[i];
+			offset = pkmDatabaseAlign(offset + sectionBytes[i]);
+		}
+		
+		string temporary = string(path) + ".tmp";
+		FILE *file = fopen(temporary.c_str(), "wb");
+		if (file == NULL) {
+			printf("[ERROR] pkmAudioFeatureDatabase: could not write %s\n", temporary.c_str());
+			return false;
+		}
+		pkmDatabaseWriter out(file);
+		out.write(&header, sizeof(header));
+		out.pad();
+		if (feature_database.getLayout() == PKM_FEATURE_ROWS || numFrames == 0) {
+			out.write(feature_database.getData(), sectionBytes[PKM_DATABASE_FEATURES]);
+		}
+		else {
+			for (int j = 0; j < numFeatures; j++) {
+				out.write(feature_database.column(j), (size_t)numFrames * sizeof(pkmFeature));
+			}
+		}
+		out.pad();
+		out.write(sounds.empty() ? NULL : &sounds[0], sectionBytes[PKM_DATABASE_SOUNDS]);
+		out.pad();
+		out.write(frames.empty() ? NULL : &frames[0], sectionBytes[PKM_DATABASE_FRAMES]);
+		out.pad();
+		vector<float> pcm(fftN * 64);
+		vector<char> encoded(pcm.size() * sizeof(float));
+		for (size_t s = 0; s < sound_files.size(); s++) {
+			for (int at = 0; at < sound_files[s].length; at += (int)pcm.size()) {
+				int count = MIN((int)pcm.size(), sound_files[s].length - at);
+				sound_files[s].read(at, count, &pcm[0]);
+				pkmAudioEncode(&pcm[0], count, pcm_format, &encoded[0]);
+				out.write(&encoded[0], (size_t)count * pkmAudioSampleBytes(pcm_format));
+			}
+		}
+		out.pad();
+		out.write(index.bytes.empty() ? NULL : &index.bytes[0], index.bytes.size());
+		bool written = out.ok && fflush(file) == 0;
+		written = fclose(file) == 0 && written;
+#if defined(_WIN32)
+		bool renamed = written && MoveFileExA(temporary.c_str(), path, MOVEFILE_REPLACE_EXISTING);
+#else
+		bool renamed = written && rename(temporary.c_str(), path) == 0;
+#endif
+		if (!renamed) {
+			remove(temporary.c_str());
+			printf("[ERROR] pkmAudioFeatureDatabase: could not write %s\n", path);
+			return false;
+		}
+		return true;
+	}
+	
+	// maps a file written by save() into this (empty) database: features
+	// and audio (through audioStore) are used in place, paged in as they're
+	// touched, and a saved
+	// kd-tree, HNSW or IVF-PQ index is restored without rebuilding
+	// (brute-force segments are repacked from the mapped rows).  Sounds added
+	// afterwards copy the features out of the file first.  The analyzer's
+	// sample rate, fft and hop size and MFCC count must be the ones saved with.
+	bool load(const char *path)
+	{
+		lock_guard<mutex> lock(writerMutex);
+		if (numFrames || !sound_files.empty() || mapped) {
+			printf("[ERROR] pkmAudioFeatureDatabase: can only load into an empty database\n");
+			return false;
 		}
 		
+		pkmMappedFile *file = new pkmMappedFile();
+		if (!file->open(path)) {
+			delete file;
+			return false;
+		}
+		const char *base = file->getData();
+		pkmDatabaseHeader header;
+		memset(&header, 0, sizeof(header));
+		if (file->size() >= sizeof(header)) {
+			memcpy(&header, base, sizeof(header));
+		}
 		
+		const char *problem = NULL;
+		if (file->size() < sizeof(header) || memcmp(header.magic, PKM_DATABASE_MAGIC, sizeof(PKM_DATABASE_MAGIC)) != 0) {
+			problem = "not a feature database";
+		}
+		else if (header.byteOrder != PKM_DATABASE_BYTE_ORDER) {
+			problem = "written with another byte order";
+		}
+		else if (header.version != PKM_DATABASE_VERSION || header.headerBytes != sizeof(header)) {
+			problem = "written by another version";
+		}
+		else if (strncmp(header.featureType, PKM_DATABASE_STRINGIFY(PKM_FEATURE_TYPE), sizeof(header.featureType)) != 0 ||
+				 header.featureBytes != (int32_t)sizeof(pkmFeature) ||
+				 header.featureLayout != feature_database.getLayout()) {
+			problem = "written with another PKM_FEATURE_TYPE or layout";
+		}
+		else if (header.numFeatures != numFeatures || header.sampleRate != sampleRate || 
+				 header.fftSize != fftN || header.hopSize != hopN) {
+			problem = "analyzed with another sample rate, fft or hop size or number of coefficients";
+		}
+		else if (header.numFrames < 0 || header.numSounds < 0 || header.numNeighbors < 1 ||
+				 header.pcmFormat < PKM_AUDIO_FLOAT32 || header.pcmFormat > PKM_AUDIO_HALF ||
+				 header.indexedFrames < 0 || header.indexedFrames > header.numFrames) {
+			problem = "corrupt";
+		}
+		else {
+			uint64_t expected[PKM_DATABASE_NUM_SECTIONS - 2] = {
+				(uint64_t)header.numFrames * header.numFeatures * sizeof(pkmFeature),
+				(uint64_t)header.numSounds * sizeof(pkmDatabaseSound),
+				(uint64_t)header.numFrames * sizeof(pkmDatabaseFrame)
+			};
+			for (int i = 0; i < PKM_DATABASE_NUM_SECTIONS && !problem; i++) {
+				const pkmDatabaseSectionEntry &section = header.sections[i];
+				if (section.offset % PKM_DATABASE_ALIGNMENT || section.offset > file->size() ||
+					section.bytes > file->size() - section.offset ||
+					(i < PKM_DATABASE_PCM && section.bytes != expected[i]) ||
+					(i == PKM_DATABASE_PCM && section.bytes % pkmAudioSampleBytes((pkmAudioSampleFormat)header.pcmFormat))) {
+					problem = "truncated or corrupt";
+				}
+			}
+		}
 		
-		//printf("sum dist: %f\n", sumDists);
-		//if (isnan(sumDists)) {
-		//	return nearestAudioFrames;
-		//}
+		const pkmDatabaseSound *sounds = (const pkmDatabaseSound *)(base + header.sections[PKM_DATABASE_SOUNDS].offset);
+		const pkmDatabaseFrame *frames = (const pkmDatabaseFrame *)(base + header.sections[PKM_DATABASE_FRAMES].offset);
+		pkmAudioSampleFormat pcmFormat = (pkmAudioSampleFormat)header.pcmFormat;
+		const char *pcm = base + header.sections[PKM_DATABASE_PCM].offset;
+		uint64_t samples = problem ? 0 : header.sections[PKM_DATABASE_PCM].bytes / pkmAudioSampleBytes(pcmFormat);
+		for (int s = 0; s < header.numSounds && !problem; s++) {
+			if (sounds[s].length < 0 || sounds[s].sample > samples || 
+				(uint64_t)sounds[s].length > samples - sounds[s].sample ||
+				sounds[s].firstFrame < (s ? sounds[s - 1].firstFrame : 0) || sounds[s].firstFrame > header.numFrames) {
+				problem = "corrupt";
+			}
+		}
+		for (int i = 0; i < header.numFrames && !problem; i++) {
+			if (frames[i].sound < 0 || frames[i].sound >= header.numSounds ||
+				frames[i].offset < 0 || frames[i].offset > sounds[frames[i].sound].length) {
+				problem = "corrupt";
+			}
+		}
+		if (problem) {
+			printf("[ERROR] pkmAudioFeatureDatabase: %s is %s\n", path, problem);
+			delete file;
+			return false;
+		}
 		
-		for (int i = 0; i < k; i++) {
-			//printf("i-th idx: %d, dist: %f\n", nnIdx[i], dists[i]);
-			pkmAudioFile p = audio_database[nnIdx[i]];
-			if (k == 1) {
-				p.weight = 1.0;
+		// pkmFeature * into a read only mapping: the store never writes an
+		// adopted block
+		feature_database.adopt((pkmFeature *)(base + header.sections[PKM_DATABASE_FEATURES].offset), header.numFrames);
+		int firstSource = audioStore.size();
+		for (int s = 0; s < header.numSounds; s++) {
+			audioStore.addMemory(pcm + sounds[s].sample * pkmAudioSampleBytes(pcmFormat), pcmFormat, sounds[s].length);
+			sound_files.push_back(pkmAudioFile(&audioStore, firstSource + s, 0, sounds[s].length));
+			sound_frames.push_back(sounds[s].firstFrame);
+			sound_ids.push_back(nextSoundId++);
+			sound_removed.push_back(0);
+		}
+		audio_database.reserve(header.numFrames);
+		for (int i = 0; i < header.numFrames; i++) {
+			audio_database.push_back(pkmAudioFile(&audioStore, firstSource + frames[i].sound, frames[i].offset, frames[i].length));
+		}
+		mapped = file;
+		numFrames = header.numFrames;
+		k = header.numNeighbors;
+		pts = numFrames;
+		
+		if (header.bBuiltIndex) {
+			pkmAudioFeatureSnapshot *next = new pkmAudioFeatureSnapshot(numFeatures);
+			const pkmDatabaseSectionEntry &section = header.sections[PKM_DATABASE_INDEX];
+			pkmIndexReader in(base + section.offset, (size_t)section.bytes);
+			if (section.bytes && next->index.load(in, indexRows(), header.indexedFrames)) {
+				indexBackend = next->index.getBackend();
+				indexParams = next->index.getParams();
+				indexedFrames = header.indexedFrames;
 			}
-			else
-			{
-				p.weight =  1.0 - (dists[i] / sumDists);
+			else {
+				indexedFrames = 0;
 			}
-			printf("i-th idx: %d, dist: %f, norm_dist: %f\n", nnIdx[i], dists[i], p.weight);
-			
-			//nearestAudioFrames.push_back(audio_database[nnIdx[i]]);
-			nearestAudioFrames.push_back(p);
+			publish(next);
+			bBuiltIndex = true;
 		}
-
-		return nearestAudioFrames;
+		retireReleasedBlocks();
+		return true;
 	}
 	
+	// live sounds
 	inline int size()
 	{
-		return unique_buffers.size();
+		lock_guard<mutex> lock(writerMutex);
+		return (int)sound_files.size() - numRemovedSounds;
+	}
+	
+	// a copy of the published snapshot with the frames added since the
+	// last update, swapped in for the audio thread; the copy shares every
+	// unchanged index segment
+	void updateIndex()
+	{
+		pkmAudioFeatureSnapshot *current = snapshot.load();
+		publish(current ? new pkmAudioFeatureSnapshot(*current)
+						: new pkmAudioFeatureSnapshot(numFeatures));
+	}
+	
+	// next, with the frames since indexedFrames inserted and the pending
+	// removals tombstoned, swapped in for the published snapshot
+	void publish(pkmAudioFeatureSnapshot *next)
+	{
+		pkmAudioFeatureSnapshot *current = snapshot.load();
+		next->index.setRows(indexRows());
+		next->index.setBackend(indexBackend, indexParams);
+		next->index.insert(indexedFrames, numFrames - indexedFrames);
+		for (size_t i = 0; i < pendingRemovals.size(); i++) {
+			next->index.remove(pendingRemovals[i].first, pendingRemovals[i].second);
+		}
+		pendingRemovals.clear();
+		next->soundFrames = sound_frames;
+		next->sounds = sound_files;
+		next->soundUses.resize((int)sound_files.size(), useClock.load(memory_order_relaxed));
+		next->reserveQuery(k);
+		indexedFrames = numFrames;
+		pts = numFrames;
+		
+		snapshot.store(next);
+		if (current) {
+			epoch.retire(current, pkmAudioFeatureSnapshot::release);
+		}
+		retireReleasedBlocks();
+	}
+	
+	// the id, index and eviction once a sound's frames are in
+	int addedSound()
+	{
+		int id = newSoundId();
+		
+		// once there is an index, new sounds go straight into it
+		if (bBuiltIndex) {
+			updateIndex();
+		}
+		else {
+			retireReleasedBlocks();
+		}
+		evict((int)sound_files.size() - 1);
+		return id;
+	}
+	
+	int newSoundId()
+	{
+		sound_ids.push_back(nextSoundId);
+		sound_removed.push_back(0);
+		return nextSoundId++;
+	}
+	
+	// one sound of addSounds: in (buffer, or source in audioStore),
+	// analyzed by a worker, then committed by the caller
+	struct IngestJob
+	{
+		float						*buffer;
+		int							source,
+									size;
+		pkmFeatureStore<pkmFeature>	*features;
+		vector<pkmAudioFile>		frames;
+		
+		IngestJob() : buffer(NULL), source(-1), size(0), features(NULL) {}
+	};
+	
+	vector<int> ingest(vector<IngestJob> &jobs)
+	{
+		lock_guard<mutex> ingestLock(ingestMutex);
+		if (ingestPool == NULL) {
+			ingestPool = new pkmThreadPool(numBatchThreads);
+			for (int i = 0; i < ingestPool->getNumThreads(); i++) {
+				ingestAnalyzers.push_back(new pkmAudioFileAnalyzer(sampleRate, fftN, hopN, analyzer->getPadTail()));
+			}
+		}
+		
+		// two windows are held at once: the workers analyze one while this
+		// thread commits the one before, then joins them in wait()
+		size_t window = ingestPool->getNumThreads() * 4, windowStart[2];
+		pkmThreadPool::Job analyzeWindow[2];
+		for (int w = 0; w < 2; w++) {
+			analyzeWindow[w] = [&, w](int task, int worker) {
+				analyzeJob(jobs[windowStart[w] + task], ingestAnalyzers[worker]);
+			};
+		}
+		windowStart[0] = 0;
+		ingestPool->start((int)min(jobs.size(), window), analyzeWindow[0]);
+		
+		vector<int> ids;
+		for (size_t first = 0, w = 0; first < jobs.size(); first += window, w ^= 1) {
+			int count = (int)min(jobs.size() - first, window);
+			ingestPool->wait();
+			if (first + window < jobs.size()) {
+				windowStart[w ^ 1] = first + window;
+				ingestPool->start((int)min(jobs.size() - first - window, window), analyzeWindow[w ^ 1]);
+			}
+			
+			lock_guard<mutex> lock(writerMutex);
+			for (int t = 0; t < count; t++) {
+				ids.push_back(commitJob(jobs[first + t]));
+			}
+			if (bBuiltIndex) {
+				updateIndex();
+			}
+			else {
+				retireReleasedBlocks();
+			}
+			evict((int)sound_files.size() - 1);
+		}
+		return ids;
+	}
+	
+	// frame features, on a worker
+	void analyzeJob(IngestJob &job, pkmAudioFileAnalyzer *worker)
+	{
+		int num_frames, num_features;
+		if (job.buffer) {
+			job.features = new pkmFeatureStore<pkmFeature>(numFeatures);
+			worker->analyzeFile(job.buffer, job.size, *job.features, job.frames, num_frames, num_features);
+		}
+		else if (worker->getNumFrames(job.size) > 0) {
+			job.features = new pkmFeatureStore<pkmFeature>(numFeatures);
+			worker->analyzeSource(audioStore, job.source, *job.features, job.frames, num_frames, num_features);
+		}
+	}
+	
+	// into the database, in order, under writerMutex
+	int commitJob(IngestJob &job)
+	{
+		if (job.features == NULL) {
+			printf("[ERROR] pkmAudioFeatureDatabase: audio store source %d is not a sound\n", job.source);
+			return -1;
+		}
+		sound_frames.push_back(numFrames);
+		if (job.features->size()) {
+			feature_database.append(job.features->getData(), job.features->size());
+		}
+		audio_database.insert(audio_database.end(), job.frames.begin(), job.frames.end());
+		if (job.buffer) {
+			sound_files.push_back(pkmAudioFile(job.buffer, 0, job.size));
+			sound_files.back().pins = new atomic<int>(0);
+			unique_buffers.push_back(job.buffer);
+			residentSamples += job.size;
+		}
+		else {
+			sound_files.push_back(pkmAudioFile(&audioStore, job.source, 0, job.size));
+		}
+		numFrames = feature_database.size();
+		
+		delete job.features;
+		job.features = NULL;
+		vector<pkmAudioFile>().swap(job.frames);
+		return newSoundId();
+	}
+	
+	// position of a live sound in sound_files, -1 if none
+	int soundPosition(int id)
+	{
+		vector<int>::iterator it = lower_bound(sound_ids.begin(), sound_ids.end(), id);
+		if (it == sound_ids.end() || *it != id || sound_removed[it - sound_ids.begin()]) {
+			return -1;
+		}
+		return (int)(it - sound_ids.begin());
+	}
+	
+	inline int soundEnd(int s)
+	{
+		return s + 1 < (int)sound_frames.size() ? sound_frames[s + 1] : numFrames;
+	}
+	
+	// tombstones sound s at the next publish
+	void markRemoved(int s)
+	{
+		int first = sound_frames[s], count = soundEnd(s) - first;
+		sound_removed[s] = 1;
+		numRemovedSounds++;
+		numRemovedFrames += count;
+		if (sound_files[s].buffer) {
+			residentSamples -= sound_files[s].length;
+		}
+		pendingRemovals.push_back(make_pair(first, count));
+	}
+	
+	// removes the least recently matched live sounds but keep until the
+	// limits hold, then has them compacted away
+	void evict(int keep)
+	{
+		if (maxFrames == 0 && maxBytes == 0) {
+			return;
+		}
+		const pkmAudioFeatureSnapshot *current = snapshot.load();
+		// a frame's features, and its widened copy when the index needs one
+		size_t frameBytes = numFeatures * sizeof(pkmFeature);
+		if (widened_features.size() > 0) {
+			frameBytes += numFeatures * sizeof(ANNcoord);
+		}
+		bool evicted = false;
+		for (;;) {
+			size_t liveFrames = numFrames - numRemovedFrames;
+			size_t bytes = liveFrames * frameBytes + residentSamples * sizeof(float);
+			if ((maxFrames == 0 || liveFrames <= (size_t)maxFrames) && (maxBytes == 0 || bytes <= maxBytes)) {
+				break;
+			}
+			// never matched sounds first, then oldest use; ties go to the oldest sound
+			int victim = -1;
+			uint64_t oldest = 0;
+			for (int s = 0; s < (int)sound_files.size(); s++) {
+				if (s == keep || sound_removed[s]) {
+					continue;
+				}
+				uint64_t used = current ? current->soundUses.get(s) : 0;
+				if (victim < 0 || used < oldest) {
+					victim = s;
+					oldest = used;
+				}
+			}
+			if (victim < 0) {
+				break;
+			}
+			markRemoved(victim);
+			evicted = true;
+		}
+		if (evicted) {
+			if (bBuiltIndex) {
+				updateIndex();
+			}
+			requestCompaction(true);
+		}
+	}
+	
+	// wakes the compactor if there is enough to reclaim (or anything, if
+	// forced); starts it the first time
+	void requestCompaction(bool force)
+	{
+		if (numRemovedSounds == 0 ||
+			(!force && (compactFraction <= 0 || numRemovedFrames < compactFraction * numFrames))) {
+			return;
+		}
+		if (compactor == NULL) {
+			compactor = new thread(&pkmAudioFeatureDatabase::compactorLoop, this);
+		}
+		{
+			lock_guard<mutex> lock(compactorMutex);
+			bCompactRequested = true;
+		}
+		compactorWake.notify_one();
+	}
+	
+	void compactorLoop()
+	{
+		unique_lock<mutex> lock(compactorMutex);
+		for (;;) {
+			while (!bCompactRequested && !bStopCompactor) {
+				compactorWake.wait(lock);
+			}
+			if (bStopCompactor) {
+				return;
+			}
+			bCompactRequested = false;
+			lock.unlock();
+			{
+				lock_guard<mutex> writer(writerMutex);
+				compactRemoved();
+			}
+			lock.lock();
+		}
+	}
+	
+	// the live sounds' rows into a fresh block and frames renumbered, the
+	// index rebuilt over them; the old block and snapshot go through the
+	// epoch, the removed sounds' buffers are parked until no player holds
+	// them.  Sounds in audioStore stay mapped.
+	void compactRemoved()
+	{
+		if (numRemovedSounds == 0) {
+			return;
+		}
+		int liveFrames = numFrames - numRemovedFrames;
+		vector<pkmFeature>		rows((size_t)liveFrames * numFeatures);
+		vector<pkmAudioFile>	audio;
+		vector<pkmAudioFile>	files;
+		vector<int>				frames, ids, kept;		// kept: old position of each sound
+		audio.reserve(liveFrames);
+		int at = 0;
+		for (int s = 0; s < (int)sound_files.size(); s++) {
+			if (sound_removed[s]) {
+				float *buffer = sound_files[s].buffer;
+				vector<float *>::iterator it = find(unique_buffers.begin(), unique_buffers.end(), buffer);
+				if (buffer && it != unique_buffers.end()) {
+					unique_buffers.erase(it);
+					ParkedBuffer parked = { buffer, sound_files[s].pins, nearestQueries.load(memory_order_acquire) };
+					parkedBuffers.push_back(parked);
+				}
+				continue;
+			}
+			frames.push_back(at);
+			for (int i = sound_frames[s]; i < soundEnd(s); i++, at++) {
+				feature_database.getRow(i, &rows[(size_t)at * numFeatures]);
+				audio.push_back(audio_database[i]);
+			}
+			files.push_back(sound_files[s]);
+			ids.push_back(sound_ids[s]);
+			kept.push_back(s);
+		}
+		
+		feature_database.reset();
+		widened_features.reset();
+		if (liveFrames) {
+			feature_database.append(&rows[0], liveFrames);
+		}
+		audio_database.swap(audio);
+		sound_files.swap(files);
+		sound_frames.swap(frames);
+		sound_ids.swap(ids);
+		sound_removed.assign(sound_files.size(), 0);
+		numFrames = liveFrames;
+		numRemovedSounds = 0;
+		numRemovedFrames = 0;
+		pendingRemovals.clear();
+		indexedFrames = 0;
+		
+		if (bBuiltIndex) {
+			const pkmAudioFeatureSnapshot *current = snapshot.load();
+			pkmAudioFeatureSnapshot *next = new pkmAudioFeatureSnapshot(numFeatures);
+			next->soundUses.resize((int)kept.size(), 0);
+			for (size_t i = 0; i < kept.size(); i++) {
+				next->soundUses.set((int)i, current ? current->soundUses.get(kept[i]) : 0);
+			}
+			publish(next);
+		}
+		else {
+			pts = numFrames;
+			retireReleasedBlocks();
+		}
+	}
+	
+	// feature blocks the stores moved away from, once nothing published
+	// points into them, and the parked buffers players are done with
+	void retireReleasedBlocks()
+	{
+		for (size_t i = 0; i < releasedBlocks.size(); i++)
+			epoch.retire(releasedBlocks[i], pkmAlignedFree);
+		releasedBlocks.clear();
+		releaseParkedBuffers();
+	}
+	
+	// a parked buffer goes once it is unpinned and getNearestFrames has
+	// been called since it was parked: every frame of it handed out before
+	// is then in a player or dropped, and none can be handed out after
+	void releaseParkedBuffers()
+	{
+		uint64_t queries = nearestQueries.load(memory_order_acquire);
+		size_t kept = 0;
+		for (size_t i = 0; i < parkedBuffers.size(); i++) {
+			ParkedBuffer &parked = parkedBuffers[i];
+			if (queries > parked.queries && parked.pins->load(memory_order_acquire) == 0) {
+				epoch.retire(parked.buffer, free);
+				delete parked.pins;
+			}
+			else {
+				parkedBuffers[kept++] = parked;
+			}
+		}
+		parkedBuffers.resize(kept);
+	}
+	
+	// row major ANNcoords the index can point into: the store itself when
+	// it holds them, otherwise widened_features caught up to numFrames
+	ANNcoord * indexRows()
+	{
+		return indexRows(feature_database.getData());
+	}
+	ANNcoord * indexRows(ANNcoord *rows)
+	{
+		if (feature_database.getLayout() == PKM_FEATURE_ROWS) {
+			return rows;
+		}
+		return widenRows();
+	}
+	template <typename T>
+	ANNcoord * indexRows(T *)
+	{
+		return widenRows();
+	}
+	ANNcoord * widenRows()
+	{
+		int first = widened_features.size();
+		if (numFrames > first) {
+			ANNcoord *rows = widened_features.appendRows(numFrames - first);
+			for (int i = first; i < numFrames; i++) 
+			{
+				for (int j = 0; j < numFeatures; j++)
+				{
+					rows[(size_t)(i - first)*numFeatures + j] = (ANNcoord)feature_database.get(i, j);
+				}
+			}
+		}
+		return widened_features.getData();
 	}
 	
 	
 	int							sampleRate, 
-								fftN;
-	pkmAudioFileAnalyzer		*analyzer;
-	vector<double *>			feature_database;
+								fftN,
+								hopN;				// between a sound's frames
+	pkmAudioFileAnalyzer		*analyzer,
+								*queryAnalyzer,		// only used by getNearestFrame
+								*batchAnalyzer;		// only used by queryBatch
+	pkmFeatureStore<pkmFeature>	feature_database;		// double unless PKM_FEATURE_TYPE says otherwise
 	vector<pkmAudioFile>		audio_database;
-	vector<float *>				unique_buffers;
+	vector<float *>				unique_buffers;			// addSound()ed buffers, freed with the database
+	pkmAudioStore				audioStore;				// sounds that aren't (addSound(source), load())
+	pkmMappedFile				*mapped;				// the file load() read, features and sounds point into it
+	vector<int>					sound_frames;			// first frame of every sound
+	vector<pkmAudioFile>		sound_files;			// every sound's whole buffer
+	vector<int>					sound_ids;				// every sound's id, ascending
+	vector<unsigned char>		sound_removed;			// removed, not compacted yet
+	int							nextSoundId,
+								numRemovedSounds,
+								numRemovedFrames;
+	size_t						residentSamples;		// in unique_buffers, of live sounds
+	vector<pair<int, int> >		pendingRemovals;		// frame ranges for the next publish
 	int							numFeatures,
 								numFrames;
 	
-	ANNpointArray				positions;
+	pkmFeatureStore<ANNcoord>	widened_features;		// for the index when feature_database isn't row major ANNcoords
+	ANNpoint					queryPt;
 	
 	// For kNN
-	ANNkd_tree					*kdTree;		// distances to nearest HRTFs
-	ANNidxArray					nnIdx;			// near neighbor indices
-	ANNdistArray				dists;			// near neighbor distances
+	atomic<pkmAudioFeatureSnapshot *>	snapshot;	// published index, read by the audio thread
+	pkmEpoch					epoch;			// frees replaced snapshots and blocks
+	mutex						writerMutex;
+	vector<void *>				releasedBlocks;	// moved feature blocks not retired yet
+	int							indexedFrames;	// frames inserted into the index so far
+	pkmIndexBackend				indexBackend;	// what the index segments are
+	pkmIndexParams				indexParams;
+	pkmFeature					*queryFeatures;	// query thread MFCCs
+	atomic<uint64_t>			useClock;		// stamps sounds' last match
+	atomic<uint64_t>			nearestQueries;	// getNearestFrames calls
+	
+	// For removal and eviction
+	struct ParkedBuffer
+	{
+		float					*buffer;
+		atomic<int>				*pins;
+		uint64_t				queries;		// nearestQueries when parked
+	};
+	vector<ParkedBuffer>		parkedBuffers;	// removed sounds' audio, see releaseParkedBuffers
+	int							maxFrames;
+	size_t						maxBytes;
+	float						compactFraction;
+	thread						*compactor;		// made on first use
+	mutex						compactorMutex;
+	condition_variable			compactorWake;
+	bool						bCompactRequested,
+								bStopCompactor;
+	
+	// For queryBatch
+	mutex						batchMutex;
+	pkmThreadPool				*batchPool;		// made on first use
+	int							numBatchThreads;
+	vector<ANNcoord>			batchFeatures;
+	
+	// For addSounds
+	mutex						ingestMutex;
+	pkmThreadPool				*ingestPool;	// made on first use
+	vector<pkmAudioFileAnalyzer *>	ingestAnalyzers;	// one per worker
 	int							k;				// number of nearest neighbors
 	int							dim;			// dimension of each point
 	int							pts;			// number of points
 //	ANNpointArray				positions;		// positions of each filter
-	bool						bBuiltIndex, bSemaphore;
+	bool						bBuiltIndex;
 };
\ No newline at end of file
@@ -42,17 +42,81 @@
  *		af->computeMFCC(input, mfccs);
  *  }
  *
+ *  // 13 liftered MFCCs over 40 mel bands up to 8k, only 13 DCT rows built
+ *  pkmAudioFeaturesConfig config;
+ *  config.bands = PKM_BANDS_MEL;
+ *  config.hiEdge = 8000;
+ *  config.numCoefficients = 13;
+ *  config.lifter = 22;
+ *  config.logFloor = 1e-10;
+ *  af = new pkmAudioFeatures(44100, 2048, config);
+ *
+ *  // several descriptors from the same FFT, into one row
+ *  int set = PKM_FEATURE_MFCC | PKM_FEATURE_CENTROID | PKM_FEATURE_CHROMA;
+ *  float *row = (float *)malloc(sizeof(float) * af->getNumFeatures(set));
+ *  af->computeFeatures(input, row, set);
+ *
  */
 
 #pragma once
 
-#include <Accelerate/Accelerate.h>
+#include "pkmDSP.h"
 #include "pkmMatrix.h"
 #include "pkmFFT.h"
+#include "pkmSampleTypes.h"
 #include "stdio.h"
 #include "string.h"
+#include <cmath>
 
 #define CQ_ENV_THRESH 0.001   // Sparse matrix threshold (for efficient matrix multiplicaton)	
+#define MFCC_BATCH_FRAMES 64  // frames per block in computeMFCCBatch
+
+enum pkmAudioFeaturesBands
+{
+	PKM_BANDS_CQT,			// gaussian constant-Q bands, bandsPerOctave per octave
+	PKM_BANDS_MEL			// triangular mel bands, numMelBands of them
+};
+
+// descriptors for computeFeatures, or'd together; a feature row holds the
+// requested ones in this order
+enum pkmAudioFeatureSet
+{
+	PKM_FEATURE_MFCC		= 1 << 0,		// getNumCoefficients() values
+	PKM_FEATURE_CENTROID	= 1 << 1,		// Hz
+	PKM_FEATURE_ROLLOFF		= 1 << 2,		// Hz, 85% of the power
+	PKM_FEATURE_FLATNESS	= 1 << 3,		// 0 (tonal) .. 1 (noise)
+	PKM_FEATURE_FLUX		= 1 << 4,
+	PKM_FEATURE_RMS			= 1 << 5,
+	PKM_FEATURE_ZCR			= 1 << 6,		// crossings per sample
+	PKM_FEATURE_CHROMA		= 1 << 7,		// 12 values, C first, peak 1
+	PKM_FEATURE_ALL			= 0xff
+};
+
+struct pkmAudioFeaturesConfig
+{
+	pkmAudioFeaturesBands	bands;
+	int						bandsPerOctave,		// CQT layout
+							numMelBands;		// mel layout
+	
+	float					loEdge,				// band range in Hz
+							hiEdge;
+	
+	int						numCoefficients;	// DCT rows computed, -1 for one per band
+	float					lifter;				// sinusoidal lifter L, 0 for none
+	float					logFloor;			// band power floor before the log, 0 for none
+	
+	pkmAudioFeaturesConfig()
+	{
+		bands = PKM_BANDS_CQT;
+		bandsPerOctave = 12;
+		numMelBands = 40;
+		loEdge = 40.0 * pow(2.0, 2.5/12.0);		// low C minus quater tone
+		hiEdge = 2000.0;
+		numCoefficients = -1;
+		lifter = 0;
+		logFloor = 0;
+	}
+};
 
 class pkmAudioFeatures
 {
@@ -65,40 +129,66 @@ public:
 		setup();
 	}
 	
+	pkmAudioFeatures(int sample_rate, int fft_size, const pkmAudioFeaturesConfig &feature_config)
+	{
+		sampleRate = sample_rate;
+		fftN = fft_size;
+		config = feature_config;
+		
+		setup();
+	}
+	
 	~pkmAudioFeatures()
 	{
 		free(CQT);
 		free(cqStart);
 		free(cqStop);
+		free(cqtOffsets);
+		free(cqtWeights);
 		
 		free(DCT);
 		
 		free(cqtVector);
 		free(dctVector);
-		
-		free(fft);
+		free(cqtVectorD);
+		free(bandFreqs);
+		free(bandChroma);
+		
+		free(batchMagnitudes);
+		free(batchBands);
+		free(batchMFCCs);
+		free(cqtTransposed);
+		free(dctTransposed);
+		free(prevMagnitudes);
+		
+		delete fft;
 		free(fft_magnitudes);
-		free(fft_phases);
-		
-		free(foutput);
 	}
 	
 	void setup()
 	{
-		bpoN = 12;
+		bpoN = config.bandsPerOctave;
+		bSparseCQT = true;
+		
+		// allocated on the first batch call
+		batchMagnitudes = batchBands = batchMFCCs = NULL;
+		cqtTransposed = dctTransposed = NULL;
 		
 		fft = new pkmFFT(fftN);
 		fftOutN = fft->fftSizeOver2;
 		fft_magnitudes = (float *)malloc(sizeof(float) * fftOutN);
-		fft_phases = (float *)malloc(sizeof(float) * fftOutN);
 		
-		// low C minus quater tone
-		loEdge = 40.0 * pow(2.0, 2.5/12.0);		//55.0
-		hiEdge = 2000.0;						//8000.0
+		loEdge = config.loEdge;
+		hiEdge = MIN(config.hiEdge, sampleRate / 2.0f);
 		
 		// Constant-Q bandwidth
 		fratio = pow(2.0, 1.0/(float)bpoN);				
-		cqtN = (int) floor(log(hiEdge/loEdge)/log(fratio));
+		if (config.bands == PKM_BANDS_MEL) {
+			cqtN = config.numMelBands;
+		}
+		else {
+			cqtN = (int) floor(log(hiEdge/loEdge)/log(fratio));
+		}
 		
 		if(cqtN<1)
 			printf("warning: cqtN not positive definite\n");
@@ -110,19 +200,36 @@ public:
 		cqStart = (int *)malloc(sizeof(int)*cqtN);					
 		cqStop = (int *)malloc(sizeof(int)*cqtN);					
 		
-		// Full spectrum DCT matrix
-		dctN = cqtN; 
-		DCT = (float *)malloc(sizeof(float)*cqtN*dctN);
+		// Only the DCT rows we hand out
+		dctN = config.numCoefficients < 0 ? cqtN : MIN(config.numCoefficients, cqtN); 
+		DCT = (float *)malloc(sizeof(float)*dctN*cqtN);
 		
 		// Our transforms (mel bands)
 		cqtVector = (float *)malloc(sizeof(float)*cqtN);	
 		dctVector = (float *)malloc(sizeof(float)*dctN);	
+		cqtVectorD = (double *)malloc(sizeof(double)*cqtN);
+		bandFreqs = (float *)malloc(sizeof(float)*cqtN);
 		
-		foutput = (float *)malloc(sizeof(float) * dctN);
+		// previous frame for the flux
+		prevMagnitudes = (float *)malloc(sizeof(float)*fftOutN);
+		vDSP_vclr(prevMagnitudes, 1, fftOutN);
 		
 		// initialize maps
-		createLogFreqMap();
+		if (config.bands == PKM_BANDS_MEL) {
+			createMelMap();
+		}
+		else {
+			createLogFreqMap();
+		}
+		createSparseCQT();
 		createDCT();
+		
+		// pitch class of every band center, C = 0
+		bandChroma = (int *)malloc(sizeof(int)*cqtN);
+		for (int i = 0; i < cqtN; i++) {
+			int semitone = (int)floorf(12.0 * log2f(bandFreqs[i] / 440.0) + 0.5) + 9;
+			bandChroma[i] = ((semitone % 12) + 12) % 12;
+		}
 	}
 	
 	void createLogFreqMap()
@@ -143,13 +250,13 @@ public:
 		for(i = 0; i < cqtN; i++)
 		{
 			logfrqs[i] = loEdge * powf(2.0,(float)i/bpoN);
+			bandFreqs[i] = logfrqs[i];
 			logfbws[i] = MAX(logfrqs[i] * (fratio - 1.0), sampleRate / N);
 		}
 		
 		float ovfctr = 0.5475;					// Norm constant so CQT'*CQT close to 1.0
 		float tmp,tmp2;
 		float *ptr;
-		float cqEnvThresh = CQ_ENV_THRESH;		// Sparse matrix threshold (for efficient matrix multiplicaton)	
 		
 		assert(CQT);
 		
@@ -159,38 +266,25 @@ public:
 		{
 			mxnorm[i] = 0.0;
 			tmp2 = 1.0 / (ovfctr * logfbws[i]);
-			for(j = 0; j < fftOutN; j++, ptr++)
+			for(j = 0; j < fftOutN; j++)
 			{
 				tmp = (logfrqs[i] - fftfrqs[j])*tmp2;
-				tmp = expf(-0.5 * tmp*tmp);
-				*ptr = tmp;								// row major transform
-				mxnorm[i] += tmp*tmp;
-			}      
+				ptr[j] = -0.5 * tmp*tmp;
+			}
+			vvexpf(ptr, ptr, &fftOutN);					// row major transform
+			for(j = 0; j < fftOutN; j++)
+				mxnorm[i] += ptr[j]*ptr[j];
 			mxnorm[i] = 2.0 * sqrtf(mxnorm[i]);
+			ptr += fftOutN;
 		}
 		
 		// Normalize transform matrix for identity inverse
 		ptr = CQT;    
 		for(i = 0; i < cqtN; i++)
 		{
-			cqStart[i] = 0;
-			cqStop[i] = 0;
 			tmp = 1.0/mxnorm[i];
 			for(j = 0; j < fftOutN; j++, ptr++)
-			{
 				*ptr *= tmp;
-				if( (!cqStart[i]) && 
-					(cqEnvThresh < *ptr) )
-				{
-					cqStart[i] = j;
-				}
-				else if( (!cqStop[i]) && 
-						 (cqStart[i]) && 
-						 (*ptr < cqEnvThresh) )
-				{
-					cqStop[i] = j;
-				}
-			}
 		}
 
 		// cleanup local dynamic memory
@@ -200,6 +294,91 @@ public:
 		free(mxnorm);
 	}
 	
+	// Triangular filters with peak 1, centers evenly spaced on the mel scale
+	// between loEdge and hiEdge
+	void createMelMap()
+	{
+		float loMel = 2595.0 * log10f(1.0 + loEdge / 700.0);
+		float hiMel = 2595.0 * log10f(1.0 + hiEdge / 700.0);
+		
+		// cqtN + 2 edges, band i rises from edge i to i+1 and falls to i+2
+		float *edges = (float *)malloc(sizeof(float)*(cqtN + 2));
+		for (int i = 0; i < cqtN + 2; i++) {
+			float mel = loMel + (hiMel - loMel) * i / (float)(cqtN + 1);
+			edges[i] = 700.0 * (powf(10.0, mel / 2595.0) - 1.0);
+		}
+		
+		float *ptr = CQT;
+		for (int i = 0; i < cqtN; i++)
+		{
+			float lo = edges[i], center = edges[i + 1], hi = edges[i + 2];
+			bandFreqs[i] = center;
+			for (int j = 0; j < fftOutN; j++, ptr++)
+			{
+				float f = j * sampleRate / (float)fftN;
+				if (f <= lo || f >= hi) {
+					*ptr = 0.0;
+				}
+				else if (f <= center) {
+					*ptr = (f - lo) / (center - lo);
+				}
+				else {
+					*ptr = (hi - f) / (hi - center);
+				}
+			}
+		}
+		
+		free(edges);
+	}
+	
+	// Band sparse copy of the CQT: band i keeps only its bins above 
+	// CQ_ENV_THRESH, cqStart[i] .. cqStop[i]-1, stored back to back from 
+	// cqtWeights + cqtOffsets[i]
+	void createSparseCQT()
+	{
+		float cqEnvThresh = CQ_ENV_THRESH;		// Sparse matrix threshold (for efficient matrix multiplicaton)	
+		
+		for (int i = 0; i < cqtN; i++)
+		{
+			const float *row = CQT + i*fftOutN;
+			cqStart[i] = -1;
+			cqStop[i] = 0;
+			for (int j = 0; j < fftOutN; j++)
+			{
+				if (cqEnvThresh < row[j])
+				{
+					if (cqStart[i] < 0) {
+						cqStart[i] = j;
+					}
+					cqStop[i] = j + 1;
+				}
+			}
+			if (cqStart[i] < 0) {
+				cqStart[i] = 0;
+			}
+		}
+		
+		cqtOffsets = (int *)malloc(sizeof(int)*(cqtN + 1));
+		cqtOffsets[0] = 0;
+		for (int i = 0; i < cqtN; i++)
+			cqtOffsets[i + 1] = cqtOffsets[i] + (cqStop[i] - cqStart[i]);
+		
+		cqtWeights = (float *)malloc(sizeof(float)*MAX(cqtOffsets[cqtN], 1));
+		for (int i = 0; i < cqtN; i++)
+			cblas_scopy(cqStop[i] - cqStart[i], CQT + i*fftOutN + cqStart[i], 1, 
+						cqtWeights + cqtOffsets[i], 1);
+	}
+	
+	// dense product with the full CQT matrix, or (default) the band sparse
+	// one which only touches bins above CQ_ENV_THRESH
+	void setSparseCQT(bool sparse)
+	{
+		bSparseCQT = sparse;
+	}
+	
+	// Orthonormal DCT-II, row i gives coefficient i; only the dctN rows that
+	// are handed out are built.  The lifter and the 1/cqtN normalization are
+	// folded into the rows.
 	void createDCT()
 	{
 
@@ -214,131 +393,381 @@ public:
 		for ( j = 0 ; j < cqtN ; j++ )
 			DCT[ j ] *= sqrtf(2.0) / 2.0;
 		
+		for( i = 0 ; i < dctN ; i++ )
+		{
+			float scale = 1.0 / (float)cqtN;
+			if (config.lifter > 0) {
+				scale *= 1.0 + 0.5 * config.lifter * sinf(M_PI * i / config.lifter);
+			}
+			vDSP_vsmul(DCT + i * cqtN, 1, &scale, DCT + i * cqtN, 1, cqtN);
+		}
 	}
 	
-	void computeMFCC(float *input, float*& output, int numMFCCS = -1)
+	// output is float, double, pkmHalf or pkmBFloat16 (pkmSampleTypes.h).
+	// The CQT and DCT stages run in pkmComputeType<T>, so double outputs are
+	// computed in double and the 16-bit types in float, and every 
+	// coefficient is written straight into output.  Only the first 
+	// numMFCCS (at most getNumCoefficients()) DCT rows are computed.
+	template <typename T>
+	void computeMFCC(float *input, T*& output, int numMFCCS = -1)
 	{
+		typedef typename pkmComputeType<T>::type C;
 		
-		// should window input buffer before FFT
-		fft->forward(0, input, fft_magnitudes, fft_phases);
+		// should window input buffer before FFT (phase is never used here)
+		fft->forwardMagnitude(input, fft_magnitudes);
 		
-		// sparse matrix product of CQT * FFT
-		int a = 0,b = 0;
-		float *ptr1 = 0, *ptr2 = 0, *ptr3 = 0;
-		float* mfccPtr = 0;
+		C *cqt = getCQTVector((C *)NULL);
+		computeBands(cqt);
+		computeCepstrum(cqt, output, numMFCCS < 0 ? dctN : MIN(numMFCCS, dctN));
+	}
+	
+	// MFCCs of numFrames magnitude spectra of fftN/2 bins each, e.g. the
+	// magnitude matrix from pkmSTFT, into rows of getNumCoefficients().  
+	// Blocks of MFCC_BATCH_FRAMES frames go through the band projection, 
+	// one vectorized log over the whole block and one DCT matrix product 
+	// (vDSP_mmul) instead of a product per frame.  Computed in float.
+	template <typename T>
+	void computeMFCCBatch(const float *magnitudes, int numFrames, T *output)
+	{
+		allocateBatch();
+		for (int f = 0; f < numFrames; f += MFCC_BATCH_FRAMES) {
+			int count = MIN(MFCC_BATCH_FRAMES, numFrames - f);
+			projectBatch(magnitudes + f*fftOutN, count, output + f*dctN);
+		}
+	}
+	
+	// MFCCs of numFrames frames of fftN samples, frame f at signal + f*hop,
+	// with the FFTs done by pkmFFT::forwardBatch a block at a time
+	template <typename T>
+	void computeMFCCBatch(float *signal, int hop, int numFrames, T *output)
+	{
+		allocateBatch();
+		for (int f = 0; f < numFrames; f += MFCC_BATCH_FRAMES) {
+			int count = MIN(MFCC_BATCH_FRAMES, numFrames - f);
+			fft->forwardBatch(signal + f*hop, hop, count, batchMagnitudes, NULL);
+			projectBatch(batchMagnitudes, count, output + f*dctN);
+		}
+	}
+	
+	// every row of M_magnitudes (e.g. from pkmSTFT::STFT) to a row of M_mfccs
+	void computeMFCC(pkm::Mat &M_magnitudes, pkm::Mat &M_mfccs)
+	{
+		if (M_mfccs.rows != M_magnitudes.rows || M_mfccs.cols != dctN) {
+			M_mfccs.reset(M_magnitudes.rows, dctN, true);
+		}
+		computeMFCCBatch(M_magnitudes.data, M_magnitudes.rows, M_mfccs.data);
+	}
+	
+	// Any set of PKM_FEATURE_* descriptors from one FFT of input (and one 
+	// band projection for MFCC and chroma), written back to back into 
+	// output in the order of the enum; getNumFeatures(features) long.
+	// Flux is against the previous frame passed to this instance.
+	template <typename T>
+	void computeFeatures(float *input, T *output, int features)
+	{
+		typedef typename pkmComputeType<T>::type C;
 		
-		/*
-		for( a = 0; a < cqtN ; a++ )
-		{
-			ptr1 = cqtVector + a; // constant-Q transform vector
-			*ptr1 = 0.0;
-			ptr2 = CQT + a * fftOutN + cqStart[a];
-			ptr3 = fft_magnitudes + cqStart[a];
-			b = cqStop[a] - cqStart[a];
-			while(b--){
-				*ptr1 += *ptr2++ * *ptr3++;
-			}
+		fft->forwardMagnitude(input, fft_magnitudes);
+		const float *m = fft_magnitudes;
+		
+		C *cqt = getCQTVector((C *)NULL);
+		C chroma[12];
+		if (features & (PKM_FEATURE_MFCC | PKM_FEATURE_CHROMA)) {
+			computeBands(cqt);
 		}
-		*/
 		
-		vDSP_mmul(fft_magnitudes, 1, CQT, 1, cqtVector, 1, 1, cqtN, fftOutN);
-
-		// LFCC 
-		a = cqtN;
-		ptr1 = cqtVector;
-		while( a-- ){
-			float f = *ptr1;
-			*ptr1++ = log10f( f*f );
+		// chroma needs the band energies before the log
+		if (features & PKM_FEATURE_CHROMA) {
+			C peak = 0;
+			for (int c = 0; c < 12; c++)
+				chroma[c] = 0;
+			for (int i = 0; i < cqtN; i++)
+				chroma[bandChroma[i]] += cqt[i]*cqt[i];
+			for (int c = 0; c < 12; c++)
+				peak = MAX(peak, chroma[c]);
+			for (int c = 0; c < 12 && peak > 0; c++)
+				chroma[c] /= peak;
 		}
 		
-		/*
-		a = dctN;
-		ptr2 = DCT; // point to column of DCT
-		mfccPtr = output;
-		while( a-- )
-		{
-			ptr1 = cqtVector;  // point to cqt vector
-			*mfccPtr = 0.0; 
-			b = cqtN;
-			while( b-- )
-				*mfccPtr += (float)(*ptr1++ * *ptr2++);
-			mfccPtr++;	
+		if (features & PKM_FEATURE_MFCC) {
+			computeCepstrum(cqt, output, dctN);
+			output += dctN;
 		}
-		*/
 		
-		if (numMFCCS == -1) {
-			vDSP_mmul(cqtVector, 1, DCT, 1, output, 1, 1, dctN, cqtN);
+		if (features & (PKM_FEATURE_CENTROID | PKM_FEATURE_ROLLOFF | PKM_FEATURE_FLATNESS))
+		{
+			C sumMagnitude = 0, sumPower = 0, sumLogPower = 0;
+			for (int k = 0; k < fftOutN; k++) {
+				C p = (C)m[k]*(C)m[k];
+				sumMagnitude += m[k];
+				sumPower += p;
+				sumLogPower += std::log(p + (C)1e-20);
+			}
 			
-			float n = dctN;
-			vDSP_vsdiv(output, 1, &n, output, 1, dctN);
+			if (features & PKM_FEATURE_CENTROID) {
+				C weighted = 0;
+				for (int k = 0; k < fftOutN; k++)
+					weighted += (C)k * (C)m[k];
+				*output++ = (T)(sumMagnitude > 0 ? weighted / sumMagnitude * binHz() : 0);
+			}
+			
+			// frequency below which 85% of the power lies
+			if (features & PKM_FEATURE_ROLLOFF) {
+				C threshold = (C)0.85 * sumPower, cumulative = 0;
+				int k = 0;
+				while (k < fftOutN - 1 && (cumulative += (C)m[k]*(C)m[k]) < threshold)
+					k++;
+				*output++ = (T)(k * binHz());
+			}
 			
-			//float rms_feature = pkm::Mat::rms(output, cqtN);
-			//output[1] = expf(rms_feature);
+			// geometric over arithmetic mean of the power spectrum
+			if (features & PKM_FEATURE_FLATNESS) {
+				C arithmetic = sumPower / fftOutN;
+				*output++ = (T)(arithmetic > 0 ? std::exp(sumLogPower / fftOutN) / arithmetic : 0);
+			}
+		}
+		
+		// rectified L2 change of the magnitudes since the last frame
+		if (features & PKM_FEATURE_FLUX) {
+			C flux = 0;
+			for (int k = 0; k < fftOutN; k++) {
+				C d = (C)m[k] - (C)prevMagnitudes[k];
+				if (d > 0)
+					flux += d*d;
+			}
+			*output++ = (T)std::sqrt(flux);
+		}
+		cblas_scopy(fftOutN, fft_magnitudes, 1, prevMagnitudes, 1);
+		
+		// time domain, no FFT needed
+		if (features & PKM_FEATURE_RMS) {
+			C sum = 0;
+			for (int i = 0; i < fftN; i++)
+				sum += (C)input[i]*(C)input[i];
+			*output++ = (T)std::sqrt(sum / fftN);
+		}
+		
+		if (features & PKM_FEATURE_ZCR) {
+			int crossings = 0;
+			for (int i = 1; i < fftN; i++)
+				crossings += (input[i - 1] >= 0) != (input[i] >= 0);
+			*output++ = (T)((C)crossings / (C)(fftN - 1));
+		}
+		
+		if (features & PKM_FEATURE_CHROMA) {
+			for (int c = 0; c < 12; c++)
+				*output++ = (T)chroma[c];
+		}
+	}
+	
+	// length of the row computeFeatures writes for this set
+	int getNumFeatures(int features)
+	{
+		int n = 0;
+		if (features & PKM_FEATURE_MFCC)		n += dctN;
+		if (features & PKM_FEATURE_CENTROID)	n++;
+		if (features & PKM_FEATURE_ROLLOFF)		n++;
+		if (features & PKM_FEATURE_FLATNESS)	n++;
+		if (features & PKM_FEATURE_FLUX)		n++;
+		if (features & PKM_FEATURE_RMS)			n++;
+		if (features & PKM_FEATURE_ZCR)			n++;
+		if (features & PKM_FEATURE_CHROMA)		n += 12;
+		return n;
+	}
+	
+	inline const pkmAudioFeaturesConfig & getConfig()
+	{
+		return config;
+	}
+	
+	inline int getNumBands()
+	{
+		return cqtN;
+	}
+	
+	inline int getNumCoefficients()
+	{
+		return dctN;
+	}
+	
+	
+private:
+	
+	// band magnitudes of fft_magnitudes
+	template <typename C>
+	void computeBands(C *cqt)
+	{
+		if (bSparseCQT) {
+			sparseCQT(cqt);
 		}
 		else {
-			vDSP_mmul(cqtVector, 1, DCT, 1, foutput, 1, 1, dctN, cqtN);
-			cblas_scopy(numMFCCS, foutput, 1, output, 1);
-			
-			float n = dctN;
-			vDSP_vsdiv(output, 1, &n, output, 1, numMFCCS);
-			
-			//float rms_feature = pkm::Mat::rms(output, cqtN);
-			//output[1] = expf(rms_feature);
+			denseCQT(cqt);
 		}
-
-		//float n = (float) dctN;
-		//vDSP_vsdiv(output, 1, &n, output, 1, dctN);
-		 
 	}
 	
-	void computeMFCC(float *input, double*& output, int numMFCCS = -1)
+	// log band energies (in place) and the first n DCT rows of them
+	template <typename C, typename T>
+	void computeCepstrum(C *cqt, T *output, int n)
 	{
-		
-		// should window input buffer before FFT
-		fft->forward(0, input, fft_magnitudes, fft_phases);
-		
-		// sparse matrix product of CQT * FFT
-		int a = 0,b = 0;
-		float *ptr1 = 0, *ptr2 = 0, *ptr3 = 0;
-		float* mfccPtr = 0;
-		
-		vDSP_mmul(fft_magnitudes, 1, CQT, 1, cqtVector, 1, 1, cqtN, fftOutN);
-		
 		// LFCC 
-		a = cqtN;
-		ptr1 = cqtVector;
-		while( a-- ){
-			float f = *ptr1;
-			*ptr1++ = log10f( f*f );
-		}
+		logBands(cqt);
 		
-		vDSP_mmul(cqtVector, 1, DCT, 1, foutput, 1, 1, dctN, cqtN);
-		if (numMFCCS == -1) {
-			vDSP_vspdp(foutput, 1, output, 1, dctN);
-			
-			double n = dctN;
-			vDSP_vsdivD(output, 1, &n, output, 1, dctN);
-			//double rms_feature = pkm::Mat::rms(output, cqtN);
-			//output[1] = expf(rms_feature);
+		// truncated DCT
+		for (int i = 0; i < n; i++)
+			output[i] = (T)dot(DCT + i*cqtN, cqt, cqtN);
+	}
+	
+	// log10 of the floored band energies, in place; float goes through
+	// the same vectorized path as the batch
+	void logBands(float *cqt)
+	{
+		float logFloor = config.logFloor;
+		vDSP_vsq(cqt, 1, cqt, 1, cqtN);
+		vDSP_vthr(cqt, 1, &logFloor, cqt, 1, cqtN);
+		vvlog10f(cqt, cqt, &cqtN);
+	}
+	void logBands(double *cqt)
+	{
+		double logFloor = config.logFloor;
+		for (int j = 0; j < cqtN; j++)
+			cqt[j] = std::log10(MAX(cqt[j]*cqt[j], logFloor));
+	}
+	
+	void allocateBatch()
+	{
+		if (batchMagnitudes) {
+			return;
+		}
+		batchMagnitudes = (float *)malloc(sizeof(float)*MFCC_BATCH_FRAMES*fftOutN);
+		batchBands = (float *)malloc(sizeof(float)*MFCC_BATCH_FRAMES*cqtN);
+		batchMFCCs = (float *)malloc(sizeof(float)*MFCC_BATCH_FRAMES*dctN);
+		
+		// transposed copies so both projections are plain row major products
+		cqtTransposed = (float *)malloc(sizeof(float)*fftOutN*cqtN);
+		for (int i = 0; i < cqtN; i++)
+			cblas_scopy(fftOutN, CQT + i*fftOutN, 1, cqtTransposed + i, cqtN);
+		dctTransposed = (float *)malloc(sizeof(float)*cqtN*dctN);
+		for (int i = 0; i < dctN; i++)
+			cblas_scopy(cqtN, DCT + i*cqtN, 1, dctTransposed + i, dctN);
+	}
+	
+	// count (<= MFCC_BATCH_FRAMES) magnitude rows to count MFCC rows
+	template <typename T>
+	void projectBatch(const float *magnitudes, int count, T *output)
+	{
+		// bands; the packed sparse weights are small enough to stay in cache
+		// across the block, so go frame by frame through the magnitudes
+		if (bSparseCQT) {
+			for (int f = 0; f < count; f++) {
+				const float *m = magnitudes + f*fftOutN;
+				float *bands = batchBands + f*cqtN;
+				for (int i = 0; i < cqtN; i++)
+					vDSP_dotpr(cqtWeights + cqtOffsets[i], 1, m + cqStart[i], 1, bands + i, 
+							   cqtOffsets[i + 1] - cqtOffsets[i]);
+			}
 		}
 		else {
-			vDSP_vspdp(foutput, 1, output, 1, numMFCCS);
-			
-			double n = dctN;
-			vDSP_vsdivD(output, 1, &n, output, 1, numMFCCS);
-			//double rms_feature = pkm::Mat::rms(output, cqtN);
-			//output[1] = expf(rms_feature);
+			vDSP_mmul(magnitudes, 1, cqtTransposed, 1, batchBands, 1, count, cqtN, fftOutN);
+		}
+		
+		// log10 of the floored energies over the whole block
+		int n = count*cqtN;
+		float logFloor = config.logFloor;
+		vDSP_vsq(batchBands, 1, batchBands, 1, n);
+		vDSP_vthr(batchBands, 1, &logFloor, batchBands, 1, n);
+		vvlog10f(batchBands, batchBands, &n);
+		
+		// DCT
+		float *mfccs = storeBatch(output);
+		vDSP_mmul(batchBands, 1, dctTransposed, 1, mfccs, 1, count, dctN, cqtN);
+		if ((void *)mfccs != (void *)output) {
+			for (int i = 0; i < count*dctN; i++)
+				output[i] = (T)mfccs[i];
 		}
-
 	}
 	
-	inline int getNumCoefficients()
+	// float rows are written in place, anything else through batchMFCCs
+	inline float * storeBatch(float *output)
 	{
-		return dctN;
+		return output;
+	}
+	template <typename T>
+	inline float * storeBatch(T *)
+	{
+		return batchMFCCs;
 	}
 	
+	inline float binHz()
+	{
+		return sampleRate / (float)fftN;
+	}
+	
+	// CQT * FFT magnitudes, CQT is cqtN x fftOutN row major
+	void denseCQT(float *cqt)
+	{
+		vDSP_mmul(CQT, 1, fft_magnitudes, 1, cqt, 1, cqtN, 1, fftOutN);
+	}
+	
+	void denseCQT(double *cqt)
+	{
+		for (int i = 0; i < cqtN; i++)
+		{
+			const float *row = CQT + i*fftOutN;
+			double sum = 0;
+			for (int k = 0; k < fftOutN; k++)
+				sum += (double)row[k] * (double)fft_magnitudes[k];
+			cqt[i] = sum;
+		}
+	}
+	
+	// same product over each band's nonzero bins only
+	void sparseCQT(float *cqt)
+	{
+		for (int i = 0; i < cqtN; i++)
+			cqt[i] = dot(cqtWeights + cqtOffsets[i], fft_magnitudes + cqStart[i], 
+						 cqtOffsets[i + 1] - cqtOffsets[i]);
+	}
+	
+	void sparseCQT(double *cqt)
+	{
+		for (int i = 0; i < cqtN; i++)
+			cqt[i] = dotD(cqtWeights + cqtOffsets[i], fft_magnitudes + cqStart[i], 
+						  cqtOffsets[i + 1] - cqtOffsets[i]);
+	}
+	
+	static inline float dot(const float *a, const float *b, int n)
+	{
+		float sum;
+		vDSP_dotpr(a, 1, b, 1, &sum, n);
+		return sum;
+	}
+	
+	static inline double dot(const float *a, const double *b, int n)
+	{
+		double sum = 0;
+		for (int k = 0; k < n; k++)
+			sum += (double)a[k] * b[k];
+		return sum;
+	}
+	
+	static inline double dotD(const float *a, const float *b, int n)
+	{
+		double sum = 0;
+		for (int k = 0; k < n; k++)
+			sum += (double)a[k] * (double)b[k];
+		return sum;
+	}
+	
+	// scratch for the CQT stage in the compute type
+	inline float * getCQTVector(float *)
+	{
+		return cqtVector;
+	}
+	inline double * getCQTVector(double *)
+	{
+		return cqtVectorD;
+	}
 	
-private:
 	float			*sample_data,
 					*powerSpectrum;
 	
@@ -351,8 +780,25 @@ private:
 	float			*cqtVector,								// transforms
 					*dctVector;
 	
+	double			*cqtVectorD;
+	
+	float			*bandFreqs,								// band centers in Hz
+					*prevMagnitudes;						// for the flux
+	int				*bandChroma;							// pitch class of each band
+	
+	float			*batchMagnitudes,						// computeMFCCBatch scratch
+					*batchBands,
+					*batchMFCCs,
+					*cqtTransposed,
+					*dctTransposed;
+	
 	int				*cqStart,								// sparse matrix indices
-					*cqStop;
+					*cqStop,
+					*cqtOffsets;
+	
+	float			*cqtWeights;							// band sparse CQT
+	
+	bool			bSparseCQT;
 	
 	float			loEdge,									// tranform range
 					hiEdge;
@@ -361,10 +807,9 @@ private:
 	
 	pkmFFT			*fft;
 	
-	float			*fft_magnitudes,
-					*fft_phases;
-
-	float			*foutput;
+	float			*fft_magnitudes;
+	
+	pkmAudioFeaturesConfig	config;
 	
 	int				bpoN,
 					cqtN,
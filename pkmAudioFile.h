@@ -9,40 +9,68 @@
 
 #pragma once
 
+#include <atomic>
+#include "pkmAudioStore.h"
+
+// the samples are either in buffer, or source of store (buffer is NULL);
+// pins, if any, counts the players holding a buffer that may be freed
+// (see pkmAudioFeatureDatabase::removeSound)
 class pkmAudioFile
 {
 public:
 	pkmAudioFile(int fs = 512)
 	{
 		buffer = 0;
+		store = 0;
+		source = -1;
 		offset = 0;
 		length = 0;
 		weight = 0;
 		frame_size = fs;
+		pins = 0;
 	}
 	
 	pkmAudioFile(float *&buf, int pos, int size, float w = 1.0, int fs = 512)
 	{
 		buffer = buf;
+		store = 0;
+		source = -1;
 		offset = pos;
 		length = size;
 		weight = w;
 		frame_size = fs;
+		pins = 0;
+	}
+	
+	pkmAudioFile(pkmAudioStore *audio_store, int source_id, int pos, int size, float w = 1.0, int fs = 512)
+	{
+		buffer = 0;
+		store = audio_store;
+		source = source_id;
+		offset = pos;
+		length = size;
+		weight = w;
+		frame_size = fs;
+		pins = 0;
 	}
 	
 	~pkmAudioFile()
 	{
 		buffer = 0;
+		store = 0;
 		weight = offset = length = 0;
 	}
 	
 	pkmAudioFile(const pkmAudioFile &rhs)
 	{
 		buffer = rhs.buffer;
+		store = rhs.store;
+		source = rhs.source;
 		offset = rhs.offset;
 		length = rhs.length;
 		weight = rhs.weight;
 		frame_size = rhs.frame_size;
+		pins = rhs.pins;
 	}
 	
 	int getNumFrames()
@@ -50,11 +78,38 @@ public:
 		return (length - offset) / frame_size;
 	}
 	
+	// count samples from sample (not counting offset) for the audio
+	// thread, see pkmAudioStore::getFrame; NULL if there are none
+	inline const float * getFrame(int sample, int count, float *scratch = 0) const
+	{
+		if (buffer) {
+			return buffer + sample;
+		}
+		return store ? store->getFrame(source, sample, count, scratch) : 0;
+	}
+	
+	// the same copied into out, from any thread
+	void read(int sample, int count, float *out) const
+	{
+		if (buffer) {
+			memcpy(out, buffer + sample, sizeof(float) * count);
+		}
+		else if (store) {
+			store->read(source, sample, count, out);
+		}
+		else {
+			memset(out, 0, sizeof(float) * count);
+		}
+	}
+	
 	
 	float		*buffer;
+	pkmAudioStore	*store;
+	int			source;
 	float		weight;
 	int			offset, 
 				length;
 	
 	int			frame_size;
+	std::atomic<int>	*pins;
 };
\ No newline at end of file
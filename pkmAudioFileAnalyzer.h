@@ -13,44 +13,204 @@ using namespace std;
 #include "pkmAudioFeatures.h"
 #include "pkmMatrix.h"
 #include "pkmAudioFile.h"
+#include "pkmFeatureStore.h"
+#include "pkmStreamingSTFT.h"
 
+// Frames start every hop_size samples (at most fft_size, which is the
+// default: back to back) and are fft_size long; overlapping ones are read straight out
+// of the signal by batched FFTs, nothing is copied per hop.  Samples after
+// the last whole frame are dropped unless pad_tail, which zero pads frames
+// until every sample is in one (those frames then run past the sound).
 class pkmAudioFileAnalyzer
 {
 public:
 	// 44100 / 512 * 93 
 	pkmAudioFileAnalyzer(int sample_rate = 44100, 
 						 int fft_size = 512, 
-						 int hop_size = 0)			// not implemented
+						 int hop_size = 0,
+						 bool pad_tail = false)
 	{
 		sampleRate = sample_rate;
 		fftN = fft_size;
+		hopSize = hop_size > 0 ? hop_size : fftN;
+		// as pkmStreamingSTFT, which analyzeSource goes through
+		if (hopSize > fftN) {
+			printf("[ERROR] pkmAudioFileAnalyzer: hop size %d is longer than a frame, using %d\n", hopSize, fftN);
+			hopSize = fftN;
+		}
+		bPadTail = pad_tail;
 		mfccAnalyzer = new pkmAudioFeatures(sampleRate, fftN);
+		stft = NULL;
 	}
 	
 	~pkmAudioFileAnalyzer()
 	{
 		delete mfccAnalyzer;
+		delete stft;
+	}
+	
+	// how many frames a sound of samples samples has
+	int getNumFrames(int samples) const
+	{
+		if (samples < fftN) {
+			return bPadTail && samples > 0 ? 1 : 0;
+		}
+		int frames = (samples - fftN) / hopSize + 1;
+		if (bPadTail && (frames - 1) * hopSize + fftN < samples) {
+			frames++;
+		}
+		return frames;
 	}
 	
+	// T is the feature storage type, e.g. pkmFeature (pkmSampleTypes.h)
+	template <typename T>
 	void analyzeFile(float *&buffer,					// in
 					 int samples,						// in
-					 vector<double *> &feature_matrix,	// out
+					 vector<T *> &feature_matrix,		// out
 					 vector<pkmAudioFile> &sound_lut,	// out
 					 int &num_frames,					// out
 					 int &num_features)					// out
 	{
-		num_frames = samples / fftN;
+		num_frames = getNumFrames(samples);
 		num_features = mfccAnalyzer->getNumCoefficients();
+		
+		// all frames at once, then one row per frame
+		T *features = (T *)malloc(sizeof(T) * num_frames * num_features);
+		computeFrames(buffer, samples, num_frames, features);
 		for (int i = 0; i < num_frames; i++) 
 		{
-			double *featureFrame = (double *)malloc(sizeof(double) * mfccAnalyzer->getNumCoefficients());
-			mfccAnalyzer->computeMFCC(buffer + i*fftN, featureFrame);
+			T *featureFrame = (T *)malloc(sizeof(T) * num_features);
+			memcpy(featureFrame, features + i*num_features, sizeof(T) * num_features);
 			feature_matrix.push_back(featureFrame);
-			sound_lut.push_back(pkmAudioFile(buffer, i*fftN, samples));
+			sound_lut.push_back(pkmAudioFile(buffer, i*hopSize, samples));
 		}
+		free(features);
 	}
 	
+	// same, appending straight into a feature store (no per frame rows)
+	template <typename T>
+	void analyzeFile(float *&buffer,					// in
+					 int samples,						// in
+					 pkmFeatureStore<T> &features,		// out, appended to
+					 vector<pkmAudioFile> &sound_lut,	// out
+					 int &num_frames,					// out
+					 int &num_features)					// out
+	{
+		num_frames = getNumFrames(samples);
+		num_features = mfccAnalyzer->getNumCoefficients();
+		if (features.getNumFeatures() != num_features) {
+			features.setNumFeatures(num_features);
+		}
+		if (num_frames <= 0) {
+			return;
+		}
+		
+		T *rows = features.appendRows(num_frames);
+		if (rows) {
+			computeFrames(buffer, samples, num_frames, rows);
+		}
+		else {
+			// column major store: compute row major, then scatter
+			rows = (T *)malloc(sizeof(T) * num_frames * num_features);
+			computeFrames(buffer, samples, num_frames, rows);
+			features.append(rows, num_frames);
+			free(rows);
+		}
+		for (int i = 0; i < num_frames; i++) 
+		{
+			sound_lut.push_back(pkmAudioFile(buffer, i*hopSize, samples));
+		}
+	}
+	
+	// same for a sound in an audio store, streamed through pkmStreamingSTFT
+	// (magnitudes only) a block at a time instead of decoded whole; the
+	// frames of sound_lut refer to the store
+	template <typename T>
+	void analyzeSource(pkmAudioStore &store,				// in
+					   int source,						// in
+					   pkmFeatureStore<T> &features,		// out, appended to
+					   vector<pkmAudioFile> &sound_lut,	// out
+					   int &num_frames,					// out
+					   int &num_features)				// out
+	{
+		int samples = store.getNumSamples(source);
+		int bins = fftN/2;
+		num_features = mfccAnalyzer->getNumCoefficients();
+		if (features.getNumFeatures() != num_features) {
+			features.setNumFeatures(num_features);
+		}
+		if (stft == NULL) {
+			stft = new pkmStreamingSTFT(fftN, hopSize);
+			stft->setPhases(false);
+		}
+		stft->reset();
+		
+		// MFCC_BATCH_FRAMES spectra at a time through the batched projection
+		vector<float> spectra((size_t)MFCC_BATCH_FRAMES * bins);
+		vector<T> rows((size_t)MFCC_BATCH_FRAMES * num_features);
+		int pending = 0;
+		stft->setCallback([&](float *magnitudes, float *, long) {
+			memcpy(&spectra[(size_t)pending * bins], magnitudes, sizeof(float) * bins);
+			if (++pending == MFCC_BATCH_FRAMES) {
+				mfccAnalyzer->computeMFCCBatch(&spectra[0], pending, &rows[0]);
+				features.append(&rows[0], pending);
+				pending = 0;
+			}
+		});
+		
+		vector<float> block((size_t)16 * fftN);
+		for (int at = 0; at < samples; at += (int)block.size()) {
+			int count = MIN((int)block.size(), samples - at);
+			store.read(source, at, count, &block[0]);
+			stft->push(&block[0], count);
+		}
+		if (bPadTail) {
+			stft->flush();
+		}
+		if (pending) {
+			mfccAnalyzer->computeMFCCBatch(&spectra[0], pending, &rows[0]);
+			features.append(&rows[0], pending);
+		}
+		stft->setCallback(pkmStreamingSTFT::FrameCallback());
+		
+		num_frames = (int)stft->getNumFrames();
+		for (int i = 0; i < num_frames; i++) 
+		{
+			sound_lut.push_back(pkmAudioFile(&store, source, i*hopSize, samples));
+		}
+	}
+	
+	inline int getHopSize() const			{ return hopSize; }
+	inline bool getPadTail() const			{ return bPadTail; }
+	
 	int						sampleRate, 
-							fftN;
+							fftN,
+							hopSize;
+	bool					bPadTail;
 	pkmAudioFeatures		*mfccAnalyzer;
+	
+private:
+	// MFCCs of num_frames (getNumFrames(samples)) frames of buffer into rows
+	template <typename T>
+	void computeFrames(float *buffer, int samples, int num_frames, T *rows)
+	{
+		int whole = samples < fftN ? 0 : MIN((samples - fftN) / hopSize + 1, num_frames);
+		if (whole) {
+			mfccAnalyzer->computeMFCCBatch(buffer, hopSize, whole, rows);
+		}
+		if (num_frames > whole) {
+			// the zero padded tail
+			int first = whole * hopSize;
+			int span = (num_frames - whole - 1) * hopSize + fftN;
+			float *tail = (float *)calloc(span, sizeof(float));
+			if (samples > first) {
+				memcpy(tail, buffer + first, sizeof(float) * MIN(samples - first, span));
+			}
+			mfccAnalyzer->computeMFCCBatch(tail, hopSize, num_frames - whole, 
+										   rows + (size_t)whole * mfccAnalyzer->getNumCoefficients());
+			free(tail);
+		}
+	}
+	
+	pkmStreamingSTFT		*stft;			// analyzeSource's, made on first use
 };
@@ -12,7 +12,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
-#include <Accelerate/Accelerate.h>
+#include "pkmDSP.h"
 #define MIN_FRAMES 5
 
 #ifndef MIN
@@ -25,6 +25,10 @@ public:
 	pkmAudioPlayer(pkmAudioFile &myFile, int frame_size = 512, int num_frames_to_play = 0, bool loop = true)
 	{
 		audioFile = myFile;			
+		// keeps a removed sound's buffer until this player is gone
+		if (audioFile.pins) {
+			audioFile.pins->fetch_add(1, std::memory_order_relaxed);
+		}
 		assert((audioFile.length - audioFile.offset) > 0);
 		
 		//printf("audiofile size: %d, offset: %d\n", audioFile.length, audioFile.offset);
@@ -56,6 +60,9 @@ public:
 	}
 	~pkmAudioPlayer()
 	{
+		if (audioFile.pins) {
+			audioFile.pins->fetch_sub(1, std::memory_order_release);
+		}
 		free(empty);
 		free(rampedBuffer);
 		free(rampInBuffer);
@@ -80,6 +87,7 @@ public:
 		if (framesToPlay < MIN_FRAMES) {
 			framesToPlay = 1;
 			audioFile.buffer = empty;
+			audioFile.store = 0;
 			audioFile.offset = 0;
 			return false;
 		}
@@ -111,20 +119,34 @@ public:
 				return empty;
 			}
 		}
+		// read in place, or paged in / decoded by the audio store (straight
+		// into rampedBuffer if frameSize is longer than its cache's frames)
+		const float *frame = audioFile.getFrame(audioFile.offset + offset, frameSize, rampedBuffer);
+		if (frame == NULL) {
+			return empty;
+		}
 		// fade in
 		if (currentFrame == 0) {
-			cblas_scopy(frameSize, audioFile.buffer + audioFile.offset + offset, 1, rampedBuffer, 1);
+			if (frame != rampedBuffer)
+				cblas_scopy(frameSize, frame, 1, rampedBuffer, 1);
 			vDSP_vmul(rampedBuffer, 1, rampInBuffer, 1, rampedBuffer, 1, rampInLength);
 			return rampedBuffer;
 		}
 		// fade out
 		else if(currentFrame == framesToPlay-1) {
 			//printf("f\n");
-			cblas_scopy(frameSize, audioFile.buffer + audioFile.offset + offset, 1, rampedBuffer, 1);
+			if (frame != rampedBuffer)
+				cblas_scopy(frameSize, frame, 1, rampedBuffer, 1);
 			vDSP_vmul(rampedBuffer + frameSize - rampOutLength, 1, rampOutBuffer, 1, rampedBuffer + frameSize - rampOutLength, 1, rampOutLength);
 			return rampedBuffer;			
 		}
-		// no fade
+		// no fade; the store's frames are read only (mapped) or only valid
+		// until its next getFrame, so they're copied
+		else if (audioFile.buffer == NULL) {
+			if (frame != rampedBuffer)
+				cblas_scopy(frameSize, frame, 1, rampedBuffer, 1);
+			return rampedBuffer;
+		}
 		else
 			return (audioFile.buffer + audioFile.offset + offset);
 	}
@@ -0,0 +1,6 @@
+/*
+ *  pkmAudioStore.cpp
+ *
+ */
+
+#include "pkmAudioStore.h"
@@ -0,0 +1,320 @@
+/*
+ *  pkmAudioStore.h
+ *
+ *  Sounds that stay on disk: each source is a run of PCM samples, either in
+ *  a file mapped by addFile() (paged in by the OS as it's played) or in
+ *  memory someone else owns (addMemory(), e.g. a database load() mapped).
+ *  Samples may be float, or 16 bit (PKM_AUDIO_INT16, or PKM_AUDIO_HALF,
+ *  pkmSampleTypes.h) for half the disk and page cache.  pkmAudioFile
+ *  refers to a source by id instead of holding the samples.
+ *
+ *  getFrame() is for the audio thread: float sources are read in place,
+ *  16 bit ones decoded into a small LRU of frames, so a frame several
+ *  players loop over is decoded once (frames longer than the LRU's go to
+ *  the caller's scratch instead).  No allocation, locks or stdio, but
+ *  the first touch of a page is a page fault.  One thread calls getFrame()
+ *  at a time; read() decodes into the caller's buffer from any thread.
+ *  Sources are only ever added (by one thread at a time), never removed
+ *  until the store is destroyed.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  pkmAudioStore store;
+ *  int source = store.addFile("corpus.raw", PKM_AUDIO_INT16);
+ *  pkmAudioFile sound(&store, source, 0, store.getNumSamples(source));
+ *
+ *  // audio thread
+ *  const float *frame = sound.getFrame(offset, 512);
+ *
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "pkmSampleTypes.h"
+#include "pkmMappedFile.h"
+
+#define PKM_AUDIO_STORE_CHUNK_BITS	10		// sources per chunk, 1 << bits
+#define PKM_AUDIO_STORE_MAX_CHUNKS	1024	// so at most a million sources
+
+enum pkmAudioSampleFormat
+{
+	PKM_AUDIO_FLOAT32,
+	PKM_AUDIO_INT16,				// full scale is 32768
+	PKM_AUDIO_HALF					// pkmHalf
+};
+
+static inline int pkmAudioSampleBytes(pkmAudioSampleFormat format)
+{
+	return format == PKM_AUDIO_FLOAT32 ? 4 : 2;
+}
+
+// count samples of format at in to floats
+static inline void pkmAudioDecode(const void *in, pkmAudioSampleFormat format, int count, float *out)
+{
+	if (format == PKM_AUDIO_FLOAT32) {
+		memcpy(out, in, sizeof(float) * count);
+	}
+	else if (format == PKM_AUDIO_INT16) {
+		const int16_t *p = (const int16_t *)in;
+		for (int i = 0; i < count; i++)
+			out[i] = p[i] * (1.0f / 32768.0f);
+	}
+	else {
+		const uint16_t *p = (const uint16_t *)in;
+		for (int i = 0; i < count; i++)
+			out[i] = pkmHalf::toFloat(p[i]);
+	}
+}
+
+// and back, clipping to full scale for PKM_AUDIO_INT16
+static inline void pkmAudioEncode(const float *in, int count, pkmAudioSampleFormat format, void *out)
+{
+	if (format == PKM_AUDIO_FLOAT32) {
+		memcpy(out, in, sizeof(float) * count);
+	}
+	else if (format == PKM_AUDIO_INT16) {
+		int16_t *p = (int16_t *)out;
+		for (int i = 0; i < count; i++) {
+			float x = in[i] * 32768.0f;
+			x = x < -32768.0f ? -32768.0f : (x > 32767.0f ? 32767.0f : x);
+			p[i] = (int16_t)(x < 0 ? x - 0.5f : x + 0.5f);
+		}
+	}
+	else {
+		uint16_t *p = (uint16_t *)out;
+		for (int i = 0; i < count; i++)
+			p[i] = pkmHalf::fromFloat(in[i]);
+	}
+}
+
+class pkmAudioStore
+{
+public:
+	// the LRU holds cache_frames decoded frames of up to frame_size samples
+	pkmAudioStore(int cache_frames = 128, int frame_size = 512)
+	{
+		numSources.store(0);
+		for (int i = 0; i < PKM_AUDIO_STORE_MAX_CHUNKS; i++)
+			chunks[i] = NULL;
+		cacheData = NULL;
+		cacheFrames = 0;
+		cacheFrameSize = 0;
+		tick = 0;
+		hits = misses = 0;
+		setCacheSize(cache_frames, frame_size);
+	}
+
+	~pkmAudioStore()
+	{
+		for (int i = 0; i < PKM_AUDIO_STORE_MAX_CHUNKS; i++)
+			delete [] chunks[i];
+		for (size_t i = 0; i < files.size(); i++)
+			delete files[i];
+		free(cacheData);
+	}
+
+	// raw headerless PCM from byte_offset in the file at path, to its end
+	// or for num_samples; returns the source id or -1
+	int addFile(const char *path, pkmAudioSampleFormat format, size_t byte_offset = 0, int num_samples = -1)
+	{
+		pkmMappedFile *file = new pkmMappedFile();
+		if (!file->open(path)) {
+			delete file;
+			return -1;
+		}
+		size_t available = byte_offset < file->size() ? (file->size() - byte_offset) / pkmAudioSampleBytes(format) : 0;
+		if (num_samples < 0) {
+			num_samples = available > 0x7fffffff ? 0x7fffffff : (int)available;
+		}
+		if ((size_t)num_samples > available || num_samples == 0) {
+			printf("[ERROR] pkmAudioStore: %s has fewer samples than asked for\n", path);
+			delete file;
+			return -1;
+		}
+		int source = addMemory(file->getData() + byte_offset, format, num_samples);
+		if (source < 0) {
+			delete file;
+			return -1;
+		}
+		files.push_back(file);
+		return source;
+	}
+
+	// num_samples samples at samples, which must outlive the store
+	int addMemory(const void *samples, pkmAudioSampleFormat format, int num_samples)
+	{
+		int id = numSources.load(std::memory_order_relaxed);
+		int chunk = id >> PKM_AUDIO_STORE_CHUNK_BITS;
+		if (chunk >= PKM_AUDIO_STORE_MAX_CHUNKS) {
+			printf("[ERROR] pkmAudioStore: too many sources\n");
+			return -1;
+		}
+		if (chunks[chunk] == NULL) {
+			chunks[chunk] = new Source[1 << PKM_AUDIO_STORE_CHUNK_BITS];
+		}
+		Source &source = chunks[chunk][id & ((1 << PKM_AUDIO_STORE_CHUNK_BITS) - 1)];
+		source.samples = (const char *)samples;
+		source.format = format;
+		source.length = num_samples;
+		// the entry is complete before a reader can see the id
+		numSources.store(id + 1, std::memory_order_release);
+		return id;
+	}
+
+	// count samples of source from sample into out, zeros past its end;
+	// any thread
+	void read(int source, int sample, int count, float *out) const
+	{
+		const Source *s = getSource(source);
+		int valid = 0;
+		if (s && sample >= 0 && sample < s->length) {
+			valid = count < s->length - sample ? count : s->length - sample;
+			pkmAudioDecode(s->samples + (size_t)sample * pkmAudioSampleBytes(s->format), s->format, valid, out);
+		}
+		if (count > valid) {
+			memset(out + valid, 0, sizeof(float) * (count - valid));
+		}
+	}
+
+	// count samples of source from sample, for the audio thread: in place
+	// for float sources, else decoded into the LRU and valid until the
+	// next getFrame.  A 16 bit frame longer than the cache's frame size
+	// is decoded into scratch (count samples) if there is one, else NULL;
+	// NULL past the end of the source.
+	const float * getFrame(int source, int sample, int count, float *scratch = NULL)
+	{
+		const Source *s = getSource(source);
+		if (s == NULL || sample < 0 || count <= 0 || count > s->length - sample) {
+			return NULL;
+		}
+		if (s->format == PKM_AUDIO_FLOAT32) {
+			return (const float *)s->samples + sample;
+		}
+		if (count > cacheFrameSize) {
+			if (scratch) {
+				pkmAudioDecode(s->samples + (size_t)sample * pkmAudioSampleBytes(s->format), s->format, count, scratch);
+			}
+			return scratch;
+		}
+
+		tick++;
+		int oldest = 0;
+		for (int i = 0; i < cacheFrames; i++) {
+			CacheEntry &entry = cache[i];
+			if (entry.source == source && entry.sample == sample && entry.count == count) {
+				entry.lastUse = tick;
+				hits++;
+				return cacheData + (size_t)i * cacheFrameSize;
+			}
+			if (entry.lastUse < cache[oldest].lastUse) {
+				oldest = i;
+			}
+		}
+		misses++;
+		CacheEntry &entry = cache[oldest];
+		entry.source = source;
+		entry.sample = sample;
+		entry.count = count;
+		entry.lastUse = tick;
+		float *frame = cacheData + (size_t)oldest * cacheFrameSize;
+		pkmAudioDecode(s->samples + (size_t)sample * pkmAudioSampleBytes(s->format), s->format, count, frame);
+		return frame;
+	}
+
+	// not while another thread is in getFrame
+	void setCacheSize(int cache_frames, int frame_size)
+	{
+		cacheFrames = cache_frames > 1 ? cache_frames : 1;
+		cacheFrameSize = frame_size > 1 ? frame_size : 1;
+		free(cacheData);
+		cacheData = (float *)malloc(sizeof(float) * (size_t)cacheFrames * cacheFrameSize);
+		cache.assign(cacheFrames, CacheEntry());
+		tick = 0;
+	}
+
+	inline int size() const						{ return numSources.load(std::memory_order_acquire); }
+	inline int getNumSamples(int source) const	{ const Source *s = getSource(source); return s ? s->length : 0; }
+	inline pkmAudioSampleFormat getFormat(int source) const
+	{
+		const Source *s = getSource(source);
+		return s ? s->format : PKM_AUDIO_FLOAT32;
+	}
+	// getFrame()s served from / decoded into the LRU
+	inline uint64_t getCacheHits() const		{ return hits; }
+	inline uint64_t getCacheMisses() const		{ return misses; }
+
+private:
+	pkmAudioStore(const pkmAudioStore &);
+	pkmAudioStore & operator=(const pkmAudioStore &);
+
+	struct Source
+	{
+		const char				*samples;
+		pkmAudioSampleFormat	format;
+		int						length;
+	};
+
+	struct CacheEntry
+	{
+		int						source,
+								sample,
+								count;
+		uint64_t				lastUse;
+
+		CacheEntry() : source(-1), sample(0), count(0), lastUse(0) {}
+	};
+
+	inline const Source * getSource(int source) const
+	{
+		if (source < 0 || source >= numSources.load(std::memory_order_acquire)) {
+			return NULL;
+		}
+		return &chunks[source >> PKM_AUDIO_STORE_CHUNK_BITS][source & ((1 << PKM_AUDIO_STORE_CHUNK_BITS) - 1)];
+	}
+
+	// sources never move once added, so readers need no lock
+	Source						*chunks[PKM_AUDIO_STORE_MAX_CHUNKS];
+	std::atomic<int>			numSources;
+	std::vector<pkmMappedFile *>	files;
+
+	// getFrame's LRU, touched by the audio thread only
+	std::vector<CacheEntry>		cache;
+	float						*cacheData;
+	int							cacheFrames,
+								cacheFrameSize;
+	uint64_t					tick,
+								hits,
+								misses;
+};
@@ -0,0 +1,6 @@
+/*
+ *  pkmBruteForce.cpp
+ *
+ */
+
+#include "pkmBruteForce.h"
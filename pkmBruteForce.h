@@ -0,0 +1,659 @@
+/*
+ *  pkmBruteForce.h
+ *
+ *  Exact k nearest neighbours by scanning every frame, for small databases
+ *  and whole batches of queries, and the ground truth the approximate
+ *  backends are measured against.  The frames are packed once into panels
+ *  of PKM_BRUTEFORCE_PANEL frames stored dimension by dimension, so that a
+ *  kernel loads one dimension of a whole panel as a vector and broadcasts
+ *  the matching dimension of PKM_BRUTEFORCE_QUERIES queries against it:
+ *  a small blocked GEMM.  Squared L2 distances come out as
+ *  ||q||^2 + ||x||^2 - 2 q.x; L1 (the metric pkmSegmenter uses) is
+ *  accumulated directly.  Distances are computed PKM_BRUTEFORCE_TILE
+ *  panels at a time (a tile stays in cache while every query of a batch
+ *  passes over it) and each query keeps its k best in a heap.  A SIMD
+ *  select compares PKM_BRUTEFORCE_SELECT distances at a time with the
+ *  current k-th best, so only the few that can still place reach the heap.
+ *  The L2 survivors are rescored from the differences, so the reported
+ *  distances are exact and their order is exact up to rounding.
+ *
+ *  Kernels for AVX2 and AVX-512 are compiled with per-function target
+ *  attributes and picked at runtime; the scalar kernel is written to
+ *  auto-vectorize elsewhere.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  pkmBruteForce exact(store.getData(), store.size(), 13);
+ *  exact.searchBatch(queries, num_queries, k, frames, distances);	// num_queries x k
+ *
+ *  pkmBruteForce manhattan(rows, num_rows, 13, PKM_DISTANCE_L1);
+ *
+ */
+
+#pragma once
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <vector>
+#include "pkmIndexSegment.h"
+#include "pkmFeatureStore.h"			// pkmAlignedMalloc
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define PKM_BRUTEFORCE_HAVE_X86 1
+#include <immintrin.h>
+#define PKM_TARGET_BRUTEFORCE_AVX2		__attribute__((target("avx2,fma")))
+#define PKM_TARGET_BRUTEFORCE_AVX512	__attribute__((target("avx512f")))
+#else
+#define PKM_BRUTEFORCE_HAVE_X86 0
+#endif
+
+#define PKM_BRUTEFORCE_PANEL 8			// frames per packed panel
+#define PKM_BRUTEFORCE_QUERIES 4		// queries per kernel call
+#define PKM_BRUTEFORCE_TILE 64			// panels per distance tile
+#define PKM_BRUTEFORCE_SELECT 64		// distances per select call
+
+enum pkmDistanceMetric
+{
+	PKM_DISTANCE_L2,					// squared euclidean
+	PKM_DISTANCE_L1						// sum of absolute differences
+};
+
+enum pkmBruteForceISA
+{
+	PKM_BRUTEFORCE_ISA_AUTO		= -1,
+	PKM_BRUTEFORCE_ISA_SCALAR	= 0,
+	PKM_BRUTEFORCE_ISA_AVX2,
+	PKM_BRUTEFORCE_ISA_AVX512,
+	PKM_BRUTEFORCE_ISA_COUNT
+};
+
+static inline const char * pkmBruteForceISAName(pkmBruteForceISA isa)
+{
+	switch (isa) {
+		case PKM_BRUTEFORCE_ISA_SCALAR:	return "scalar";
+		case PKM_BRUTEFORCE_ISA_AVX2:	return "avx2";
+		case PKM_BRUTEFORCE_ISA_AVX512:	return "avx512";
+		default:						return "unknown";
+	}
+}
+
+static inline bool pkmBruteForceISASupported(pkmBruteForceISA isa)
+{
+	switch (isa) {
+		case PKM_BRUTEFORCE_ISA_SCALAR:
+			return true;
+#if PKM_BRUTEFORCE_HAVE_X86
+		case PKM_BRUTEFORCE_ISA_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		case PKM_BRUTEFORCE_ISA_AVX512:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx512f");
+#endif
+		default:
+			return false;
+	}
+}
+
+static inline pkmBruteForceISA pkmBruteForceDetectISA()
+{
+	if (pkmBruteForceISASupported(PKM_BRUTEFORCE_ISA_AVX512))
+		return PKM_BRUTEFORCE_ISA_AVX512;
+	if (pkmBruteForceISASupported(PKM_BRUTEFORCE_ISA_AVX2))
+		return PKM_BRUTEFORCE_ISA_AVX2;
+	return PKM_BRUTEFORCE_ISA_SCALAR;
+}
+
+// For 1 or PKM_BRUTEFORCE_QUERIES queries against numPanels panels: dot
+// products (L2) or L1 distances, query q's for panel frame f at
+// out[q*outStride + f].
+typedef void (*pkmBruteForceKernel)(const pkmIndexCoord *const *queries, int nq,
+									const pkmIndexCoord *panels, int numPanels, int dim,
+									pkmIndexDist *out, int outStride);
+
+static void pkmBruteForceDotScalar(const pkmIndexCoord *const *queries, int nq,
+								   const pkmIndexCoord *panels, int numPanels, int dim,
+								   pkmIndexDist *out, int outStride)
+{
+	for (int p = 0; p < numPanels; p++) {
+		const pkmIndexCoord *panel = panels + (size_t)p * dim * PKM_BRUTEFORCE_PANEL;
+		for (int q = 0; q < nq; q++) {
+			pkmIndexDist acc[PKM_BRUTEFORCE_PANEL] = {0};
+			for (int j = 0; j < dim; j++) {
+				pkmIndexCoord v = queries[q][j];
+				const pkmIndexCoord *x = panel + j * PKM_BRUTEFORCE_PANEL;
+				for (int l = 0; l < PKM_BRUTEFORCE_PANEL; l++)
+					acc[l] += v * x[l];
+			}
+			memcpy(out + (size_t)q * outStride + p * PKM_BRUTEFORCE_PANEL, acc, sizeof(acc));
+		}
+	}
+}
+
+static void pkmBruteForceL1Scalar(const pkmIndexCoord *const *queries, int nq,
+								  const pkmIndexCoord *panels, int numPanels, int dim,
+								  pkmIndexDist *out, int outStride)
+{
+	for (int p = 0; p < numPanels; p++) {
+		const pkmIndexCoord *panel = panels + (size_t)p * dim * PKM_BRUTEFORCE_PANEL;
+		for (int q = 0; q < nq; q++) {
+			pkmIndexDist acc[PKM_BRUTEFORCE_PANEL] = {0};
+			for (int j = 0; j < dim; j++) {
+				pkmIndexCoord v = queries[q][j];
+				const pkmIndexCoord *x = panel + j * PKM_BRUTEFORCE_PANEL;
+				for (int l = 0; l < PKM_BRUTEFORCE_PANEL; l++)
+					acc[l] += fabs(v - x[l]);
+			}
+			memcpy(out + (size_t)q * outStride + p * PKM_BRUTEFORCE_PANEL, acc, sizeof(acc));
+		}
+	}
+}
+
+#if PKM_BRUTEFORCE_HAVE_X86
+
+// 4 queries x 8 frames in 8 accumulators: two loads and four broadcasts
+// feed eight FMAs per dimension
+PKM_TARGET_BRUTEFORCE_AVX2
+static void pkmBruteForceDotAVX2(const pkmIndexCoord *const *queries, int nq,
+								 const pkmIndexCoord *panels, int numPanels, int dim,
+								 pkmIndexDist *out, int outStride)
+{
+	const pkmIndexCoord *q0 = queries[0], *q1 = queries[1], *q2 = queries[2], *q3 = queries[3];
+	if (nq == 1) {
+		for (int p = 0; p < numPanels; p++) {
+			const pkmIndexCoord *x = panels + (size_t)p * dim * PKM_BRUTEFORCE_PANEL;
+			__m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+			for (int j = 0; j < dim; j++, x += PKM_BRUTEFORCE_PANEL) {
+				__m256d v = _mm256_broadcast_sd(q0 + j);
+				a = _mm256_fmadd_pd(v, _mm256_load_pd(x), a);
+				b = _mm256_fmadd_pd(v, _mm256_load_pd(x + 4), b);
+			}
+			_mm256_storeu_pd(out + p * PKM_BRUTEFORCE_PANEL, a);
+			_mm256_storeu_pd(out + p * PKM_BRUTEFORCE_PANEL + 4, b);
+		}
+		return;
+	}
+	for (int p = 0; p < numPanels; p++) {
+		const pkmIndexCoord *x = panels + (size_t)p * dim * PKM_BRUTEFORCE_PANEL;
+		__m256d a0 = _mm256_setzero_pd(), b0 = _mm256_setzero_pd();
+		__m256d a1 = _mm256_setzero_pd(), b1 = _mm256_setzero_pd();
+		__m256d a2 = _mm256_setzero_pd(), b2 = _mm256_setzero_pd();
+		__m256d a3 = _mm256_setzero_pd(), b3 = _mm256_setzero_pd();
+		for (int j = 0; j < dim; j++, x += PKM_BRUTEFORCE_PANEL) {
+			__m256d lo = _mm256_load_pd(x), hi = _mm256_load_pd(x + 4);
+			__m256d v = _mm256_broadcast_sd(q0 + j);
+			a0 = _mm256_fmadd_pd(v, lo, a0);
+			b0 = _mm256_fmadd_pd(v, hi, b0);
+			v = _mm256_broadcast_sd(q1 + j);
+			a1 = _mm256_fmadd_pd(v, lo, a1);
+			b1 = _mm256_fmadd_pd(v, hi, b1);
+			v = _mm256_broadcast_sd(q2 + j);
+			a2 = _mm256_fmadd_pd(v, lo, a2);
+			b2 = _mm256_fmadd_pd(v, hi, b2);
+			v = _mm256_broadcast_sd(q3 + j);
+			a3 = _mm256_fmadd_pd(v, lo, a3);
+			b3 = _mm256_fmadd_pd(v, hi, b3);
+		}
+		pkmIndexDist *o = out + p * PKM_BRUTEFORCE_PANEL;
+		_mm256_storeu_pd(o, a0);							_mm256_storeu_pd(o + 4, b0);
+		_mm256_storeu_pd(o + outStride, a1);				_mm256_storeu_pd(o + outStride + 4, b1);
+		_mm256_storeu_pd(o + 2 * (size_t)outStride, a2);	_mm256_storeu_pd(o + 2 * (size_t)outStride + 4, b2);
+		_mm256_storeu_pd(o + 3 * (size_t)outStride, a3);	_mm256_storeu_pd(o + 3 * (size_t)outStride + 4, b3);
+	}
+}
+
+PKM_TARGET_BRUTEFORCE_AVX2
+static void pkmBruteForceL1AVX2(const pkmIndexCoord *const *queries, int nq,
+								const pkmIndexCoord *panels, int numPanels, int dim,
+								pkmIndexDist *out, int outStride)
+{
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	for (int p = 0; p < numPanels; p++) {
+		const pkmIndexCoord *panel = panels + (size_t)p * dim * PKM_BRUTEFORCE_PANEL;
+		for (int q = 0; q < nq; q++) {
+			const pkmIndexCoord *x = panel;
+			__m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+			for (int j = 0; j < dim; j++, x += PKM_BRUTEFORCE_PANEL) {
+				__m256d v = _mm256_broadcast_sd(queries[q] + j);
+				a = _mm256_add_pd(a, _mm256_andnot_pd(sign, _mm256_sub_pd(v, _mm256_load_pd(x))));
+				b = _mm256_add_pd(b, _mm256_andnot_pd(sign, _mm256_sub_pd(v, _mm256_load_pd(x + 4))));
+			}
+			pkmIndexDist *o = out + (size_t)q * outStride + p * PKM_BRUTEFORCE_PANEL;
+			_mm256_storeu_pd(o, a);
+			_mm256_storeu_pd(o + 4, b);
+		}
+	}
+}
+
+// a whole panel per register; two panels at once to keep 8 FMAs in flight
+PKM_TARGET_BRUTEFORCE_AVX512
+static void pkmBruteForceDotAVX512(const pkmIndexCoord *const *queries, int nq,
+								   const pkmIndexCoord *panels, int numPanels, int dim,
+								   pkmIndexDist *out, int outStride)
+{
+	const pkmIndexCoord *q0 = queries[0], *q1 = queries[1], *q2 = queries[2], *q3 = queries[3];
+	const size_t panelSize = (size_t)dim * PKM_BRUTEFORCE_PANEL;
+	int p = 0;
+	if (nq == 1) {
+		for (; p < numPanels; p++) {
+			const pkmIndexCoord *x = panels + p * panelSize;
+			__m512d a = _mm512_setzero_pd();
+			for (int j = 0; j < dim; j++, x += PKM_BRUTEFORCE_PANEL)
+				a = _mm512_fmadd_pd(_mm512_set1_pd(q0[j]), _mm512_load_pd(x), a);
+			_mm512_storeu_pd(out + p * PKM_BRUTEFORCE_PANEL, a);
+		}
+		return;
+	}
+	for (; p + 2 <= numPanels; p += 2) {
+		const pkmIndexCoord *x = panels + p * panelSize;
+		const pkmIndexCoord *y = x + panelSize;
+		__m512d a0 = _mm512_setzero_pd(), b0 = _mm512_setzero_pd();
+		__m512d a1 = _mm512_setzero_pd(), b1 = _mm512_setzero_pd();
+		__m512d a2 = _mm512_setzero_pd(), b2 = _mm512_setzero_pd();
+		__m512d a3 = _mm512_setzero_pd(), b3 = _mm512_setzero_pd();
+		for (int j = 0; j < dim; j++, x += PKM_BRUTEFORCE_PANEL, y += PKM_BRUTEFORCE_PANEL) {
+			__m512d px = _mm512_load_pd(x), py = _mm512_load_pd(y);
+			__m512d v = _mm512_set1_pd(q0[j]);
+			a0 = _mm512_fmadd_pd(v, px, a0);
+			b0 = _mm512_fmadd_pd(v, py, b0);
+			v = _mm512_set1_pd(q1[j]);
+			a1 = _mm512_fmadd_pd(v, px, a1);
+			b1 = _mm512_fmadd_pd(v, py, b1);
+			v = _mm512_set1_pd(q2[j]);
+			a2 = _mm512_fmadd_pd(v, px, a2);
+			b2 = _mm512_fmadd_pd(v, py, b2);
+			v = _mm512_set1_pd(q3[j]);
+			a3 = _mm512_fmadd_pd(v, px, a3);
+			b3 = _mm512_fmadd_pd(v, py, b3);
+		}
+		pkmIndexDist *o = out + p * PKM_BRUTEFORCE_PANEL;
+		_mm512_storeu_pd(o, a0);							_mm512_storeu_pd(o + 8, b0);
+		_mm512_storeu_pd(o + outStride, a1);				_mm512_storeu_pd(o + outStride + 8, b1);
+		_mm512_storeu_pd(o + 2 * (size_t)outStride, a2);	_mm512_storeu_pd(o + 2 * (size_t)outStride + 8, b2);
+		_mm512_storeu_pd(o + 3 * (size_t)outStride, a3);	_mm512_storeu_pd(o + 3 * (size_t)outStride + 8, b3);
+	}
+	if (p < numPanels) {
+		pkmBruteForceDotAVX2(queries, nq, panels + p * panelSize, numPanels - p, dim,
+							 out + p * PKM_BRUTEFORCE_PANEL, outStride);
+	}
+}
+
+PKM_TARGET_BRUTEFORCE_AVX512
+static void pkmBruteForceL1AVX512(const pkmIndexCoord *const *queries, int nq,
+								  const pkmIndexCoord *panels, int numPanels, int dim,
+								  pkmIndexDist *out, int outStride)
+{
+	for (int p = 0; p < numPanels; p++) {
+		const pkmIndexCoord *panel = panels + (size_t)p * dim * PKM_BRUTEFORCE_PANEL;
+		for (int q = 0; q < nq; q++) {
+			const pkmIndexCoord *x = panel;
+			__m512d a = _mm512_setzero_pd();
+			for (int j = 0; j < dim; j++, x += PKM_BRUTEFORCE_PANEL)
+				a = _mm512_add_pd(a, _mm512_abs_pd(_mm512_sub_pd(_mm512_set1_pd(queries[q][j]), _mm512_load_pd(x))));
+			_mm512_storeu_pd(out + (size_t)q * outStride + p * PKM_BRUTEFORCE_PANEL, a);
+		}
+	}
+}
+
+#endif
+
+// Of count kernel outputs, those whose distance is under bound: L2
+// distances are queryNorm + norms[f] - 2 row[f], L1 ones (norms NULL) are
+// row[f] as is.  Writes their positions to hits and distances to dists,
+// returns how many.
+typedef int (*pkmBruteForceSelect)(const pkmIndexDist *row, const pkmIndexDist *norms,
+								   pkmIndexDist queryNorm, int count, pkmIndexDist bound,
+								   int *hits, pkmIndexDist *dists);
+
+static int pkmBruteForceSelectScalar(const pkmIndexDist *row, const pkmIndexDist *norms,
+									 pkmIndexDist queryNorm, int count, pkmIndexDist bound,
+									 int *hits, pkmIndexDist *dists)
+{
+	int found = 0;
+	if (norms == NULL) {
+		for (int f = 0; f < count; f++) {
+			if (row[f] < bound) {
+				hits[found] = f;
+				dists[found++] = row[f];
+			}
+		}
+		return found;
+	}
+	for (int f = 0; f < count; f++) {
+		pkmIndexDist d = queryNorm + norms[f] - 2 * row[f];
+		if (d < bound) {
+			hits[found] = f;
+			dists[found++] = d;
+		}
+	}
+	return found;
+}
+
+// the last count % width outputs of a vector select
+static inline int pkmBruteForceSelectTail(const pkmIndexDist *row, const pkmIndexDist *norms,
+										  pkmIndexDist queryNorm, int f, int count, pkmIndexDist bound,
+										  int *hits, pkmIndexDist *dists)
+{
+	int found = pkmBruteForceSelectScalar(row + f, norms ? norms + f : NULL, queryNorm, count - f, bound, hits, dists);
+	for (int i = 0; i < found; i++)
+		hits[i] += f;
+	return found;
+}
+
+#if PKM_BRUTEFORCE_HAVE_X86
+
+PKM_TARGET_BRUTEFORCE_AVX2
+static int pkmBruteForceSelectAVX2(const pkmIndexDist *row, const pkmIndexDist *norms,
+								   pkmIndexDist queryNorm, int count, pkmIndexDist bound,
+								   int *hits, pkmIndexDist *dists)
+{
+	const __m256d b = _mm256_set1_pd(bound), qn = _mm256_set1_pd(queryNorm), two = _mm256_set1_pd(2.0);
+	int found = 0, f = 0;
+	for (; f + 4 <= count; f += 4) {
+		__m256d d = _mm256_loadu_pd(row + f);
+		if (norms)
+			d = _mm256_sub_pd(_mm256_add_pd(qn, _mm256_loadu_pd(norms + f)), _mm256_mul_pd(two, d));
+		int mask = _mm256_movemask_pd(_mm256_cmp_pd(d, b, _CMP_LT_OQ));
+		if (mask) {
+			pkmIndexDist lanes[4];
+			_mm256_storeu_pd(lanes, d);
+			for (; mask; mask &= mask - 1) {
+				int l = __builtin_ctz(mask);
+				hits[found] = f + l;
+				dists[found++] = lanes[l];
+			}
+		}
+	}
+	// the tail and the heap are SSE code: leave no dirty upper state for them
+	_mm256_zeroupper();
+	return found + pkmBruteForceSelectTail(row, norms, queryNorm, f, count, bound, hits + found, dists + found);
+}
+
+PKM_TARGET_BRUTEFORCE_AVX512
+static int pkmBruteForceSelectAVX512(const pkmIndexDist *row, const pkmIndexDist *norms,
+									 pkmIndexDist queryNorm, int count, pkmIndexDist bound,
+									 int *hits, pkmIndexDist *dists)
+{
+	const __m512d b = _mm512_set1_pd(bound), qn = _mm512_set1_pd(queryNorm), two = _mm512_set1_pd(2.0);
+	int found = 0, f = 0;
+	for (; f + 8 <= count; f += 8) {
+		__m512d d = _mm512_loadu_pd(row + f);
+		if (norms)
+			d = _mm512_sub_pd(_mm512_add_pd(qn, _mm512_loadu_pd(norms + f)), _mm512_mul_pd(two, d));
+		unsigned mask = _mm512_cmp_pd_mask(d, b, _CMP_LT_OQ);
+		if (mask) {
+			pkmIndexDist lanes[8];
+			_mm512_storeu_pd(lanes, d);
+			for (; mask; mask &= mask - 1) {
+				int l = __builtin_ctz(mask);
+				hits[found] = f + l;
+				dists[found++] = lanes[l];
+			}
+		}
+	}
+	// the tail and the heap are SSE code: leave no dirty upper state for them
+	_mm256_zeroupper();
+	return found + pkmBruteForceSelectTail(row, norms, queryNorm, f, count, bound, hits + found, dists + found);
+}
+
+#endif
+
+static inline pkmBruteForceSelect pkmBruteForceGetSelect(pkmBruteForceISA isa)
+{
+	switch (isa) {
+#if PKM_BRUTEFORCE_HAVE_X86
+		case PKM_BRUTEFORCE_ISA_AVX2:	return pkmBruteForceSelectAVX2;
+		case PKM_BRUTEFORCE_ISA_AVX512:	return pkmBruteForceSelectAVX512;
+#endif
+		default:						return pkmBruteForceSelectScalar;
+	}
+}
+
+static inline pkmBruteForceKernel pkmBruteForceGetKernel(pkmBruteForceISA isa, pkmDistanceMetric metric)
+{
+	switch (isa) {
+#if PKM_BRUTEFORCE_HAVE_X86
+		case PKM_BRUTEFORCE_ISA_AVX2:
+			return metric == PKM_DISTANCE_L1 ? pkmBruteForceL1AVX2 : pkmBruteForceDotAVX2;
+		case PKM_BRUTEFORCE_ISA_AVX512:
+			return metric == PKM_DISTANCE_L1 ? pkmBruteForceL1AVX512 : pkmBruteForceDotAVX512;
+#endif
+		default:
+			return metric == PKM_DISTANCE_L1 ? pkmBruteForceL1Scalar : pkmBruteForceDotScalar;
+	}
+}
+
+class pkmBruteForce : public pkmIndexSegment
+{
+public:
+	typedef std::pair<pkmIndexDist, int> Entry;
+
+	// frames [0, num_frames) of row major rows
+	pkmBruteForce(const pkmIndexCoord *rows, int num_frames, int dimensions,
+				  pkmDistanceMetric distance_metric = PKM_DISTANCE_L2,
+				  pkmBruteForceISA isa = PKM_BRUTEFORCE_ISA_AUTO)
+	{
+		std::vector<int> frames(num_frames);
+		for (int i = 0; i < num_frames; i++)
+			frames[i] = i;
+		pack(rows, frames, dimensions, distance_metric, isa);
+	}
+
+	// the given rows of rows, searched as 0 .. frames.size() - 1
+	pkmBruteForce(const pkmIndexCoord *rows, const std::vector<int> &frames, int dimensions,
+				  pkmDistanceMetric distance_metric = PKM_DISTANCE_L2,
+				  pkmBruteForceISA isa = PKM_BRUTEFORCE_ISA_AUTO)
+	{
+		pack(rows, frames, dimensions, distance_metric, isa);
+	}
+
+	~pkmBruteForce()
+	{
+		pkmAlignedFree(panels);
+	}
+
+	// one query, from the packed copy; allocation free once reserve()d for k
+	int search(const pkmIndexCoord *, const pkmIndexCoord *query, int k, int *local, pkmIndexDist *dists,
+			   const pkmIndexParams &, pkmIndexScratch &scratch) const
+	{
+		if (n == 0 || k <= 0) {
+			return 0;
+		}
+		const pkmIndexCoord *queries[PKM_BRUTEFORCE_QUERIES] = { query, query, query, query };
+		pkmIndexDist queryNorm = norm(query);
+
+		pkmIndexDist tile[PKM_BRUTEFORCE_TILE * PKM_BRUTEFORCE_PANEL];
+		const int tileStride = PKM_BRUTEFORCE_TILE * PKM_BRUTEFORCE_PANEL;
+		std::vector<Entry> &heap = scratch.results;
+		heap.clear();
+		for (int p0 = 0; p0 < numPanels; p0 += PKM_BRUTEFORCE_TILE) {
+			int tilePanels = std::min(PKM_BRUTEFORCE_TILE, numPanels - p0);
+			kernel(queries, 1, panelAt(p0), tilePanels, dim, tile, tileStride);
+			collect(tile, queryNorm, p0, tilePanels, k, heap);
+		}
+		rescore(query, heap);
+		return pkmIndexDrainBest(heap, local, dists);
+	}
+
+	void reserve(pkmIndexScratch &scratch, int k, const pkmIndexParams &) const
+	{
+		if ((int)scratch.results.capacity() < k + 1) {
+			scratch.results.reserve(k + 1);
+		}
+	}
+
+	// num_queries row major queries at once; query q's min(k, size()) nearest,
+	// closest first, go to local and dists[q*k ..].  Returns how many each.
+	int searchBatch(const pkmIndexCoord *queries, int num_queries, int k,
+					int *local, pkmIndexDist *dists) const
+	{
+		int found = std::min(k, n);
+		if (found <= 0 || num_queries <= 0) {
+			return 0;
+		}
+		std::vector<std::vector<Entry> > heaps(num_queries);
+		std::vector<pkmIndexDist> queryNorms(num_queries);
+		for (int q = 0; q < num_queries; q++) {
+			heaps[q].reserve(found + 1);
+			queryNorms[q] = norm(queries + (size_t)q * dim);
+		}
+
+		std::vector<pkmIndexDist> tile(PKM_BRUTEFORCE_QUERIES * PKM_BRUTEFORCE_TILE * PKM_BRUTEFORCE_PANEL);
+		const int tileStride = PKM_BRUTEFORCE_TILE * PKM_BRUTEFORCE_PANEL;
+		for (int p0 = 0; p0 < numPanels; p0 += PKM_BRUTEFORCE_TILE) {
+			int tilePanels = std::min(PKM_BRUTEFORCE_TILE, numPanels - p0);
+			// every query passes over this tile while it is in cache
+			for (int q0 = 0; q0 < num_queries; q0 += PKM_BRUTEFORCE_QUERIES) {
+				int nq = std::min(PKM_BRUTEFORCE_QUERIES, num_queries - q0);
+				const pkmIndexCoord *block[PKM_BRUTEFORCE_QUERIES];
+				for (int q = 0; q < PKM_BRUTEFORCE_QUERIES; q++)
+					block[q] = queries + (size_t)(q0 + std::min(q, nq - 1)) * dim;
+				kernel(block, nq == 1 ? 1 : PKM_BRUTEFORCE_QUERIES, panelAt(p0), tilePanels, dim, &tile[0], tileStride);
+				for (int q = 0; q < nq; q++)
+					collect(&tile[(size_t)q * tileStride], queryNorms[q0 + q], p0, tilePanels, found, heaps[q0 + q]);
+			}
+		}
+
+		for (int q = 0; q < num_queries; q++) {
+			rescore(queries + (size_t)q * dim, heaps[q]);
+			pkmIndexDrainBest(heaps[q], local + (size_t)q * k, dists + (size_t)q * k);
+		}
+		return found;
+	}
+
+	// as a segment: the same tiled pass
+	void searchBatch(const pkmIndexCoord *, const pkmIndexCoord *queries, int num_queries, int, int k,
+					 int *local, pkmIndexDist *dists, int *found,
+					 const pkmIndexParams &) const
+	{
+		int count = searchBatch(queries, num_queries, k, local, dists);
+		for (int q = 0; q < num_queries; q++)
+			found[q] = count;
+	}
+
+	inline int size() const							{ return n; }
+	inline pkmDistanceMetric getMetric() const		{ return metric; }
+	inline pkmBruteForceISA getISA() const			{ return kernelISA; }
+
+private:
+	pkmBruteForce(const pkmBruteForce &);
+	pkmBruteForce & operator=(const pkmBruteForce &);
+
+	void pack(const pkmIndexCoord *rows, const std::vector<int> &frames, int dimensions,
+			  pkmDistanceMetric distance_metric, pkmBruteForceISA isa)
+	{
+		dim = dimensions;
+		n = (int)frames.size();
+		metric = distance_metric;
+		kernelISA = isa == PKM_BRUTEFORCE_ISA_AUTO || !pkmBruteForceISASupported(isa) ? pkmBruteForceDetectISA() : isa;
+		kernel = pkmBruteForceGetKernel(kernelISA, metric);
+		select = pkmBruteForceGetSelect(kernelISA);
+
+		numPanels = (n + PKM_BRUTEFORCE_PANEL - 1) / PKM_BRUTEFORCE_PANEL;
+		size_t count = std::max((size_t)numPanels * dim * PKM_BRUTEFORCE_PANEL, (size_t)1);
+		panels = (pkmIndexCoord *)pkmAlignedMalloc(sizeof(pkmIndexCoord) * count);
+		memset(panels, 0, sizeof(pkmIndexCoord) * count);
+		norms.assign((size_t)numPanels * PKM_BRUTEFORCE_PANEL, 0);
+		for (int i = 0; i < n; i++) {
+			const pkmIndexCoord *row = rows + (size_t)frames[i] * dim;
+			pkmIndexCoord *panel = panelAt(i / PKM_BRUTEFORCE_PANEL) + i % PKM_BRUTEFORCE_PANEL;
+			for (int j = 0; j < dim; j++)
+				panel[j * PKM_BRUTEFORCE_PANEL] = row[j];
+			norms[i] = norm(row);
+		}
+	}
+
+	inline pkmIndexCoord * panelAt(int p) const
+	{
+		return panels + (size_t)p * dim * PKM_BRUTEFORCE_PANEL;
+	}
+
+	inline pkmIndexCoord frameAt(int i, int j) const
+	{
+		return panelAt(i / PKM_BRUTEFORCE_PANEL)[j * PKM_BRUTEFORCE_PANEL + i % PKM_BRUTEFORCE_PANEL];
+	}
+
+	inline pkmIndexDist norm(const pkmIndexCoord *x) const
+	{
+		pkmIndexDist sum = 0;
+		for (int j = 0; j < dim; j++)
+			sum += x[j] * x[j];
+		return sum;
+	}
+
+	// a tile's kernel output into a query's k best
+	inline void collect(const pkmIndexDist *row, pkmIndexDist queryNorm, int p0, int tilePanels,
+						int k, std::vector<Entry> &heap) const
+	{
+		int first = p0 * PKM_BRUTEFORCE_PANEL;
+		int count = std::min(tilePanels * PKM_BRUTEFORCE_PANEL, n - first);
+		// most frames lose to the current k-th best: select against it a block
+		// at a time, and heap only the survivors.  The bound only tightens
+		// between blocks, so a block may pass a few the heap then refuses.
+		int hits[PKM_BRUTEFORCE_SELECT];
+		pkmIndexDist dists[PKM_BRUTEFORCE_SELECT];
+		const pkmIndexDist *frameNorms = metric == PKM_DISTANCE_L1 ? NULL : &norms[first];
+		for (int f = 0; f < count; f += PKM_BRUTEFORCE_SELECT) {
+			pkmIndexDist worst = (int)heap.size() < k ? DBL_MAX : heap.front().first;
+			int found = select(row + f, frameNorms ? frameNorms + f : NULL, queryNorm,
+							   std::min(PKM_BRUTEFORCE_SELECT, count - f), worst, hits, dists);
+			for (int i = 0; i < found; i++)
+				pkmIndexKeepBest(heap, k, dists[i], first + f + hits[i]);
+		}
+	}
+
+	// exact L2 distances for the survivors, which the expansion only
+	// approximates when the norms are large
+	void rescore(const pkmIndexCoord *query, std::vector<Entry> &heap) const
+	{
+		if (metric == PKM_DISTANCE_L1) {
+			return;
+		}
+		for (size_t i = 0; i < heap.size(); i++) {
+			pkmIndexDist sum = 0;
+			for (int j = 0; j < dim; j++) {
+				pkmIndexDist d = query[j] - frameAt(heap[i].second, j);
+				sum += d*d;
+			}
+			heap[i].first = sum;
+		}
+		std::make_heap(heap.begin(), heap.end());
+	}
+
+	pkmIndexCoord				*panels;		// numPanels x dim x PKM_BRUTEFORCE_PANEL, zero padded
+	std::vector<pkmIndexDist>	norms;			// ||x||^2 of every frame
+	pkmBruteForceKernel			kernel;
+	pkmBruteForceSelect			select;
+	pkmBruteForceISA			kernelISA;
+	pkmDistanceMetric			metric;
+	int							dim,
+								n,
+								numPanels;
+};
@@ -0,0 +1,441 @@
+/*
+ *  pkmDSP.h
+ *
+ *  Portable subset of Apple's Accelerate Framework (vDSP/cblas) as used by
+ *  the pkm classes.  On Apple platforms this simply includes Accelerate;
+ *  everywhere else it provides plain C implementations with the same names,
+ *  argument order and packing so the rest of the code compiles unchanged.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Only the routines actually called in this project are provided, and only
+ *  the FFT-free ones: the FFT itself lives behind pkmFFTBackend.  The
+ *  transcendental ones (phase, polar/rect, vForce log/exp/sincos) run on
+ *  pkmFastMath.
+ *
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#ifdef __APPLE__
+
+#include <Accelerate/Accelerate.h>
+
+#else
+
+#if defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define PKM_DSP_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PKM_DSP_NEON 1
+#endif
+
+// vectorized log/exp/atan2/sincos behind the vForce and polar shims below;
+// -DPKM_EXACT_MATH puts libm back
+#include "pkmFastMath.h"
+
+// strided shims gather this many elements at a time into unit stride
+// scratch for pkmFastMath
+#define PKM_DSP_BLOCK 64
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifndef MAX
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+typedef long				vDSP_Stride;
+typedef unsigned long		vDSP_Length;
+
+typedef struct DSPComplex {
+	float					real;
+	float					imag;
+} DSPComplex;
+
+typedef struct DSPSplitComplex {
+	float					*realp;
+	float					*imagp;
+} DSPSplitComplex;
+
+typedef DSPComplex			COMPLEX;
+typedef DSPSplitComplex		COMPLEX_SPLIT;
+
+enum {
+	vDSP_HANN_DENORM		= 0,
+	vDSP_HANN_HALF			= 1,
+	vDSP_HANN_NORM			= 2
+};
+
+// W[n] = 0.5 * (1 - cos(2*pi*n/N)), or 0.8165 * (1 - cos(2*pi*n/N)) when normalized
+static inline void vDSP_hann_window(float *C, vDSP_Length N, int Flag)
+{
+	vDSP_Length n = (Flag & vDSP_HANN_HALF) ? (N + 1) / 2 : N;
+	float scale = (Flag & vDSP_HANN_NORM) ? 0.8165f : 0.5f;
+	for (vDSP_Length i = 0; i < n; i++)
+		C[i] = scale * (1.0f - cosf(2.0f * (float)M_PI * (float)i / (float)N));
+}
+
+enum {
+	vDSP_HALF_WINDOW		= 1
+};
+
+// W[n] = 0.54 - 0.46 * cos(2*pi*n/N)
+static inline void vDSP_hamm_window(float *C, vDSP_Length N, int Flag)
+{
+	vDSP_Length n = (Flag & vDSP_HALF_WINDOW) ? (N + 1) / 2 : N;
+	for (vDSP_Length i = 0; i < n; i++)
+		C[i] = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * (float)i / (float)N);
+}
+
+// W[n] = 0.42 - 0.5 * cos(2*pi*n/N) + 0.08 * cos(4*pi*n/N)
+static inline void vDSP_blkman_window(float *C, vDSP_Length N, int Flag)
+{
+	vDSP_Length n = (Flag & vDSP_HALF_WINDOW) ? (N + 1) / 2 : N;
+	for (vDSP_Length i = 0; i < n; i++)
+		C[i] = 0.42f - 0.5f * cosf(2.0f * (float)M_PI * (float)i / (float)N)
+			 + 0.08f * cosf(4.0f * (float)M_PI * (float)i / (float)N);
+}
+
+static inline void vDSP_vclr(float *C, vDSP_Stride IC, vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = 0.0f;
+}
+
+static inline void vDSP_vmul(const float *A, vDSP_Stride IA,
+							 const float *B, vDSP_Stride IB,
+							 float *C, vDSP_Stride IC,
+							 vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = A[i*IA] * B[i*IB];
+}
+
+static inline void vDSP_vadd(const float *A, vDSP_Stride IA,
+							 const float *B, vDSP_Stride IB,
+							 float *C, vDSP_Stride IC,
+							 vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = A[i*IA] + B[i*IB];
+}
+
+static inline void vDSP_vsmul(const float *A, vDSP_Stride IA,
+							  const float *B,
+							  float *C, vDSP_Stride IC,
+							  vDSP_Length N)
+{
+	float b = *B;
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = A[i*IA] * b;
+}
+
+static inline void vDSP_vsdiv(const float *A, vDSP_Stride IA,
+							  const float *B,
+							  float *C, vDSP_Stride IC,
+							  vDSP_Length N)
+{
+	float b = *B;
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = A[i*IA] / b;
+}
+
+static inline void vDSP_vsdivD(const double *A, vDSP_Stride IA,
+							   const double *B,
+							   double *C, vDSP_Stride IC,
+							   vDSP_Length N)
+{
+	double b = *B;
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = A[i*IA] / b;
+}
+
+static inline void vDSP_vspdp(const float *A, vDSP_Stride IA,
+							  double *C, vDSP_Stride IC,
+							  vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = (double)A[i*IA];
+}
+
+static inline void vDSP_vramp(const float *A, const float *B,
+							  float *C, vDSP_Stride IC,
+							  vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = *A + (float)i * *B;
+}
+
+// interleaved complex -> split complex
+static inline void vDSP_ctoz(const DSPComplex *C, vDSP_Stride IC,
+							 const DSPSplitComplex *Z, vDSP_Stride IZ,
+							 vDSP_Length N)
+{
+	// IC is in units of floats, as with vDSP
+	const float *c = (const float *)C;
+	for (vDSP_Length i = 0; i < N; i++) {
+		Z->realp[i*IZ] = c[i*IC];
+		Z->imagp[i*IZ] = c[i*IC + 1];
+	}
+}
+
+// split complex -> interleaved complex
+static inline void vDSP_ztoc(const DSPSplitComplex *Z, vDSP_Stride IZ,
+							 DSPComplex *C, vDSP_Stride IC,
+							 vDSP_Length N)
+{
+	float *c = (float *)C;
+	for (vDSP_Length i = 0; i < N; i++) {
+		c[i*IC] = Z->realp[i*IZ];
+		c[i*IC + 1] = Z->imagp[i*IZ];
+	}
+}
+
+// rectangular (re, im) pairs -> polar (mag, phase) pairs
+static inline void vDSP_polar(const float *A, vDSP_Stride IA,
+							  float *C, vDSP_Stride IC,
+							  vDSP_Length N)
+{
+	float re[PKM_DSP_BLOCK], im[PKM_DSP_BLOCK], phase[PKM_DSP_BLOCK];
+	for (vDSP_Length i0 = 0; i0 < N; i0 += PKM_DSP_BLOCK) {
+		int n = (int)MIN((vDSP_Length)PKM_DSP_BLOCK, N - i0);
+		for (int i = 0; i < n; i++) {
+			re[i] = A[(i0 + i)*IA];
+			im[i] = A[(i0 + i)*IA + 1];
+		}
+		pkmFastAtan2(im, re, phase, n);
+		for (int i = 0; i < n; i++) {
+			C[(i0 + i)*IC] = sqrtf(re[i]*re[i] + im[i]*im[i]);
+			C[(i0 + i)*IC + 1] = phase[i];
+		}
+	}
+}
+
+// polar (mag, phase) pairs -> rectangular (re, im) pairs
+static inline void vDSP_rect(const float *A, vDSP_Stride IA,
+							 float *C, vDSP_Stride IC,
+							 vDSP_Length N)
+{
+	float phase[PKM_DSP_BLOCK], s[PKM_DSP_BLOCK], c[PKM_DSP_BLOCK];
+	for (vDSP_Length i0 = 0; i0 < N; i0 += PKM_DSP_BLOCK) {
+		int n = (int)MIN((vDSP_Length)PKM_DSP_BLOCK, N - i0);
+		for (int i = 0; i < n; i++)
+			phase[i] = A[(i0 + i)*IA + 1];
+		pkmFastSinCos(phase, s, c, n);
+		for (int i = 0; i < n; i++) {
+			float mag = A[(i0 + i)*IA];
+			C[(i0 + i)*IC] = mag * c[i];
+			C[(i0 + i)*IC + 1] = mag * s[i];
+		}
+	}
+}
+
+// magnitude of split complex values
+static inline void vDSP_zvabs(const DSPSplitComplex *A, vDSP_Stride IA,
+							  float *C, vDSP_Stride IC,
+							  vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++) {
+		float re = A->realp[i*IA], im = A->imagp[i*IA];
+		C[i*IC] = sqrtf(re*re + im*im);
+	}
+}
+
+// squared magnitude of split complex values
+static inline void vDSP_zvmags(const DSPSplitComplex *A, vDSP_Stride IA,
+							   float *C, vDSP_Stride IC,
+							   vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++) {
+		float re = A->realp[i*IA], im = A->imagp[i*IA];
+		C[i*IC] = re*re + im*im;
+	}
+}
+
+// phase of split complex values
+static inline void vDSP_zvphas(const DSPSplitComplex *A, vDSP_Stride IA,
+							   float *C, vDSP_Stride IC,
+							   vDSP_Length N)
+{
+	if (IA == 1 && IC == 1) {
+		pkmFastAtan2(A->imagp, A->realp, C, (int)N);
+		return;
+	}
+	float re[PKM_DSP_BLOCK], im[PKM_DSP_BLOCK], phase[PKM_DSP_BLOCK];
+	for (vDSP_Length i0 = 0; i0 < N; i0 += PKM_DSP_BLOCK) {
+		int n = (int)MIN((vDSP_Length)PKM_DSP_BLOCK, N - i0);
+		for (int i = 0; i < n; i++) {
+			re[i] = A->realp[(i0 + i)*IA];
+			im[i] = A->imagp[(i0 + i)*IA];
+		}
+		pkmFastAtan2(im, re, phase, n);
+		for (int i = 0; i < n; i++)
+			C[(i0 + i)*IC] = phase[i];
+	}
+}
+
+// C (M x N) = A (M x P) * B (P x N), all row major.  Unit strides run
+// blocked over P with the inner loop along rows of B and C, so it
+// vectorizes and B stays in cache; every C[m][n] still sums p in order.
+static inline void vDSP_mmul(const float *A, vDSP_Stride IA,
+							 const float *B, vDSP_Stride IB,
+							 float *C, vDSP_Stride IC,
+							 vDSP_Length M,
+							 vDSP_Length N,
+							 vDSP_Length P)
+{
+	if (IA == 1 && IB == 1 && IC == 1) {
+		const vDSP_Length block = 128;
+		for (vDSP_Length i = 0; i < M*N; i++)
+			C[i] = 0.0f;
+		for (vDSP_Length p0 = 0; p0 < P; p0 += block) {
+			vDSP_Length p1 = MIN(p0 + block, P);
+			for (vDSP_Length m = 0; m < M; m++) {
+				float *c = C + m*N;
+				for (vDSP_Length p = p0; p < p1; p++) {
+					float a = A[m*P + p];
+					const float *b = B + p*N;
+					vDSP_Length n = 0;
+#if defined(PKM_DSP_SSE)
+					__m128 va = _mm_set1_ps(a);
+					for (; n + 4 <= N; n += 4)
+						_mm_storeu_ps(c + n, _mm_add_ps(_mm_loadu_ps(c + n), _mm_mul_ps(va, _mm_loadu_ps(b + n))));
+#elif defined(PKM_DSP_NEON)
+					float32x4_t va = vdupq_n_f32(a);
+					for (; n + 4 <= N; n += 4)
+						vst1q_f32(c + n, vaddq_f32(vld1q_f32(c + n), vmulq_f32(va, vld1q_f32(b + n))));
+#endif
+					for (; n < N; n++)
+						c[n] += a * b[n];
+				}
+			}
+		}
+		return;
+	}
+	for (vDSP_Length m = 0; m < M; m++) {
+		for (vDSP_Length n = 0; n < N; n++) {
+			float sum = 0.0f;
+			for (vDSP_Length p = 0; p < P; p++)
+				sum += A[(m*P + p)*IA] * B[(p*N + n)*IB];
+			C[(m*N + n)*IC] = sum;
+		}
+	}
+}
+
+// C = A * A
+static inline void vDSP_vsq(const float *A, vDSP_Stride IA,
+							float *C, vDSP_Stride IC,
+							vDSP_Length N)
+{
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = A[i*IA] * A[i*IA];
+}
+
+// C = max(A, *B)
+static inline void vDSP_vthr(const float *A, vDSP_Stride IA,
+							 const float *B,
+							 float *C, vDSP_Stride IC,
+							 vDSP_Length N)
+{
+	float b = *B;
+	for (vDSP_Length i = 0; i < N; i++)
+		C[i*IC] = A[i*IA] >= b ? A[i*IA] : b;
+}
+
+// vForce: y = log10(x)
+static inline void vvlog10f(float *y, const float *x, const int *n)
+{
+	pkmFastLog10(x, y, *n);
+}
+
+// vForce: y = exp(x)
+static inline void vvexpf(float *y, const float *x, const int *n)
+{
+	pkmFastExp(x, y, *n);
+}
+
+// vForce: z = sin(x), c = cos(x)
+static inline void vvsincosf(float *z, float *c, const float *x, const int *n)
+{
+	pkmFastSinCos(x, z, c, *n);
+}
+
+// *C = sum A[n] * B[n], vectorized for unit strides
+static inline void vDSP_dotpr(const float *A, vDSP_Stride IA,
+							  const float *B, vDSP_Stride IB,
+							  float *C,
+							  vDSP_Length N)
+{
+	vDSP_Length n = 0;
+	float sum = 0.0f;
+	if (IA == 1 && IB == 1) {
+#if defined(PKM_DSP_SSE)
+		__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+		for (; n + 8 <= N; n += 8) {
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(A + n), _mm_loadu_ps(B + n)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(A + n + 4), _mm_loadu_ps(B + n + 4)));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+		sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(PKM_DSP_NEON)
+		float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+		for (; n + 8 <= N; n += 8) {
+			acc0 = vmlaq_f32(acc0, vld1q_f32(A + n), vld1q_f32(B + n));
+			acc1 = vmlaq_f32(acc1, vld1q_f32(A + n + 4), vld1q_f32(B + n + 4));
+		}
+		float lanes[4];
+		vst1q_f32(lanes, vaddq_f32(acc0, acc1));
+		sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	}
+	for (; n < N; n++)
+		sum += A[n*IA] * B[n*IB];
+	*C = sum;
+}
+
+static inline void cblas_scopy(const int N,
+							   const float *X, const int incX,
+							   float *Y, const int incY)
+{
+	for (int i = 0; i < N; i++)
+		Y[i*incY] = X[i*incX];
+}
+
+#endif
@@ -0,0 +1,6 @@
+/*
+ *  pkmDatabaseFile.cpp
+ *
+ */
+
+#include "pkmDatabaseFile.h"
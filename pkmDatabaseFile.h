@@ -0,0 +1,150 @@
+/*
+ *  pkmDatabaseFile.h
+ *
+ *  On-disk layout of a pkmAudioFeatureDatabase (save() and load()), made to
+ *  be memory mapped and used where it lies rather than parsed:
+ *
+ *  pkmDatabaseHeader			magic, version, byte order, feature type and
+ *								shape, and where every section is
+ *  PKM_DATABASE_FEATURES		the feature store's block as is (rows, or
+ *								columns of numFrames values)
+ *  PKM_DATABASE_SOUNDS			pkmDatabaseSound per sound
+ *  PKM_DATABASE_FRAMES			pkmDatabaseFrame per frame (audio_database)
+ *  PKM_DATABASE_PCM			every sound's samples, as pcmFormat
+ *  PKM_DATABASE_INDEX			pkmIncrementalIndex::save(), may be empty
+ *
+ *  Sections start on PKM_DATABASE_ALIGNMENT byte boundaries.  Numbers are in
+ *  the writer's byte order, which load() checks against its own; a newer
+ *  version, another feature type or feature count, or a section out of the
+ *  file is refused.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define PKM_DATABASE_MAGIC			"pkmAFDB"
+#define PKM_DATABASE_VERSION		3
+#define PKM_DATABASE_BYTE_ORDER		0x01020304u
+#define PKM_DATABASE_ALIGNMENT		4096
+
+#define PKM_DATABASE_STRINGIFY2(x)	#x
+#define PKM_DATABASE_STRINGIFY(x)	PKM_DATABASE_STRINGIFY2(x)
+
+enum pkmDatabaseSection
+{
+	PKM_DATABASE_FEATURES,
+	PKM_DATABASE_SOUNDS,
+	PKM_DATABASE_FRAMES,
+	PKM_DATABASE_PCM,
+	PKM_DATABASE_INDEX,
+	PKM_DATABASE_NUM_SECTIONS
+};
+
+struct pkmDatabaseSectionEntry
+{
+	uint64_t		offset,				// from the start of the file
+					bytes;
+};
+
+struct pkmDatabaseHeader
+{
+	char			magic[8];
+	uint32_t		version,
+					byteOrder,
+					headerBytes;
+	char			featureType[20];	// PKM_FEATURE_TYPE as written
+	int32_t			featureBytes,
+					featureLayout,
+					numFeatures,
+					sampleRate,
+					fftSize,
+					hopSize,
+					numFrames,
+					numSounds,
+					numNeighbors,
+					bBuiltIndex,
+					indexedFrames,
+					pcmFormat;			// pkmAudioSampleFormat
+	pkmDatabaseSectionEntry	sections[PKM_DATABASE_NUM_SECTIONS];
+};
+
+struct pkmDatabaseSound
+{
+	uint64_t		sample;				// first sample in PKM_DATABASE_PCM
+	int32_t			length,				// samples
+					firstFrame;
+};
+
+struct pkmDatabaseFrame
+{
+	int32_t			sound,
+					offset,				// samples into the sound
+					length;				// as pkmAudioFile::length
+};
+
+// bytes up to the next section boundary
+static inline uint64_t pkmDatabaseAlign(uint64_t bytes)
+{
+	return (bytes + PKM_DATABASE_ALIGNMENT - 1) / PKM_DATABASE_ALIGNMENT * PKM_DATABASE_ALIGNMENT;
+}
+
+// sequential writes that count their bytes (ftell is 32 bits on some
+// platforms); ok turns false on the first failure
+struct pkmDatabaseWriter
+{
+	FILE			*file;
+	uint64_t		at;
+	bool			ok;
+
+	pkmDatabaseWriter(FILE *f) : file(f), at(0), ok(f != NULL) {}
+
+	void write(const void *p, size_t bytes)
+	{
+		if (ok && bytes && fwrite(p, 1, bytes, file) != bytes) {
+			ok = false;
+		}
+		at += bytes;
+	}
+
+	// zeros up to the next section boundary
+	void pad()
+	{
+		static const char zeros[256] = {0};
+		uint64_t n = pkmDatabaseAlign(at) - at;
+		while (n > 0) {
+			size_t chunk = n < sizeof(zeros) ? (size_t)n : sizeof(zeros);
+			write(zeros, chunk);
+			n -= chunk;
+		}
+	}
+};
@@ -0,0 +1,6 @@
+/*
+ *  pkmEpoch.cpp
+ *
+ */
+
+#include "pkmEpoch.h"
@@ -0,0 +1,146 @@
+/*
+ *  pkmEpoch.h
+ *
+ *  Epoch based reclamation for data that real-time readers look at while
+ *  a writer replaces it.  Readers bracket their access with enter() and
+ *  exit(), which never block or allocate: enter() claims one of
+ *  PKM_EPOCH_MAX_READERS slots with a compare and swap and stamps it with
+ *  the current epoch.  The writer publishes the new version (an atomic
+ *  store), then retire()s the old one; it is freed once every reader that
+ *  could still see it has left, i.e. every occupied slot carries a later
+ *  epoch.  Only the writer frees anything.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  // reader (audio thread)
+ *  int slot = epoch.enter();
+ *  Snapshot *s = published.load();
+ *  ...
+ *  epoch.exit(slot);
+ *
+ *  // writer (one at a time)
+ *  Snapshot *old = published.exchange(next);
+ *  epoch.retire(old, deleteSnapshot);
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#define PKM_EPOCH_MAX_READERS 8
+
+class pkmEpoch
+{
+public:
+	pkmEpoch()
+	{
+		epoch.store(1);
+		for (int i = 0; i < PKM_EPOCH_MAX_READERS; i++)
+			slots[i].store(0);
+	}
+
+	// frees everything still retired; no reader may be inside
+	~pkmEpoch()
+	{
+		for (size_t i = 0; i < retired.size(); i++)
+			retired[i].release(retired[i].ptr);
+	}
+
+	// reader: returns the slot to hand to exit()
+	int enter()
+	{
+		while (true) {
+			uint64_t e = epoch.load();
+			for (int i = 0; i < PKM_EPOCH_MAX_READERS; i++) {
+				uint64_t idle = 0;
+				if (slots[i].compare_exchange_strong(idle, e)) {
+					return i;
+				}
+			}
+			// more than PKM_EPOCH_MAX_READERS readers at once; retry
+		}
+	}
+
+	void exit(int slot)
+	{
+		slots[slot].store(0);
+	}
+
+	// writer: ptr is unreachable for new readers (already unpublished);
+	// release(ptr) runs once the readers that might hold it are gone
+	void retire(void *ptr, void (*release)(void *))
+	{
+		Retired r;
+		r.ptr = ptr;
+		r.release = release;
+		r.epoch = epoch.fetch_add(1);
+		retired.push_back(r);
+		reclaim();
+	}
+
+	// writer: free what no reader can see any more
+	void reclaim()
+	{
+		uint64_t oldest = UINT64_MAX;
+		for (int i = 0; i < PKM_EPOCH_MAX_READERS; i++) {
+			uint64_t e = slots[i].load();
+			if (e && e < oldest) {
+				oldest = e;
+			}
+		}
+		size_t kept = 0;
+		for (size_t i = 0; i < retired.size(); i++) {
+			if (retired[i].epoch < oldest) {
+				retired[i].release(retired[i].ptr);
+			}
+			else {
+				retired[kept++] = retired[i];
+			}
+		}
+		retired.resize(kept);
+	}
+
+	inline int getNumRetired() const		{ return (int)retired.size(); }
+
+private:
+	struct Retired
+	{
+		void		*ptr;
+		void		(*release)(void *);
+		uint64_t	epoch;
+	};
+
+	std::atomic<uint64_t>	epoch;
+	std::atomic<uint64_t>	slots[PKM_EPOCH_MAX_READERS];	// 0 = free, else epoch at enter()
+	std::vector<Retired>	retired;
+};
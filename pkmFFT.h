@@ -1,7 +1,8 @@
 /*
  *  pkmFFT.h
  *
- *  Real FFT wraper for Apple's Accelerate Framework
+ *  Real FFT wraper for Apple's Accelerate Framework, or the native SIMD
+ *  engine where Accelerate is not available (see pkmFFTBackend.h)
  *
  *  Created by Parag K. Mital - http://pkmital.com 
  *  Contact: parag@pkmital.com
@@ -52,26 +53,49 @@
  *  fft = new pkmFFT(4096);
  *  fft.forward(0, sample_data, allocated_magnitude_buffer, allocated_phase_buffer);
  *  fft.inverse(0, sample_data, allocated_magnitude_buffer, allocated_phase_buffer);
+ *
+ *  // when the phase is not needed
+ *  fft.forwardMagnitude(sample_data, allocated_magnitude_buffer);
+ *  fft.forwardPower(sample_data, allocated_power_buffer);
+ *
+ *  // or many frames at once, e.g. hops of 1024 straight into matrix rows
+ *  fft.forwardBatch(sample_data, 1024, num_frames, magnitudes.row(0), phases.row(0));
  *  delete fft;
  *
  */
 #pragma once
 
-#include <Accelerate/Accelerate.h>
+#include "pkmDSP.h"
+#include "pkmFFTBackend.h"
+#include "pkmFFTPlan.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+// largest lane interleaved transform (in floats per split array) that
+// forwardBatch runs, i.e. 512 points with 8 lanes or 1024 with 4
+#ifndef PKM_FFT_LANES_MAX_FLOATS
+#define PKM_FFT_LANES_MAX_FLOATS 2048
+#endif
 
 class pkmFFT
 {
 public:
 
-	pkmFFT(int size = 4096)
+	pkmFFT(int size = 4096, 
+		   pkmFFTBackendType backend_type = PKM_FFT_BACKEND_DEFAULT, 
+		   pkmFFTWindowType window_type = PKM_FFT_WINDOW_HANN)
 	{
+		// odd sizes have no packed spectrum: keep no plan, and every
+		// transform does nothing (isValid() is false)
+		if (size < 2 || (size & 1)) {
+			printf("[ERROR] pkmFFT: size %d is not even\n", size);
+			size = 0;
+		}
+		
 		fftSize = size;					// sample size
 		fftSizeOver2 = fftSize/2;		
-		log2n = log2f(fftSize);			// bins
+		log2n = fftSize ? log2f(fftSize) : 0;	// bins
 		log2nOver2 = log2n/2;
 		
 		in_real = (float *) malloc(fftSize * sizeof(float));
@@ -80,15 +104,29 @@ public:
 		split_data.imagp = (float *) malloc(fftSizeOver2 * sizeof(float));
 		
 		windowSize = size;
-		window = (float *) malloc(sizeof(float) * windowSize);
-		memset(window, 0, sizeof(float) * windowSize);
-		vDSP_hann_window(window, windowSize, vDSP_HANN_NORM);
 		
-		scale = 1.0f/(float)(4.0f*fftSize);
+		scale = fftSize ? 1.0f/(float)(4.0f*fftSize) : 0.0f;
 		
-		// allocate the fft object once
-		fftSetup = vDSP_create_fftsetup(log2n, FFT_RADIX2);
-		if (fftSetup == NULL || in_real == NULL || out_real == NULL || 
+		// twiddles and window are shared with every other pkmFFT of this 
+		// size, only the scratch above is ours
+		plan = NULL;
+		backend = NULL;
+		window = NULL;
+		lanes = 1;
+		lane_data.realp = lane_data.imagp = NULL;
+		if (!fftSize) {
+			return;
+		}
+		plan = pkmFFTPlan::acquire(fftSize, backend_type, window_type);
+		backend = plan->backend;
+		window = plan->window;
+		
+		// lane interleaved scratch for forwardBatch
+		lanes = backend->getLanes();
+		lane_data.realp = (float *) malloc(fftSizeOver2 * lanes * sizeof(float));
+		lane_data.imagp = (float *) malloc(fftSizeOver2 * lanes * sizeof(float));
+		
+		if (backend == NULL || in_real == NULL || out_real == NULL || 
 			split_data.realp == NULL || split_data.imagp == NULL || window == NULL) 
 		{
 			printf("\nFFT_Setup failed to allocate enough memory.\n");
@@ -100,9 +138,10 @@ public:
 		free(out_real);
 		free(split_data.realp);
 		free(split_data.imagp);
-		free(window);
+		free(lane_data.realp);
+		free(lane_data.imagp);
 		
-		vDSP_destroy_fftsetup(fftSetup);
+		pkmFFTPlan::release(plan);
 	}
 	
 	void forward(int start, 
@@ -110,33 +149,89 @@ public:
 				 float *magnitude, 
 				 float *phase)
 	{	
-		//multiply by window
-		vDSP_vmul(buffer, 1, window, 1, in_real, 1, fftSize);
+		transform(buffer);
 		
-		//convert to split complex format with evens in real and odds in imag
-		vDSP_ctoz((COMPLEX *) in_real, 2, &split_data, 1, fftSizeOver2);
+		vDSP_zvabs(&split_data, 1, magnitude, 1, fftSizeOver2);
+		vDSP_zvphas(&split_data, 1, phase, 1, fftSizeOver2);
+	}
+	
+	// magnitude only, skipping the phase (atan2) entirely
+	void forwardMagnitude(float *buffer, 
+						  float *magnitude)
+	{
+		transform(buffer);
 		
-		//calc fft
-		vDSP_fft_zrip(fftSetup, &split_data, 1, log2n, FFT_FORWARD);
+		vDSP_zvabs(&split_data, 1, magnitude, 1, fftSizeOver2);
+	}
+	
+	// power (squared magnitude), no sqrt and no phase
+	void forwardPower(float *buffer, 
+					  float *power)
+	{
+		transform(buffer);
 		
-		split_data.imagp[0] = 0.0;
+		vDSP_zvmags(&split_data, 1, power, 1, fftSizeOver2);
+	}
+	
+	// raw vDSP_fft_zrip packed spectrum: realp[0] is DC, imagp[0] is Nyquist,
+	// and bins 1 .. fftSizeOver2-1 follow (scaled by 2)
+	void forwardSplit(float *buffer, 
+					  float *realp, 
+					  float *imagp)
+	{
+		if (!isValid()) {
+			return;
+		}
+		vDSP_vmul(buffer, 1, window, 1, in_real, 1, fftSize);
+		COMPLEX_SPLIT out = { realp, imagp };
+		vDSP_ctoz((COMPLEX *) in_real, 2, &out, 1, fftSizeOver2);
+		backend->forward(&out);
+	}
+	
+	// forward transform of count frames, frame f starting at frames + f*stride,
+	// written to row f of row-major magnitude and phase matrices with 
+	// fftSizeOver2 columns (e.g. pkm::Mat::row(0)).  phase may be NULL.
+	void forwardBatch(float *frames, 
+					  int stride, 
+					  int count, 
+					  float *magnitudes, 
+					  float *phases)
+	{
+		int f = 0;
 		
-		/*
-		for (i = 0; i < fftSizeOver2; i++) 
+		// groups of frames side by side, one per SIMD lane, as long as the
+		// interleaved frames stay in cache (beyond that it is slower)
+		if (lanes > 1 && fftSizeOver2 * lanes <= PKM_FFT_LANES_MAX_FLOATS) {
+			for (; f + lanes <= count; f += lanes)
+			{
+				for (int l = 0; l < lanes; l++) {
+					COMPLEX_SPLIT lane = { lane_data.realp + l, lane_data.imagp + l };
+					vDSP_vmul(frames + (f + l)*stride, 1, window, 1, in_real, 1, fftSize);
+					vDSP_ctoz((COMPLEX *) in_real, 2, &lane, lanes, fftSizeOver2);
+				}
+				
+				backend->forwardLanes(&lane_data);
+				
+				for (int l = 0; l < lanes; l++) {
+					COMPLEX_SPLIT lane = { lane_data.realp + l, lane_data.imagp + l };
+					lane.imagp[0] = 0.0;
+					vDSP_zvabs(&lane, lanes, magnitudes + (f + l)*fftSizeOver2, 1, fftSizeOver2);
+					if (phases) {
+						vDSP_zvphas(&lane, lanes, phases + (f + l)*fftSizeOver2, 1, fftSizeOver2);
+					}
+				}
+			}
+		}
+		
+		// remaining frames one at a time
+		for (; f < count; f++)
 		{
-			//compute power 
-			float power = split_data.realp[i]*split_data.realp[i] + 
-							split_data.imagp[i]*split_data.imagp[i];
-			
-			//compute magnitude and phase
-			magnitude[i] = sqrtf(power);
-			phase[i] = atan2f(split_data.imagp[i], split_data.realp[i]);
-		}*/
-		
-		vDSP_ztoc(&split_data, 1, (COMPLEX *) in_real, 2, fftSizeOver2);
-		vDSP_polar(in_real, 2, out_real, 2, fftSizeOver2);
-		cblas_scopy(fftSizeOver2, out_real, 2, magnitude, 1);
-		cblas_scopy(fftSizeOver2, out_real+1, 2, phase, 1);
+			transform(frames + f*stride);
+			vDSP_zvabs(&split_data, 1, magnitudes + f*fftSizeOver2, 1, fftSizeOver2);
+			if (phases) {
+				vDSP_zvphas(&split_data, 1, phases + f*fftSizeOver2, 1, fftSizeOver2);
+			}
+		}
 	}
 	
 	void inverse(int start, 
@@ -145,6 +240,22 @@ public:
 				 float *phase, 
 				 bool dowindow = true)
 	{
+		// multiply by window w/ overlap-add
+		if (dowindow) {
+			inverseFrame(magnitude, phase, out_real);
+			vDSP_vadd(buffer + start, 1, out_real, 1, buffer + start, 1, fftSize);
+		}
+	}
+	
+	// scaled and windowed inverse of one frame into frame (fftSize samples),
+	// i.e. exactly what inverse() overlap-adds into its buffer
+	void inverseFrame(float *magnitude,
+					  float *phase,
+					  float *frame)
+	{
+		if (!isValid()) {
+			return;
+		}
 		/*
 		float	*real_p = split_data.realp, 
 				*imag_p = split_data.imagp;
@@ -154,47 +265,68 @@ public:
 		}
 		*/
 		
-		cblas_scopy(fftSizeOver2, magnitude, 1, in_real, 2);
-		cblas_scopy(fftSizeOver2, phase, 1, in_real+1, 2);
-		vDSP_rect(in_real, 2, out_real, 2, fftSizeOver2);
+		// polar to split complex directly: cos into real, sin into imag,
+		// both scaled by the magnitude
+		int n = fftSizeOver2;
+		vvsincosf(split_data.imagp, split_data.realp, phase, &n);
+		vDSP_vmul(split_data.realp, 1, magnitude, 1, split_data.realp, 1, fftSizeOver2);
+		vDSP_vmul(split_data.imagp, 1, magnitude, 1, split_data.imagp, 1, fftSizeOver2);
 		
-		//convert to split complex format with evens in real and odds in imag
-		vDSP_ctoz((COMPLEX *) out_real, 2, &split_data, 1, fftSizeOver2);
-		
-		vDSP_fft_zrip(fftSetup, &split_data, 1, log2n, FFT_INVERSE);
+		backend->inverse(&split_data);
 		vDSP_ztoc(&split_data, 1, (COMPLEX*) out_real, 2, fftSizeOver2);
 		
 		vDSP_vsmul(out_real, 1, &scale, out_real, 1, fftSize);
-		
-		// multiply by window w/ overlap-add
-		if (dowindow) {
-			float *p = buffer + start;
-			for (i = 0; i < fftSize; i++) {
-				*p++ += out_real[i] * window[i];
-			}
-		}
+		vDSP_vmul(out_real, 1, window, 1, frame, 1, fftSize);
 	}
 	
 	
+	// false when the size was rejected
+	inline bool isValid()
+	{
+		return plan != NULL;
+	}
+	
 	int					fftSize, 
 						fftSizeOver2,
 						log2n,
 						log2nOver2,
 						windowSize,
+						lanes,
 						i;	
 	
 private:
 	
-				
+	// window, pack and transform buffer into split_data, dropping the
+	// Nyquist term so bin 0 is just the DC
+	void transform(float *buffer)
+	{
+		if (!isValid()) {
+			return;
+		}
+		
+		//multiply by window
+		vDSP_vmul(buffer, 1, window, 1, in_real, 1, fftSize);
+		
+		//convert to split complex format with evens in real and odds in imag
+		vDSP_ctoz((COMPLEX *) in_real, 2, &split_data, 1, fftSizeOver2);
+		
+		//calc fft
+		backend->forward(&split_data);
+		
+		split_data.imagp[0] = 0.0;
+	}
 	
 	float				*in_real, 
-						*out_real,
-						*window;
+						*out_real;
+	
+	const float			*window;
 	
 	float				scale;
 	
-    FFTSetup			fftSetup;
-    COMPLEX_SPLIT		split_data;
+	pkmFFTPlan			*plan;
+	pkmFFTBackend		*backend;
+    COMPLEX_SPLIT		split_data,
+						lane_data;
 	
 	
 };
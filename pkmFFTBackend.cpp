@@ -0,0 +1,6 @@
+/*
+ *  pkmFFTBackend.cpp
+ *
+ */
+
+#include "pkmFFTBackend.h"
\ No newline at end of file
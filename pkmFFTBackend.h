@@ -0,0 +1,186 @@
+/*
+ *  pkmFFTBackend.h
+ *
+ *  Pluggable real FFT backends underneath pkmFFT: Accelerate's
+ *  vDSP_fft_zrip on Apple platforms and the native SIMD engine (pkmRealFFT)
+ *  everywhere else.  Both take and return vDSP_fft_zrip packed split complex
+ *  data with the same scaling, so pkmFFT does not care which one it has.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Define PKM_FFT_NATIVE to use the native engine on Apple platforms too.
+ *  Sizes that are not a power of two always use the native engine.
+ *
+ */
+
+#pragma once
+
+#include "pkmDSP.h"
+#include "pkmRealFFT.h"
+
+enum pkmFFTBackendType
+{
+	PKM_FFT_BACKEND_DEFAULT,
+	PKM_FFT_BACKEND_ACCELERATE,
+	PKM_FFT_BACKEND_NATIVE
+};
+
+class pkmFFTBackend
+{
+public:
+	virtual ~pkmFFTBackend() {}
+
+	// in-place real FFT of vDSP_fft_zrip packed data
+	virtual void forward(COMPLEX_SPLIT *split) = 0;
+	virtual void inverse(COMPLEX_SPLIT *split) = 0;
+
+	// number of frames forwardLanes() transforms in one call
+	virtual int getLanes() = 0;
+
+	// in-place forward transform of getLanes() frames held lane-interleaved,
+	// element k of frame l at realp[k*getLanes() + l] (and imagp)
+	virtual void forwardLanes(COMPLEX_SPLIT *split) = 0;
+
+	virtual const char * getName() = 0;
+
+	static pkmFFTBackend * create(int size,
+								  pkmFFTBackendType type = PKM_FFT_BACKEND_DEFAULT,
+								  pkmFFTISA isa = PKM_FFT_ISA_AUTO);
+};
+
+#ifdef __APPLE__
+
+class pkmFFTBackendAccelerate : public pkmFFTBackend
+{
+public:
+	pkmFFTBackendAccelerate(int size)
+	{
+		log2n = log2f(size);
+		fftSetup = vDSP_create_fftsetup(log2n, FFT_RADIX2);
+		if (fftSetup == NULL) {
+			printf("\nFFT_Setup failed to allocate enough memory.\n");
+		}
+	}
+	~pkmFFTBackendAccelerate()
+	{
+		vDSP_destroy_fftsetup(fftSetup);
+	}
+
+	void forward(COMPLEX_SPLIT *split)
+	{
+		vDSP_fft_zrip(fftSetup, split, 1, log2n, FFT_FORWARD);
+	}
+
+	void inverse(COMPLEX_SPLIT *split)
+	{
+		vDSP_fft_zrip(fftSetup, split, 1, log2n, FFT_INVERSE);
+	}
+
+	int getLanes()
+	{
+		return 8;
+	}
+
+	void forwardLanes(COMPLEX_SPLIT *split)
+	{
+		vDSP_fftm_zrip(fftSetup, split, 8, 1, log2n, 8, FFT_FORWARD);
+	}
+
+	const char * getName()
+	{
+		return "accelerate";
+	}
+
+private:
+	int					log2n;
+	FFTSetup			fftSetup;
+};
+
+#endif
+
+class pkmFFTBackendNative : public pkmFFTBackend
+{
+public:
+	pkmFFTBackendNative(int size, pkmFFTISA isa = PKM_FFT_ISA_AUTO)
+	{
+		engine = new pkmRealFFT(size, isa);
+	}
+	~pkmFFTBackendNative()
+	{
+		delete engine;
+	}
+
+	void forward(COMPLEX_SPLIT *split)
+	{
+		engine->forward(split->realp, split->imagp);
+	}
+
+	void inverse(COMPLEX_SPLIT *split)
+	{
+		engine->inverse(split->realp, split->imagp);
+	}
+
+	int getLanes()
+	{
+		return engine->getLanes();
+	}
+
+	void forwardLanes(COMPLEX_SPLIT *split)
+	{
+		engine->forwardLanes(split->realp, split->imagp);
+	}
+
+	const char * getName()
+	{
+		return pkmFFTISAName(engine->getISA());
+	}
+
+private:
+	pkmRealFFT			*engine;
+};
+
+inline pkmFFTBackend * pkmFFTBackend::create(int size,
+											 pkmFFTBackendType type,
+											 pkmFFTISA isa)
+{
+#if defined(__APPLE__) && !defined(PKM_FFT_NATIVE)
+	if (type == PKM_FFT_BACKEND_DEFAULT) {
+		type = PKM_FFT_BACKEND_ACCELERATE;
+	}
+#endif
+#ifdef __APPLE__
+	// vDSP_fft_zrip only does powers of two
+	if (type == PKM_FFT_BACKEND_ACCELERATE && (size & (size - 1)) == 0) {
+		return new pkmFFTBackendAccelerate(size);
+	}
+#else
+	if (type == PKM_FFT_BACKEND_ACCELERATE) {
+		printf("[WARNING] pkmFFTBackend: Accelerate is not available, using the native FFT\n");
+	}
+#endif
+	return new pkmFFTBackendNative(size, isa);
+}
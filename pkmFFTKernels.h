@@ -0,0 +1,701 @@
+/*
+ *  pkmFFTKernels.h
+ *
+ *  Butterfly kernels for the native FFT engine (pkmRealFFT) with SSE, AVX2
+ *  and NEON variants, and the runtime CPU dispatch that picks between them.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  All kernels work on split complex data (separate real and imaginary
+ *  arrays) so that a vector register always holds consecutive butterflies.
+ *  The twiddle table is laid out so that the twiddles for a stage with
+ *  half-length h are tw[h .. 2h-1], i.e. contiguous for every stage.
+ *  Stages are normally run two at a time (radix-4 passes) to halve the
+ *  number of trips through memory, with a single radix-2 pass first when
+ *  the number of stages is odd.
+ *
+ *  The "Lanes" kernels transform several frames at once instead: frames are
+ *  interleaved so that one vector register holds the same element of 4 (SSE,
+ *  NEON) or 8 (AVX2) frames, and each twiddle is broadcast once and reused
+ *  for every frame and every block of a stage.
+ *
+ *  The SIMD variants are compiled with per-function target attributes, so
+ *  no special compiler flags are needed; pkmFFTDetectISA() decides at
+ *  runtime which one is safe to call.
+ *
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define PKM_FFT_HAVE_X86 1
+#include <immintrin.h>
+#define PKM_TARGET_SSE		__attribute__((target("sse2")))
+#define PKM_TARGET_AVX2		__attribute__((target("avx2,fma")))
+#else
+#define PKM_FFT_HAVE_X86 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PKM_FFT_HAVE_NEON 1
+#include <arm_neon.h>
+#else
+#define PKM_FFT_HAVE_NEON 0
+#endif
+
+enum pkmFFTISA
+{
+	PKM_FFT_ISA_AUTO		= -1,
+	PKM_FFT_ISA_SCALAR		= 0,
+	PKM_FFT_ISA_SSE,
+	PKM_FFT_ISA_AVX2,
+	PKM_FFT_ISA_NEON,
+	PKM_FFT_ISA_COUNT
+};
+
+static inline const char * pkmFFTISAName(pkmFFTISA isa)
+{
+	switch (isa) {
+		case PKM_FFT_ISA_SCALAR:	return "scalar";
+		case PKM_FFT_ISA_SSE:		return "sse";
+		case PKM_FFT_ISA_AVX2:		return "avx2";
+		case PKM_FFT_ISA_NEON:		return "neon";
+		default:					return "auto";
+	}
+}
+
+static inline bool pkmFFTISASupported(pkmFFTISA isa)
+{
+	switch (isa) {
+		case PKM_FFT_ISA_SCALAR:
+			return true;
+#if PKM_FFT_HAVE_X86
+		case PKM_FFT_ISA_SSE:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+		case PKM_FFT_ISA_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+#if PKM_FFT_HAVE_NEON
+		case PKM_FFT_ISA_NEON:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+// best instruction set available on this machine
+static inline pkmFFTISA pkmFFTDetectISA()
+{
+	if (pkmFFTISASupported(PKM_FFT_ISA_AVX2))
+		return PKM_FFT_ISA_AVX2;
+	if (pkmFFTISASupported(PKM_FFT_ISA_NEON))
+		return PKM_FFT_ISA_NEON;
+	if (pkmFFTISASupported(PKM_FFT_ISA_SSE))
+		return PKM_FFT_ISA_SSE;
+	return PKM_FFT_ISA_SCALAR;
+}
+
+// one radix-2 decimation-in-frequency stage over n points, half-length h:
+//		a' = a + b,  b' = (a - b) * w^j
+typedef void (*pkmFFTStageFn)(float *re, float *im,
+							  const float *twr, const float *twi,
+							  int n, int half);
+
+// two fused radix-2 stages (half-lengths 2q and q) in one pass over the data,
+// which gives the same result as calling the radix-2 stage twice
+typedef void (*pkmFFTStage4Fn)(float *re, float *im,
+							   const float *twr, const float *twi,
+							   int n, int quarter);
+
+static inline void pkmFFTStageScalar(float *re, float *im,
+									 const float *twr, const float *twi,
+									 int n, int half)
+{
+	twr += half;
+	twi += half;
+	for (int b = 0; b < n; b += 2*half)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + half, *i1 = i0 + half;
+		for (int j = 0; j < half; j++)
+		{
+			float dr = r0[j] - r1[j];
+			float di = i0[j] - i1[j];
+			r0[j] += r1[j];
+			i0[j] += i1[j];
+			r1[j] = dr*twr[j] - di*twi[j];
+			i1[j] = dr*twi[j] + di*twr[j];
+		}
+	}
+}
+
+static inline void pkmFFTStage4Scalar(float *re, float *im,
+									  const float *twr, const float *twi,
+									  int n, int quarter)
+{
+	int q = quarter;
+	const float *w1r = twr + 2*q, *w1i = twi + 2*q;		// stage 2q, j
+	const float *w3r = w1r + q, *w3i = w1i + q;			// stage 2q, j + q
+	const float *w2r = twr + q, *w2i = twi + q;			// stage q, j
+	for (int b = 0; b < n; b += 4*q)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + q, *i1 = i0 + q;
+		float *r2 = r1 + q, *i2 = i1 + q;
+		float *r3 = r2 + q, *i3 = i2 + q;
+		for (int j = 0; j < q; j++)
+		{
+			float b0r = r0[j] + r2[j], b0i = i0[j] + i2[j];
+			float b1r = r1[j] + r3[j], b1i = i1[j] + i3[j];
+			float d2r = r0[j] - r2[j], d2i = i0[j] - i2[j];
+			float d3r = r1[j] - r3[j], d3i = i1[j] - i3[j];
+			float b2r = d2r*w1r[j] - d2i*w1i[j], b2i = d2r*w1i[j] + d2i*w1r[j];
+			float b3r = d3r*w3r[j] - d3i*w3i[j], b3i = d3r*w3i[j] + d3i*w3r[j];
+			float e1r = b0r - b1r, e1i = b0i - b1i;
+			float e3r = b2r - b3r, e3i = b2i - b3i;
+			r0[j] = b0r + b1r;	i0[j] = b0i + b1i;
+			r1[j] = e1r*w2r[j] - e1i*w2i[j];	i1[j] = e1r*w2i[j] + e1i*w2r[j];
+			r2[j] = b2r + b3r;	i2[j] = b2i + b3i;
+			r3[j] = e3r*w2r[j] - e3i*w2i[j];	i3[j] = e3r*w2i[j] + e3i*w2r[j];
+		}
+	}
+}
+
+#if PKM_FFT_HAVE_X86
+
+PKM_TARGET_SSE
+static inline void pkmFFTStageSSE(float *re, float *im,
+								  const float *twr, const float *twi,
+								  int n, int half)
+{
+	if (half < 4) {
+		pkmFFTStageScalar(re, im, twr, twi, n, half);
+		return;
+	}
+	twr += half;
+	twi += half;
+	for (int b = 0; b < n; b += 2*half)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + half, *i1 = i0 + half;
+		for (int j = 0; j < half; j += 4)
+		{
+			__m128 ar = _mm_loadu_ps(r0 + j), ai = _mm_loadu_ps(i0 + j);
+			__m128 br = _mm_loadu_ps(r1 + j), bi = _mm_loadu_ps(i1 + j);
+			__m128 wr = _mm_loadu_ps(twr + j), wi = _mm_loadu_ps(twi + j);
+			__m128 dr = _mm_sub_ps(ar, br), di = _mm_sub_ps(ai, bi);
+			_mm_storeu_ps(r0 + j, _mm_add_ps(ar, br));
+			_mm_storeu_ps(i0 + j, _mm_add_ps(ai, bi));
+			_mm_storeu_ps(r1 + j, _mm_sub_ps(_mm_mul_ps(dr, wr), _mm_mul_ps(di, wi)));
+			_mm_storeu_ps(i1 + j, _mm_add_ps(_mm_mul_ps(dr, wi), _mm_mul_ps(di, wr)));
+		}
+	}
+}
+
+PKM_TARGET_SSE
+static inline void pkmFFTStage4SSE(float *re, float *im,
+								  const float *twr, const float *twi,
+								  int n, int quarter)
+{
+	int q = quarter;
+	if (q < 4) {
+		pkmFFTStage4Scalar(re, im, twr, twi, n, q);
+		return;
+	}
+	const float *w1r = twr + 2*q, *w1i = twi + 2*q;
+	const float *w3r = w1r + q, *w3i = w1i + q;
+	const float *w2r = twr + q, *w2i = twi + q;
+	for (int b = 0; b < n; b += 4*q)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + q, *i1 = i0 + q;
+		float *r2 = r1 + q, *i2 = i1 + q;
+		float *r3 = r2 + q, *i3 = i2 + q;
+		for (int j = 0; j < q; j += 4)
+		{
+			__m128 a0r = _mm_loadu_ps(r0 + j), a0i = _mm_loadu_ps(i0 + j);
+			__m128 a1r = _mm_loadu_ps(r1 + j), a1i = _mm_loadu_ps(i1 + j);
+			__m128 a2r = _mm_loadu_ps(r2 + j), a2i = _mm_loadu_ps(i2 + j);
+			__m128 a3r = _mm_loadu_ps(r3 + j), a3i = _mm_loadu_ps(i3 + j);
+			__m128 t1r = _mm_loadu_ps(w1r + j), t1i = _mm_loadu_ps(w1i + j);
+			__m128 t3r = _mm_loadu_ps(w3r + j), t3i = _mm_loadu_ps(w3i + j);
+			__m128 t2r = _mm_loadu_ps(w2r + j), t2i = _mm_loadu_ps(w2i + j);
+			__m128 b0r = _mm_add_ps(a0r, a2r), b0i = _mm_add_ps(a0i, a2i);
+			__m128 b1r = _mm_add_ps(a1r, a3r), b1i = _mm_add_ps(a1i, a3i);
+			__m128 d2r = _mm_sub_ps(a0r, a2r), d2i = _mm_sub_ps(a0i, a2i);
+			__m128 d3r = _mm_sub_ps(a1r, a3r), d3i = _mm_sub_ps(a1i, a3i);
+			__m128 b2r = _mm_sub_ps(_mm_mul_ps(d2r, t1r), _mm_mul_ps(d2i, t1i)), b2i = _mm_add_ps(_mm_mul_ps(d2r, t1i), _mm_mul_ps(d2i, t1r));
+			__m128 b3r = _mm_sub_ps(_mm_mul_ps(d3r, t3r), _mm_mul_ps(d3i, t3i)), b3i = _mm_add_ps(_mm_mul_ps(d3r, t3i), _mm_mul_ps(d3i, t3r));
+			__m128 e1r = _mm_sub_ps(b0r, b1r), e1i = _mm_sub_ps(b0i, b1i);
+			__m128 e3r = _mm_sub_ps(b2r, b3r), e3i = _mm_sub_ps(b2i, b3i);
+			_mm_storeu_ps(r0 + j, _mm_add_ps(b0r, b1r));
+			_mm_storeu_ps(i0 + j, _mm_add_ps(b0i, b1i));
+			_mm_storeu_ps(r1 + j, _mm_sub_ps(_mm_mul_ps(e1r, t2r), _mm_mul_ps(e1i, t2i)));
+			_mm_storeu_ps(i1 + j, _mm_add_ps(_mm_mul_ps(e1r, t2i), _mm_mul_ps(e1i, t2r)));
+			_mm_storeu_ps(r2 + j, _mm_add_ps(b2r, b3r));
+			_mm_storeu_ps(i2 + j, _mm_add_ps(b2i, b3i));
+			_mm_storeu_ps(r3 + j, _mm_sub_ps(_mm_mul_ps(e3r, t2r), _mm_mul_ps(e3i, t2i)));
+			_mm_storeu_ps(i3 + j, _mm_add_ps(_mm_mul_ps(e3r, t2i), _mm_mul_ps(e3i, t2r)));
+		}
+	}
+}
+
+// radix-2 stage on 4 lane-interleaved frames, element j of frame l at j*4 + l
+PKM_TARGET_SSE
+static inline void pkmFFTStageLanesSSE(float *re, float *im,
+									 const float *twr, const float *twi,
+									 int n, int half)
+{
+	twr += half;
+	twi += half;
+	for (int j = 0; j < half; j++)
+	{
+		__m128 wr = _mm_set1_ps(twr[j]), wi = _mm_set1_ps(twi[j]);
+		for (int b = j; b < n; b += 2*half)
+		{
+			float *r0 = re + b*4, *i0 = im + b*4;
+			float *r1 = r0 + half*4, *i1 = i0 + half*4;
+			__m128 ar = _mm_loadu_ps(r0), ai = _mm_loadu_ps(i0);
+			__m128 br = _mm_loadu_ps(r1), bi = _mm_loadu_ps(i1);
+			__m128 dr = _mm_sub_ps(ar, br), di = _mm_sub_ps(ai, bi);
+			_mm_storeu_ps(r0, _mm_add_ps(ar, br));
+			_mm_storeu_ps(i0, _mm_add_ps(ai, bi));
+			_mm_storeu_ps(r1, _mm_sub_ps(_mm_mul_ps(dr, wr), _mm_mul_ps(di, wi)));
+			_mm_storeu_ps(i1, _mm_add_ps(_mm_mul_ps(dr, wi), _mm_mul_ps(di, wr)));
+		}
+	}
+}
+
+PKM_TARGET_SSE
+static inline void pkmFFTStage4LanesSSE(float *re, float *im,
+									  const float *twr, const float *twi,
+									  int n, int quarter)
+{
+	int q = quarter;
+	for (int j = 0; j < q; j++)
+	{
+		__m128 t1r = _mm_set1_ps(twr[2*q + j]), t1i = _mm_set1_ps(twi[2*q + j]);
+		__m128 t3r = _mm_set1_ps(twr[3*q + j]), t3i = _mm_set1_ps(twi[3*q + j]);
+		__m128 t2r = _mm_set1_ps(twr[q + j]), t2i = _mm_set1_ps(twi[q + j]);
+		for (int b = j; b < n; b += 4*q)
+		{
+			float *r0 = re + b*4, *i0 = im + b*4;
+			float *r1 = r0 + q*4, *i1 = i0 + q*4;
+			float *r2 = r1 + q*4, *i2 = i1 + q*4;
+			float *r3 = r2 + q*4, *i3 = i2 + q*4;
+			__m128 a0r = _mm_loadu_ps(r0), a0i = _mm_loadu_ps(i0);
+			__m128 a1r = _mm_loadu_ps(r1), a1i = _mm_loadu_ps(i1);
+			__m128 a2r = _mm_loadu_ps(r2), a2i = _mm_loadu_ps(i2);
+			__m128 a3r = _mm_loadu_ps(r3), a3i = _mm_loadu_ps(i3);
+			__m128 b0r = _mm_add_ps(a0r, a2r), b0i = _mm_add_ps(a0i, a2i);
+			__m128 b1r = _mm_add_ps(a1r, a3r), b1i = _mm_add_ps(a1i, a3i);
+			__m128 d2r = _mm_sub_ps(a0r, a2r), d2i = _mm_sub_ps(a0i, a2i);
+			__m128 d3r = _mm_sub_ps(a1r, a3r), d3i = _mm_sub_ps(a1i, a3i);
+			__m128 b2r = _mm_sub_ps(_mm_mul_ps(d2r, t1r), _mm_mul_ps(d2i, t1i)), b2i = _mm_add_ps(_mm_mul_ps(d2r, t1i), _mm_mul_ps(d2i, t1r));
+			__m128 b3r = _mm_sub_ps(_mm_mul_ps(d3r, t3r), _mm_mul_ps(d3i, t3i)), b3i = _mm_add_ps(_mm_mul_ps(d3r, t3i), _mm_mul_ps(d3i, t3r));
+			__m128 e1r = _mm_sub_ps(b0r, b1r), e1i = _mm_sub_ps(b0i, b1i);
+			__m128 e3r = _mm_sub_ps(b2r, b3r), e3i = _mm_sub_ps(b2i, b3i);
+			_mm_storeu_ps(r0, _mm_add_ps(b0r, b1r));
+			_mm_storeu_ps(i0, _mm_add_ps(b0i, b1i));
+			_mm_storeu_ps(r1, _mm_sub_ps(_mm_mul_ps(e1r, t2r), _mm_mul_ps(e1i, t2i)));
+			_mm_storeu_ps(i1, _mm_add_ps(_mm_mul_ps(e1r, t2i), _mm_mul_ps(e1i, t2r)));
+			_mm_storeu_ps(r2, _mm_add_ps(b2r, b3r));
+			_mm_storeu_ps(i2, _mm_add_ps(b2i, b3i));
+			_mm_storeu_ps(r3, _mm_sub_ps(_mm_mul_ps(e3r, t2r), _mm_mul_ps(e3i, t2i)));
+			_mm_storeu_ps(i3, _mm_add_ps(_mm_mul_ps(e3r, t2i), _mm_mul_ps(e3i, t2r)));
+		}
+	}
+}
+
+PKM_TARGET_AVX2
+static inline void pkmFFTStageAVX2(float *re, float *im,
+								   const float *twr, const float *twi,
+								   int n, int half)
+{
+	if (half < 8) {
+		pkmFFTStageSSE(re, im, twr, twi, n, half);
+		return;
+	}
+	twr += half;
+	twi += half;
+	for (int b = 0; b < n; b += 2*half)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + half, *i1 = i0 + half;
+		for (int j = 0; j < half; j += 8)
+		{
+			__m256 ar = _mm256_loadu_ps(r0 + j), ai = _mm256_loadu_ps(i0 + j);
+			__m256 br = _mm256_loadu_ps(r1 + j), bi = _mm256_loadu_ps(i1 + j);
+			__m256 wr = _mm256_loadu_ps(twr + j), wi = _mm256_loadu_ps(twi + j);
+			__m256 dr = _mm256_sub_ps(ar, br), di = _mm256_sub_ps(ai, bi);
+			_mm256_storeu_ps(r0 + j, _mm256_add_ps(ar, br));
+			_mm256_storeu_ps(i0 + j, _mm256_add_ps(ai, bi));
+			_mm256_storeu_ps(r1 + j, _mm256_fmsub_ps(dr, wr, _mm256_mul_ps(di, wi)));
+			_mm256_storeu_ps(i1 + j, _mm256_fmadd_ps(dr, wi, _mm256_mul_ps(di, wr)));
+		}
+	}
+}
+
+PKM_TARGET_AVX2
+static inline void pkmFFTStage4AVX2(float *re, float *im,
+								   const float *twr, const float *twi,
+								   int n, int quarter)
+{
+	int q = quarter;
+	if (q < 8) {
+		pkmFFTStage4SSE(re, im, twr, twi, n, q);
+		return;
+	}
+	const float *w1r = twr + 2*q, *w1i = twi + 2*q;
+	const float *w3r = w1r + q, *w3i = w1i + q;
+	const float *w2r = twr + q, *w2i = twi + q;
+	for (int b = 0; b < n; b += 4*q)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + q, *i1 = i0 + q;
+		float *r2 = r1 + q, *i2 = i1 + q;
+		float *r3 = r2 + q, *i3 = i2 + q;
+		for (int j = 0; j < q; j += 8)
+		{
+			__m256 a0r = _mm256_loadu_ps(r0 + j), a0i = _mm256_loadu_ps(i0 + j);
+			__m256 a1r = _mm256_loadu_ps(r1 + j), a1i = _mm256_loadu_ps(i1 + j);
+			__m256 a2r = _mm256_loadu_ps(r2 + j), a2i = _mm256_loadu_ps(i2 + j);
+			__m256 a3r = _mm256_loadu_ps(r3 + j), a3i = _mm256_loadu_ps(i3 + j);
+			__m256 t1r = _mm256_loadu_ps(w1r + j), t1i = _mm256_loadu_ps(w1i + j);
+			__m256 t3r = _mm256_loadu_ps(w3r + j), t3i = _mm256_loadu_ps(w3i + j);
+			__m256 t2r = _mm256_loadu_ps(w2r + j), t2i = _mm256_loadu_ps(w2i + j);
+			__m256 b0r = _mm256_add_ps(a0r, a2r), b0i = _mm256_add_ps(a0i, a2i);
+			__m256 b1r = _mm256_add_ps(a1r, a3r), b1i = _mm256_add_ps(a1i, a3i);
+			__m256 d2r = _mm256_sub_ps(a0r, a2r), d2i = _mm256_sub_ps(a0i, a2i);
+			__m256 d3r = _mm256_sub_ps(a1r, a3r), d3i = _mm256_sub_ps(a1i, a3i);
+			__m256 b2r = _mm256_fmsub_ps(d2r, t1r, _mm256_mul_ps(d2i, t1i)), b2i = _mm256_fmadd_ps(d2r, t1i, _mm256_mul_ps(d2i, t1r));
+			__m256 b3r = _mm256_fmsub_ps(d3r, t3r, _mm256_mul_ps(d3i, t3i)), b3i = _mm256_fmadd_ps(d3r, t3i, _mm256_mul_ps(d3i, t3r));
+			__m256 e1r = _mm256_sub_ps(b0r, b1r), e1i = _mm256_sub_ps(b0i, b1i);
+			__m256 e3r = _mm256_sub_ps(b2r, b3r), e3i = _mm256_sub_ps(b2i, b3i);
+			_mm256_storeu_ps(r0 + j, _mm256_add_ps(b0r, b1r));
+			_mm256_storeu_ps(i0 + j, _mm256_add_ps(b0i, b1i));
+			_mm256_storeu_ps(r1 + j, _mm256_fmsub_ps(e1r, t2r, _mm256_mul_ps(e1i, t2i)));
+			_mm256_storeu_ps(i1 + j, _mm256_fmadd_ps(e1r, t2i, _mm256_mul_ps(e1i, t2r)));
+			_mm256_storeu_ps(r2 + j, _mm256_add_ps(b2r, b3r));
+			_mm256_storeu_ps(i2 + j, _mm256_add_ps(b2i, b3i));
+			_mm256_storeu_ps(r3 + j, _mm256_fmsub_ps(e3r, t2r, _mm256_mul_ps(e3i, t2i)));
+			_mm256_storeu_ps(i3 + j, _mm256_fmadd_ps(e3r, t2i, _mm256_mul_ps(e3i, t2r)));
+		}
+	}
+}
+
+// radix-2 stage on 8 lane-interleaved frames, element j of frame l at j*8 + l
+PKM_TARGET_AVX2
+static inline void pkmFFTStageLanesAVX2(float *re, float *im,
+									  const float *twr, const float *twi,
+									  int n, int half)
+{
+	twr += half;
+	twi += half;
+	for (int j = 0; j < half; j++)
+	{
+		__m256 wr = _mm256_set1_ps(twr[j]), wi = _mm256_set1_ps(twi[j]);
+		for (int b = j; b < n; b += 2*half)
+		{
+			float *r0 = re + b*8, *i0 = im + b*8;
+			float *r1 = r0 + half*8, *i1 = i0 + half*8;
+			__m256 ar = _mm256_loadu_ps(r0), ai = _mm256_loadu_ps(i0);
+			__m256 br = _mm256_loadu_ps(r1), bi = _mm256_loadu_ps(i1);
+			__m256 dr = _mm256_sub_ps(ar, br), di = _mm256_sub_ps(ai, bi);
+			_mm256_storeu_ps(r0, _mm256_add_ps(ar, br));
+			_mm256_storeu_ps(i0, _mm256_add_ps(ai, bi));
+			_mm256_storeu_ps(r1, _mm256_fmsub_ps(dr, wr, _mm256_mul_ps(di, wi)));
+			_mm256_storeu_ps(i1, _mm256_fmadd_ps(dr, wi, _mm256_mul_ps(di, wr)));
+		}
+	}
+}
+
+PKM_TARGET_AVX2
+static inline void pkmFFTStage4LanesAVX2(float *re, float *im,
+									   const float *twr, const float *twi,
+									   int n, int quarter)
+{
+	int q = quarter;
+	for (int j = 0; j < q; j++)
+	{
+		__m256 t1r = _mm256_set1_ps(twr[2*q + j]), t1i = _mm256_set1_ps(twi[2*q + j]);
+		__m256 t3r = _mm256_set1_ps(twr[3*q + j]), t3i = _mm256_set1_ps(twi[3*q + j]);
+		__m256 t2r = _mm256_set1_ps(twr[q + j]), t2i = _mm256_set1_ps(twi[q + j]);
+		for (int b = j; b < n; b += 4*q)
+		{
+			float *r0 = re + b*8, *i0 = im + b*8;
+			float *r1 = r0 + q*8, *i1 = i0 + q*8;
+			float *r2 = r1 + q*8, *i2 = i1 + q*8;
+			float *r3 = r2 + q*8, *i3 = i2 + q*8;
+			__m256 a0r = _mm256_loadu_ps(r0), a0i = _mm256_loadu_ps(i0);
+			__m256 a1r = _mm256_loadu_ps(r1), a1i = _mm256_loadu_ps(i1);
+			__m256 a2r = _mm256_loadu_ps(r2), a2i = _mm256_loadu_ps(i2);
+			__m256 a3r = _mm256_loadu_ps(r3), a3i = _mm256_loadu_ps(i3);
+			__m256 b0r = _mm256_add_ps(a0r, a2r), b0i = _mm256_add_ps(a0i, a2i);
+			__m256 b1r = _mm256_add_ps(a1r, a3r), b1i = _mm256_add_ps(a1i, a3i);
+			__m256 d2r = _mm256_sub_ps(a0r, a2r), d2i = _mm256_sub_ps(a0i, a2i);
+			__m256 d3r = _mm256_sub_ps(a1r, a3r), d3i = _mm256_sub_ps(a1i, a3i);
+			__m256 b2r = _mm256_fmsub_ps(d2r, t1r, _mm256_mul_ps(d2i, t1i)), b2i = _mm256_fmadd_ps(d2r, t1i, _mm256_mul_ps(d2i, t1r));
+			__m256 b3r = _mm256_fmsub_ps(d3r, t3r, _mm256_mul_ps(d3i, t3i)), b3i = _mm256_fmadd_ps(d3r, t3i, _mm256_mul_ps(d3i, t3r));
+			__m256 e1r = _mm256_sub_ps(b0r, b1r), e1i = _mm256_sub_ps(b0i, b1i);
+			__m256 e3r = _mm256_sub_ps(b2r, b3r), e3i = _mm256_sub_ps(b2i, b3i);
+			_mm256_storeu_ps(r0, _mm256_add_ps(b0r, b1r));
+			_mm256_storeu_ps(i0, _mm256_add_ps(b0i, b1i));
+			_mm256_storeu_ps(r1, _mm256_fmsub_ps(e1r, t2r, _mm256_mul_ps(e1i, t2i)));
+			_mm256_storeu_ps(i1, _mm256_fmadd_ps(e1r, t2i, _mm256_mul_ps(e1i, t2r)));
+			_mm256_storeu_ps(r2, _mm256_add_ps(b2r, b3r));
+			_mm256_storeu_ps(i2, _mm256_add_ps(b2i, b3i));
+			_mm256_storeu_ps(r3, _mm256_fmsub_ps(e3r, t2r, _mm256_mul_ps(e3i, t2i)));
+			_mm256_storeu_ps(i3, _mm256_fmadd_ps(e3r, t2i, _mm256_mul_ps(e3i, t2r)));
+		}
+	}
+}
+
+#endif
+
+#if PKM_FFT_HAVE_NEON
+
+static inline void pkmFFTStageNEON(float *re, float *im,
+								   const float *twr, const float *twi,
+								   int n, int half)
+{
+	if (half < 4) {
+		pkmFFTStageScalar(re, im, twr, twi, n, half);
+		return;
+	}
+	twr += half;
+	twi += half;
+	for (int b = 0; b < n; b += 2*half)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + half, *i1 = i0 + half;
+		for (int j = 0; j < half; j += 4)
+		{
+			float32x4_t ar = vld1q_f32(r0 + j), ai = vld1q_f32(i0 + j);
+			float32x4_t br = vld1q_f32(r1 + j), bi = vld1q_f32(i1 + j);
+			float32x4_t wr = vld1q_f32(twr + j), wi = vld1q_f32(twi + j);
+			float32x4_t dr = vsubq_f32(ar, br), di = vsubq_f32(ai, bi);
+			vst1q_f32(r0 + j, vaddq_f32(ar, br));
+			vst1q_f32(i0 + j, vaddq_f32(ai, bi));
+			vst1q_f32(r1 + j, vmlsq_f32(vmulq_f32(dr, wr), di, wi));
+			vst1q_f32(i1 + j, vmlaq_f32(vmulq_f32(dr, wi), di, wr));
+		}
+	}
+}
+
+static inline void pkmFFTStage4NEON(float *re, float *im,
+								   const float *twr, const float *twi,
+								   int n, int quarter)
+{
+	int q = quarter;
+	if (q < 4) {
+		pkmFFTStage4Scalar(re, im, twr, twi, n, q);
+		return;
+	}
+	const float *w1r = twr + 2*q, *w1i = twi + 2*q;
+	const float *w3r = w1r + q, *w3i = w1i + q;
+	const float *w2r = twr + q, *w2i = twi + q;
+	for (int b = 0; b < n; b += 4*q)
+	{
+		float *r0 = re + b, *i0 = im + b;
+		float *r1 = r0 + q, *i1 = i0 + q;
+		float *r2 = r1 + q, *i2 = i1 + q;
+		float *r3 = r2 + q, *i3 = i2 + q;
+		for (int j = 0; j < q; j += 4)
+		{
+			float32x4_t a0r = vld1q_f32(r0 + j), a0i = vld1q_f32(i0 + j);
+			float32x4_t a1r = vld1q_f32(r1 + j), a1i = vld1q_f32(i1 + j);
+			float32x4_t a2r = vld1q_f32(r2 + j), a2i = vld1q_f32(i2 + j);
+			float32x4_t a3r = vld1q_f32(r3 + j), a3i = vld1q_f32(i3 + j);
+			float32x4_t t1r = vld1q_f32(w1r + j), t1i = vld1q_f32(w1i + j);
+			float32x4_t t3r = vld1q_f32(w3r + j), t3i = vld1q_f32(w3i + j);
+			float32x4_t t2r = vld1q_f32(w2r + j), t2i = vld1q_f32(w2i + j);
+			float32x4_t b0r = vaddq_f32(a0r, a2r), b0i = vaddq_f32(a0i, a2i);
+			float32x4_t b1r = vaddq_f32(a1r, a3r), b1i = vaddq_f32(a1i, a3i);
+			float32x4_t d2r = vsubq_f32(a0r, a2r), d2i = vsubq_f32(a0i, a2i);
+			float32x4_t d3r = vsubq_f32(a1r, a3r), d3i = vsubq_f32(a1i, a3i);
+			float32x4_t b2r = vmlsq_f32(vmulq_f32(d2r, t1r), d2i, t1i), b2i = vmlaq_f32(vmulq_f32(d2r, t1i), d2i, t1r);
+			float32x4_t b3r = vmlsq_f32(vmulq_f32(d3r, t3r), d3i, t3i), b3i = vmlaq_f32(vmulq_f32(d3r, t3i), d3i, t3r);
+			float32x4_t e1r = vsubq_f32(b0r, b1r), e1i = vsubq_f32(b0i, b1i);
+			float32x4_t e3r = vsubq_f32(b2r, b3r), e3i = vsubq_f32(b2i, b3i);
+			vst1q_f32(r0 + j, vaddq_f32(b0r, b1r));
+			vst1q_f32(i0 + j, vaddq_f32(b0i, b1i));
+			vst1q_f32(r1 + j, vmlsq_f32(vmulq_f32(e1r, t2r), e1i, t2i));
+			vst1q_f32(i1 + j, vmlaq_f32(vmulq_f32(e1r, t2i), e1i, t2r));
+			vst1q_f32(r2 + j, vaddq_f32(b2r, b3r));
+			vst1q_f32(i2 + j, vaddq_f32(b2i, b3i));
+			vst1q_f32(r3 + j, vmlsq_f32(vmulq_f32(e3r, t2r), e3i, t2i));
+			vst1q_f32(i3 + j, vmlaq_f32(vmulq_f32(e3r, t2i), e3i, t2r));
+		}
+	}
+}
+
+// radix-2 stage on 4 lane-interleaved frames, element j of frame l at j*4 + l
+static inline void pkmFFTStageLanesNEON(float *re, float *im,
+									  const float *twr, const float *twi,
+									  int n, int half)
+{
+	twr += half;
+	twi += half;
+	for (int j = 0; j < half; j++)
+	{
+		float32x4_t wr = vdupq_n_f32(twr[j]), wi = vdupq_n_f32(twi[j]);
+		for (int b = j; b < n; b += 2*half)
+		{
+			float *r0 = re + b*4, *i0 = im + b*4;
+			float *r1 = r0 + half*4, *i1 = i0 + half*4;
+			float32x4_t ar = vld1q_f32(r0), ai = vld1q_f32(i0);
+			float32x4_t br = vld1q_f32(r1), bi = vld1q_f32(i1);
+			float32x4_t dr = vsubq_f32(ar, br), di = vsubq_f32(ai, bi);
+			vst1q_f32(r0, vaddq_f32(ar, br));
+			vst1q_f32(i0, vaddq_f32(ai, bi));
+			vst1q_f32(r1, vmlsq_f32(vmulq_f32(dr, wr), di, wi));
+			vst1q_f32(i1, vmlaq_f32(vmulq_f32(dr, wi), di, wr));
+		}
+	}
+}
+
+static inline void pkmFFTStage4LanesNEON(float *re, float *im,
+									   const float *twr, const float *twi,
+									   int n, int quarter)
+{
+	int q = quarter;
+	for (int j = 0; j < q; j++)
+	{
+		float32x4_t t1r = vdupq_n_f32(twr[2*q + j]), t1i = vdupq_n_f32(twi[2*q + j]);
+		float32x4_t t3r = vdupq_n_f32(twr[3*q + j]), t3i = vdupq_n_f32(twi[3*q + j]);
+		float32x4_t t2r = vdupq_n_f32(twr[q + j]), t2i = vdupq_n_f32(twi[q + j]);
+		for (int b = j; b < n; b += 4*q)
+		{
+			float *r0 = re + b*4, *i0 = im + b*4;
+			float *r1 = r0 + q*4, *i1 = i0 + q*4;
+			float *r2 = r1 + q*4, *i2 = i1 + q*4;
+			float *r3 = r2 + q*4, *i3 = i2 + q*4;
+			float32x4_t a0r = vld1q_f32(r0), a0i = vld1q_f32(i0);
+			float32x4_t a1r = vld1q_f32(r1), a1i = vld1q_f32(i1);
+			float32x4_t a2r = vld1q_f32(r2), a2i = vld1q_f32(i2);
+			float32x4_t a3r = vld1q_f32(r3), a3i = vld1q_f32(i3);
+			float32x4_t b0r = vaddq_f32(a0r, a2r), b0i = vaddq_f32(a0i, a2i);
+			float32x4_t b1r = vaddq_f32(a1r, a3r), b1i = vaddq_f32(a1i, a3i);
+			float32x4_t d2r = vsubq_f32(a0r, a2r), d2i = vsubq_f32(a0i, a2i);
+			float32x4_t d3r = vsubq_f32(a1r, a3r), d3i = vsubq_f32(a1i, a3i);
+			float32x4_t b2r = vmlsq_f32(vmulq_f32(d2r, t1r), d2i, t1i), b2i = vmlaq_f32(vmulq_f32(d2r, t1i), d2i, t1r);
+			float32x4_t b3r = vmlsq_f32(vmulq_f32(d3r, t3r), d3i, t3i), b3i = vmlaq_f32(vmulq_f32(d3r, t3i), d3i, t3r);
+			float32x4_t e1r = vsubq_f32(b0r, b1r), e1i = vsubq_f32(b0i, b1i);
+			float32x4_t e3r = vsubq_f32(b2r, b3r), e3i = vsubq_f32(b2i, b3i);
+			vst1q_f32(r0, vaddq_f32(b0r, b1r));
+			vst1q_f32(i0, vaddq_f32(b0i, b1i));
+			vst1q_f32(r1, vmlsq_f32(vmulq_f32(e1r, t2r), e1i, t2i));
+			vst1q_f32(i1, vmlaq_f32(vmulq_f32(e1r, t2i), e1i, t2r));
+			vst1q_f32(r2, vaddq_f32(b2r, b3r));
+			vst1q_f32(i2, vaddq_f32(b2i, b3i));
+			vst1q_f32(r3, vmlsq_f32(vmulq_f32(e3r, t2r), e3i, t2i));
+			vst1q_f32(i3, vmlaq_f32(vmulq_f32(e3r, t2i), e3i, t2r));
+		}
+	}
+}
+
+#endif
+
+// the stage kernel for an instruction set (falls back to scalar if the
+// instruction set was not compiled in)
+static inline pkmFFTStageFn pkmFFTGetStageKernel(pkmFFTISA isa)
+{
+	switch (isa) {
+#if PKM_FFT_HAVE_X86
+		case PKM_FFT_ISA_SSE:		return pkmFFTStageSSE;
+		case PKM_FFT_ISA_AVX2:		return pkmFFTStageAVX2;
+#endif
+#if PKM_FFT_HAVE_NEON
+		case PKM_FFT_ISA_NEON:		return pkmFFTStageNEON;
+#endif
+		default:					return pkmFFTStageScalar;
+	}
+}
+
+static inline pkmFFTStage4Fn pkmFFTGetStage4Kernel(pkmFFTISA isa)
+{
+	switch (isa) {
+#if PKM_FFT_HAVE_X86
+		case PKM_FFT_ISA_SSE:		return pkmFFTStage4SSE;
+		case PKM_FFT_ISA_AVX2:		return pkmFFTStage4AVX2;
+#endif
+#if PKM_FFT_HAVE_NEON
+		case PKM_FFT_ISA_NEON:		return pkmFFTStage4NEON;
+#endif
+		default:					return pkmFFTStage4Scalar;
+	}
+}
+
+// number of frames the lane kernels transform side by side; one frame per
+// lane, so the scalar kernels double as the single-lane versions
+static inline int pkmFFTGetLanes(pkmFFTISA isa)
+{
+	switch (isa) {
+#if PKM_FFT_HAVE_X86
+		case PKM_FFT_ISA_SSE:		return 4;
+		case PKM_FFT_ISA_AVX2:		return 8;
+#endif
+#if PKM_FFT_HAVE_NEON
+		case PKM_FFT_ISA_NEON:		return 4;
+#endif
+		default:					return 1;
+	}
+}
+
+static inline pkmFFTStageFn pkmFFTGetStageLanesKernel(pkmFFTISA isa)
+{
+	switch (isa) {
+#if PKM_FFT_HAVE_X86
+		case PKM_FFT_ISA_SSE:		return pkmFFTStageLanesSSE;
+		case PKM_FFT_ISA_AVX2:		return pkmFFTStageLanesAVX2;
+#endif
+#if PKM_FFT_HAVE_NEON
+		case PKM_FFT_ISA_NEON:		return pkmFFTStageLanesNEON;
+#endif
+		default:					return pkmFFTStageScalar;
+	}
+}
+
+static inline pkmFFTStage4Fn pkmFFTGetStage4LanesKernel(pkmFFTISA isa)
+{
+	switch (isa) {
+#if PKM_FFT_HAVE_X86
+		case PKM_FFT_ISA_SSE:		return pkmFFTStage4LanesSSE;
+		case PKM_FFT_ISA_AVX2:		return pkmFFTStage4LanesAVX2;
+#endif
+#if PKM_FFT_HAVE_NEON
+		case PKM_FFT_ISA_NEON:		return pkmFFTStage4LanesNEON;
+#endif
+		default:					return pkmFFTStage4Scalar;
+	}
+}
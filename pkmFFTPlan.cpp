@@ -0,0 +1,6 @@
+/*
+ *  pkmFFTPlan.cpp
+ *
+ */
+
+#include "pkmFFTPlan.h"
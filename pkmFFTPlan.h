@@ -0,0 +1,168 @@
+/*
+ *  pkmFFTPlan.h
+ *
+ *  Process-wide cache of FFT plans (backend twiddle tables and analysis
+ *  window) shared by every pkmFFT of the same size, backend and window, so
+ *  that many analyzers of one size build those tables only once.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  A plan is immutable once built: the backends keep no scratch of their
+ *  own (vDSP_fft_zrip and pkmRealFFT both work in place on the caller's
+ *  data) so one plan can be used from any number of threads at once.  Each
+ *  pkmFFT only owns its scratch buffers.
+ *
+ *  Usage:
+ *
+ *  pkmFFTPlan *plan = pkmFFTPlan::acquire(1024);	// built or shared
+ *  plan->backend->forward(&split_data);
+ *  vDSP_vmul(buffer, 1, plan->window, 1, windowed, 1, 1024);
+ *  pkmFFTPlan::release(plan);						// freed with the last user
+ *
+ */
+
+#pragma once
+
+#include "pkmDSP.h"
+#include "pkmFFTBackend.h"
+#include <map>
+#include <mutex>
+
+enum pkmFFTWindowType
+{
+	PKM_FFT_WINDOW_HANN,			// vDSP_HANN_NORM, what pkmFFT has always used
+	PKM_FFT_WINDOW_HAMMING,
+	PKM_FFT_WINDOW_BLACKMAN,
+	PKM_FFT_WINDOW_RECTANGULAR
+};
+
+class pkmFFTPlan
+{
+public:
+
+	// shared plan for this size, backend and window; build it on first use
+	static pkmFFTPlan * acquire(int size,
+								pkmFFTBackendType backend_type = PKM_FFT_BACKEND_DEFAULT,
+								pkmFFTWindowType window_type = PKM_FFT_WINDOW_HANN)
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+
+		Key key(size, ((int)backend_type << 8) | (int)window_type);
+		std::map<Key, pkmFFTPlan *> &plans = getPlans();
+		std::map<Key, pkmFFTPlan *>::iterator it = plans.find(key);
+		if (it != plans.end()) {
+			it->second->refCount++;
+			return it->second;
+		}
+
+		pkmFFTPlan *plan = new pkmFFTPlan(size, backend_type, window_type);
+		plan->key = key;
+		plans[key] = plan;
+		return plan;
+	}
+
+	// drop one reference, the last one frees the tables
+	static void release(pkmFFTPlan *plan)
+	{
+		if (plan == NULL) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(getMutex());
+		if (--plan->refCount == 0) {
+			getPlans().erase(plan->key);
+			delete plan;
+		}
+	}
+
+	// number of distinct plans alive, e.g. to check that instances share
+	static int getNumPlans()
+	{
+		std::lock_guard<std::mutex> lock(getMutex());
+		return (int)getPlans().size();
+	}
+
+	pkmFFTBackend		*backend;
+	float				*window;
+
+	int					fftSize;
+	pkmFFTWindowType	windowType;
+
+private:
+
+	typedef std::pair<int, int> Key;
+
+	pkmFFTPlan(int size, pkmFFTBackendType backend_type, pkmFFTWindowType window_type)
+	{
+		fftSize = size;
+		windowType = window_type;
+		refCount = 1;
+
+		backend = pkmFFTBackend::create(fftSize, backend_type);
+
+		window = (float *)malloc(sizeof(float) * fftSize);
+		switch (windowType)
+		{
+			case PKM_FFT_WINDOW_HAMMING:
+				vDSP_hamm_window(window, fftSize, 0);
+				break;
+			case PKM_FFT_WINDOW_BLACKMAN:
+				vDSP_blkman_window(window, fftSize, 0);
+				break;
+			case PKM_FFT_WINDOW_RECTANGULAR:
+				for (int i = 0; i < fftSize; i++)
+					window[i] = 1.0f;
+				break;
+			case PKM_FFT_WINDOW_HANN:
+			default:
+				vDSP_hann_window(window, fftSize, vDSP_HANN_NORM);
+				break;
+		}
+	}
+
+	~pkmFFTPlan()
+	{
+		delete backend;
+		free(window);
+	}
+
+	// function statics so the cache is shared by every translation unit
+	static std::mutex & getMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static std::map<Key, pkmFFTPlan *> & getPlans()
+	{
+		static std::map<Key, pkmFFTPlan *> plans;
+		return plans;
+	}
+
+	Key					key;
+	int					refCount;
+};
@@ -0,0 +1,6 @@
+/*
+ *  pkmFastMath.cpp
+ *
+ */
+
+#include "pkmFastMath.h"
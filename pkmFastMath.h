@@ -0,0 +1,390 @@
+/*
+ *  pkmFastMath.h
+ *
+ *  Vectorized single precision log, log10, exp, atan2 and sincos over
+ *  arrays, for the non-Apple vDSP/vForce shims in pkmDSP.h (Apple builds
+ *  get the same routines from Accelerate).  Cephes style range reduction
+ *  and minimax polynomials, 4 floats at a time with SSE2 or AArch64 NEON.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Maximum error against the correctly rounded result, measured over
+ *  2^24 points spread over each range (without FMA contraction):
+ *
+ *  pkmFastLog		1 ulp		x in [FLT_MIN, FLT_MAX]
+ *  pkmFastLog10	2 ulp		x in [FLT_MIN, FLT_MAX]
+ *  pkmFastExp		1 ulp		x in [-87, 88]
+ *  pkmFastAtan2	3 ulp		finite y, x
+ *  pkmFastSinCos	2 ulp		|x| <= 4, absolute error < 8e-8 up to |x| <= 8192
+ *
+ *  Special values: log of 0 is -inf, of a negative or nan is nan, of +inf
+ *  is +inf, and subnormals are treated as FLT_MIN.  exp clamps to
+ *  [-88.38, 88.38].  atan2(0, 0) is 0 and the sign of zero is not looked
+ *  at, so atan2(-0, -1) is +pi.
+ *
+ *  Define PKM_EXACT_MATH (or build for something other than SSE2/NEON) to
+ *  get the libm functions instead, element by element.
+ *
+ *  Usage:
+ *
+ *  pkmFastLog10(band_energies, log_energies, n);	// in place is fine
+ *  pkmFastAtan2(imagp, realp, phases, n);
+ *  pkmFastSinCos(phases, sines, cosines, n);
+ *
+ */
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+#if !defined(PKM_EXACT_MATH) && (defined(__SSE2__) || defined(__x86_64__) || defined(_M_X64))
+#include <emmintrin.h>
+#define PKM_FAST_MATH_SSE 1
+#elif !defined(PKM_EXACT_MATH) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PKM_FAST_MATH_NEON 1
+#endif
+
+#if defined(PKM_FAST_MATH_SSE) || defined(PKM_FAST_MATH_NEON)
+
+// 4 lane float (V), int (VI) and mask (VM) operations, so every function
+// below is written once for both instruction sets
+#if defined(PKM_FAST_MATH_SSE)
+
+typedef __m128		pkmV;
+typedef __m128i		pkmVI;
+typedef __m128		pkmVM;
+
+static inline pkmV	pkmVSet(float a)					{ return _mm_set1_ps(a); }
+static inline pkmV	pkmVLoad(const float *p)			{ return _mm_loadu_ps(p); }
+static inline void	pkmVStore(float *p, pkmV a)			{ _mm_storeu_ps(p, a); }
+static inline pkmV	pkmVAdd(pkmV a, pkmV b)				{ return _mm_add_ps(a, b); }
+static inline pkmV	pkmVSub(pkmV a, pkmV b)				{ return _mm_sub_ps(a, b); }
+static inline pkmV	pkmVMul(pkmV a, pkmV b)				{ return _mm_mul_ps(a, b); }
+static inline pkmV	pkmVDiv(pkmV a, pkmV b)				{ return _mm_div_ps(a, b); }
+static inline pkmV	pkmVMin(pkmV a, pkmV b)				{ return _mm_min_ps(a, b); }
+static inline pkmV	pkmVMax(pkmV a, pkmV b)				{ return _mm_max_ps(a, b); }
+static inline pkmV	pkmVXor(pkmV a, pkmV b)				{ return _mm_xor_ps(a, b); }
+static inline pkmV	pkmVAnd(pkmV a, pkmV b)				{ return _mm_and_ps(a, b); }
+static inline pkmVM	pkmVLt(pkmV a, pkmV b)				{ return _mm_cmplt_ps(a, b); }
+static inline pkmVM	pkmVGt(pkmV a, pkmV b)				{ return _mm_cmpgt_ps(a, b); }
+static inline pkmVM	pkmVEq(pkmV a, pkmV b)				{ return _mm_cmpeq_ps(a, b); }
+static inline pkmVM	pkmVMOr(pkmVM a, pkmVM b)			{ return _mm_or_ps(a, b); }
+static inline pkmVM	pkmVMAnd(pkmVM a, pkmVM b)			{ return _mm_and_ps(a, b); }
+static inline pkmV	pkmVSel(pkmVM m, pkmV a, pkmV b)	{ return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline pkmV	pkmVSignBit(pkmV a)					{ return _mm_and_ps(a, _mm_set1_ps(-0.0f)); }
+static inline pkmV	pkmVAbs(pkmV a)						{ return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline pkmVI	pkmVToInt(pkmV a)					{ return _mm_cvttps_epi32(a); }
+static inline pkmV	pkmVFromInt(pkmVI a)				{ return _mm_cvtepi32_ps(a); }
+static inline pkmVI	pkmVAsInt(pkmV a)					{ return _mm_castps_si128(a); }
+static inline pkmV	pkmVIAsFloat(pkmVI a)				{ return _mm_castsi128_ps(a); }
+static inline pkmVI	pkmVISet(int a)						{ return _mm_set1_epi32(a); }
+static inline pkmVI	pkmVIAdd(pkmVI a, pkmVI b)			{ return _mm_add_epi32(a, b); }
+static inline pkmVI	pkmVISub(pkmVI a, pkmVI b)			{ return _mm_sub_epi32(a, b); }
+static inline pkmVI	pkmVIAnd(pkmVI a, pkmVI b)			{ return _mm_and_si128(a, b); }
+static inline pkmVI	pkmVIAndNot(pkmVI a, pkmVI b)		{ return _mm_andnot_si128(a, b); }	// ~a & b
+static inline pkmVI	pkmVIShl23(pkmVI a)					{ return _mm_slli_epi32(a, 23); }
+static inline pkmVI	pkmVIShl29(pkmVI a)					{ return _mm_slli_epi32(a, 29); }
+static inline pkmVI	pkmVIShr23(pkmVI a)					{ return _mm_srli_epi32(a, 23); }
+static inline pkmVM	pkmVIEq(pkmVI a, pkmVI b)			{ return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+
+#else
+
+typedef float32x4_t	pkmV;
+typedef int32x4_t	pkmVI;
+typedef uint32x4_t	pkmVM;
+
+static inline pkmV	pkmVSet(float a)					{ return vdupq_n_f32(a); }
+static inline pkmV	pkmVLoad(const float *p)			{ return vld1q_f32(p); }
+static inline void	pkmVStore(float *p, pkmV a)			{ vst1q_f32(p, a); }
+static inline pkmV	pkmVAdd(pkmV a, pkmV b)				{ return vaddq_f32(a, b); }
+static inline pkmV	pkmVSub(pkmV a, pkmV b)				{ return vsubq_f32(a, b); }
+static inline pkmV	pkmVMul(pkmV a, pkmV b)				{ return vmulq_f32(a, b); }
+static inline pkmV	pkmVDiv(pkmV a, pkmV b)				{ return vdivq_f32(a, b); }
+static inline pkmV	pkmVMin(pkmV a, pkmV b)				{ return vminq_f32(a, b); }
+static inline pkmV	pkmVMax(pkmV a, pkmV b)				{ return vmaxq_f32(a, b); }
+static inline pkmV	pkmVXor(pkmV a, pkmV b)				{ return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static inline pkmV	pkmVAnd(pkmV a, pkmV b)				{ return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static inline pkmVM	pkmVLt(pkmV a, pkmV b)				{ return vcltq_f32(a, b); }
+static inline pkmVM	pkmVGt(pkmV a, pkmV b)				{ return vcgtq_f32(a, b); }
+static inline pkmVM	pkmVEq(pkmV a, pkmV b)				{ return vceqq_f32(a, b); }
+static inline pkmVM	pkmVMOr(pkmVM a, pkmVM b)			{ return vorrq_u32(a, b); }
+static inline pkmVM	pkmVMAnd(pkmVM a, pkmVM b)			{ return vandq_u32(a, b); }
+static inline pkmV	pkmVSel(pkmVM m, pkmV a, pkmV b)	{ return vbslq_f32(m, a, b); }
+static inline pkmV	pkmVSignBit(pkmV a)					{ return pkmVAnd(a, vdupq_n_f32(-0.0f)); }
+static inline pkmV	pkmVAbs(pkmV a)						{ return vabsq_f32(a); }
+static inline pkmVI	pkmVToInt(pkmV a)					{ return vcvtq_s32_f32(a); }
+static inline pkmV	pkmVFromInt(pkmVI a)				{ return vcvtq_f32_s32(a); }
+static inline pkmVI	pkmVAsInt(pkmV a)					{ return vreinterpretq_s32_f32(a); }
+static inline pkmV	pkmVIAsFloat(pkmVI a)				{ return vreinterpretq_f32_s32(a); }
+static inline pkmVI	pkmVISet(int a)						{ return vdupq_n_s32(a); }
+static inline pkmVI	pkmVIAdd(pkmVI a, pkmVI b)			{ return vaddq_s32(a, b); }
+static inline pkmVI	pkmVISub(pkmVI a, pkmVI b)			{ return vsubq_s32(a, b); }
+static inline pkmVI	pkmVIAnd(pkmVI a, pkmVI b)			{ return vandq_s32(a, b); }
+static inline pkmVI	pkmVIAndNot(pkmVI a, pkmVI b)		{ return vbicq_s32(b, a); }			// ~a & b
+static inline pkmVI	pkmVIShl23(pkmVI a)					{ return vshlq_n_s32(a, 23); }
+static inline pkmVI	pkmVIShl29(pkmVI a)					{ return vshlq_n_s32(a, 29); }
+static inline pkmVI	pkmVIShr23(pkmVI a)					{ return vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), 23)); }
+static inline pkmVM	pkmVIEq(pkmVI a, pkmVI b)			{ return vceqq_s32(a, b); }
+
+#endif
+
+// natural log: x = m * 2^e with m in [sqrt(1/2), sqrt(2)), log(m) by a
+// degree 9 polynomial in m - 1, ln 2 split in two for the exponent
+static inline pkmV pkmVLog(pkmV x)
+{
+	pkmVM isZero = pkmVEq(x, pkmVSet(0.0f));
+	pkmVM isNegative = pkmVLt(x, pkmVSet(0.0f));
+	pkmVM isNumber = pkmVEq(x, x);							// false for nan
+	pkmVM isInf = pkmVEq(x, pkmVSet(INFINITY));
+
+	pkmV v = pkmVMax(x, pkmVSet(1.17549435e-38f));			// FLT_MIN
+	pkmVI bits = pkmVAsInt(v);
+	pkmV e = pkmVFromInt(pkmVISub(pkmVIShr23(bits), pkmVISet(126)));
+	// mantissa in [0.5, 1)
+	pkmV m = pkmVIAsFloat(pkmVIAdd(pkmVIAnd(bits, pkmVISet(0x007fffff)), pkmVISet(0x3f000000)));
+
+	pkmVM small = pkmVLt(m, pkmVSet(0.707106781186547524f));
+	e = pkmVSub(e, pkmVSel(small, pkmVSet(1.0f), pkmVSet(0.0f)));
+	m = pkmVSub(pkmVAdd(m, pkmVSel(small, m, pkmVSet(0.0f))), pkmVSet(1.0f));
+
+	pkmV z = pkmVMul(m, m);
+	pkmV y = pkmVSet(7.0376836292e-2f);
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(-1.1514610310e-1f));
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(1.1676998740e-1f));
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(-1.2420140846e-1f));
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(1.4249322787e-1f));
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(-1.6668057665e-1f));
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(2.0000714765e-1f));
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(-2.4999993993e-1f));
+	y = pkmVAdd(pkmVMul(y, m), pkmVSet(3.3333331174e-1f));
+	y = pkmVMul(pkmVMul(y, m), z);
+
+	y = pkmVAdd(y, pkmVMul(e, pkmVSet(-2.12194440e-4f)));
+	y = pkmVSub(y, pkmVMul(z, pkmVSet(0.5f)));
+	pkmV r = pkmVAdd(m, y);
+	r = pkmVAdd(r, pkmVMul(e, pkmVSet(0.693359375f)));
+
+	r = pkmVSel(isInf, pkmVSet(INFINITY), r);
+	r = pkmVSel(isZero, pkmVSet(-INFINITY), r);
+	r = pkmVSel(isNumber, r, pkmVSet(NAN));
+	return pkmVSel(isNegative, pkmVSet(NAN), r);
+}
+
+// e^x: x = n ln2 + r with ln 2 in two parts, e^r by a degree 6 polynomial
+static inline pkmV pkmVExp(pkmV x)
+{
+	x = pkmVMin(x, pkmVSet(88.3762626647949f));
+	x = pkmVMax(x, pkmVSet(-88.3762626647949f));
+
+	// n = floor(x / ln 2 + 1/2)
+	pkmV fx = pkmVAdd(pkmVMul(x, pkmVSet(1.44269504088896341f)), pkmVSet(0.5f));
+	pkmV n = pkmVFromInt(pkmVToInt(fx));
+	n = pkmVSub(n, pkmVSel(pkmVGt(n, fx), pkmVSet(1.0f), pkmVSet(0.0f)));
+
+	x = pkmVSub(x, pkmVMul(n, pkmVSet(0.693359375f)));
+	x = pkmVSub(x, pkmVMul(n, pkmVSet(-2.12194440e-4f)));
+
+	pkmV z = pkmVMul(x, x);
+	pkmV y = pkmVSet(1.9875691500e-4f);
+	y = pkmVAdd(pkmVMul(y, x), pkmVSet(1.3981999507e-3f));
+	y = pkmVAdd(pkmVMul(y, x), pkmVSet(8.3334519073e-3f));
+	y = pkmVAdd(pkmVMul(y, x), pkmVSet(4.1665795894e-2f));
+	y = pkmVAdd(pkmVMul(y, x), pkmVSet(1.6666665459e-1f));
+	y = pkmVAdd(pkmVMul(y, x), pkmVSet(5.0000001201e-1f));
+	y = pkmVAdd(pkmVAdd(pkmVMul(y, z), x), pkmVSet(1.0f));
+
+	// 2^n straight into the exponent bits
+	pkmV scale = pkmVIAsFloat(pkmVIShl23(pkmVIAdd(pkmVToInt(n), pkmVISet(127))));
+	return pkmVMul(y, scale);
+}
+
+// sin and cos together: reduce by multiples of pi/4 (pi/4 in three parts)
+// and pick the sine or cosine polynomial per octant
+static inline void pkmVSinCos(pkmV x, pkmV *s, pkmV *c)
+{
+	pkmV signSin = pkmVSignBit(x);
+	x = pkmVAbs(x);
+
+	// j = octant rounded up to even
+	pkmVI j = pkmVToInt(pkmVMul(x, pkmVSet(1.27323954473516f)));
+	j = pkmVIAnd(pkmVIAdd(j, pkmVISet(1)), pkmVISet(~1));
+	pkmV y = pkmVFromInt(j);
+
+	pkmV swapSin = pkmVIAsFloat(pkmVIShl29(pkmVIAnd(j, pkmVISet(4))));
+	pkmVM usePolySin = pkmVIEq(pkmVIAnd(j, pkmVISet(2)), pkmVISet(0));
+	pkmV signCos = pkmVIAsFloat(pkmVIShl29(pkmVIAndNot(pkmVISub(j, pkmVISet(2)), pkmVISet(4))));
+	signSin = pkmVXor(signSin, swapSin);
+
+	x = pkmVAdd(x, pkmVMul(y, pkmVSet(-0.78515625f)));
+	x = pkmVAdd(x, pkmVMul(y, pkmVSet(-2.4187564849853515625e-4f)));
+	x = pkmVAdd(x, pkmVMul(y, pkmVSet(-3.77489497744594108e-8f)));
+
+	pkmV z = pkmVMul(x, x);
+
+	pkmV yc = pkmVSet(2.443315711809948e-5f);
+	yc = pkmVAdd(pkmVMul(yc, z), pkmVSet(-1.388731625493765e-3f));
+	yc = pkmVAdd(pkmVMul(yc, z), pkmVSet(4.166664568298827e-2f));
+	yc = pkmVMul(pkmVMul(yc, z), z);
+	yc = pkmVSub(yc, pkmVMul(z, pkmVSet(0.5f)));
+	yc = pkmVAdd(yc, pkmVSet(1.0f));
+
+	pkmV ys = pkmVSet(-1.9515295891e-4f);
+	ys = pkmVAdd(pkmVMul(ys, z), pkmVSet(8.3321608736e-3f));
+	ys = pkmVAdd(pkmVMul(ys, z), pkmVSet(-1.6666654611e-1f));
+	ys = pkmVAdd(pkmVMul(pkmVMul(ys, z), x), x);
+
+	*s = pkmVXor(pkmVSel(usePolySin, ys, yc), signSin);
+	*c = pkmVXor(pkmVSel(usePolySin, yc, ys), signCos);
+}
+
+// atan(y / x) reduced to |t| <= tan(pi/8), then put in the right quadrant
+static inline pkmV pkmVAtan2(pkmV y, pkmV x)
+{
+	pkmV t = pkmVDiv(y, x);
+	pkmV sign = pkmVSignBit(t);
+	t = pkmVAbs(t);
+
+	pkmVM big = pkmVGt(t, pkmVSet(2.414213562373095f));
+	pkmVM mid = pkmVGt(t, pkmVSet(0.4142135623730950f));
+	pkmV offset = pkmVSel(big, pkmVSet(1.57079632679489661923f),
+						  pkmVSel(mid, pkmVSet(0.78539816339744830962f), pkmVSet(0.0f)));
+	pkmV reduced = pkmVSel(mid, pkmVDiv(pkmVSub(t, pkmVSet(1.0f)), pkmVAdd(t, pkmVSet(1.0f))), t);
+	t = pkmVSel(big, pkmVDiv(pkmVSet(-1.0f), t), reduced);
+
+	pkmV z = pkmVMul(t, t);
+	pkmV a = pkmVSet(8.05374449538e-2f);
+	a = pkmVAdd(pkmVMul(a, z), pkmVSet(-1.38776856032e-1f));
+	a = pkmVAdd(pkmVMul(a, z), pkmVSet(1.99777106478e-1f));
+	a = pkmVAdd(pkmVMul(a, z), pkmVSet(-3.33329491539e-1f));
+	a = pkmVAdd(pkmVAdd(pkmVMul(pkmVMul(a, z), t), t), offset);
+	a = pkmVXor(a, sign);
+
+	// left half plane, and 0 / 0
+	pkmV pi = pkmVXor(pkmVSet(3.14159265358979323846f), pkmVSignBit(y));
+	a = pkmVSel(pkmVLt(x, pkmVSet(0.0f)), pkmVAdd(a, pi), a);
+	pkmVM bothZero = pkmVMAnd(pkmVEq(x, pkmVSet(0.0f)), pkmVEq(y, pkmVSet(0.0f)));
+	return pkmVSel(bothZero, pkmVSet(0.0f), a);
+}
+
+#define PKM_FAST_MATH_MAP(name, fn)										\
+static inline void name(const float *x, float *y, int n)				\
+{																		\
+	int i = 0;															\
+	for (; i + 4 <= n; i += 4)											\
+		pkmVStore(y + i, fn(pkmVLoad(x + i)));							\
+	if (i < n) {														\
+		float in[4] = { 1, 1, 1, 1 }, out[4];							\
+		memcpy(in, x + i, sizeof(float) * (n - i));						\
+		pkmVStore(out, fn(pkmVLoad(in)));								\
+		memcpy(y + i, out, sizeof(float) * (n - i));					\
+	}																	\
+}
+
+static inline pkmV pkmVLog10(pkmV x)
+{
+	return pkmVMul(pkmVLog(x), pkmVSet(0.434294481903251827651f));
+}
+
+PKM_FAST_MATH_MAP(pkmFastLog, pkmVLog)
+PKM_FAST_MATH_MAP(pkmFastLog10, pkmVLog10)
+PKM_FAST_MATH_MAP(pkmFastExp, pkmVExp)
+
+#undef PKM_FAST_MATH_MAP
+
+static inline void pkmFastAtan2(const float *y, const float *x, float *out, int n)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		pkmVStore(out + i, pkmVAtan2(pkmVLoad(y + i), pkmVLoad(x + i)));
+	if (i < n) {
+		float yi[4] = { 0, 0, 0, 0 }, xi[4] = { 1, 1, 1, 1 }, o[4];
+		memcpy(yi, y + i, sizeof(float) * (n - i));
+		memcpy(xi, x + i, sizeof(float) * (n - i));
+		pkmVStore(o, pkmVAtan2(pkmVLoad(yi), pkmVLoad(xi)));
+		memcpy(out + i, o, sizeof(float) * (n - i));
+	}
+}
+
+static inline void pkmFastSinCos(const float *x, float *s, float *c, int n)
+{
+	int i = 0;
+	pkmV vs, vc;
+	for (; i + 4 <= n; i += 4) {
+		pkmVSinCos(pkmVLoad(x + i), &vs, &vc);
+		pkmVStore(s + i, vs);
+		pkmVStore(c + i, vc);
+	}
+	if (i < n) {
+		float xi[4] = { 0, 0, 0, 0 }, so[4], co[4];
+		memcpy(xi, x + i, sizeof(float) * (n - i));
+		pkmVSinCos(pkmVLoad(xi), &vs, &vc);
+		pkmVStore(so, vs);
+		pkmVStore(co, vc);
+		memcpy(s + i, so, sizeof(float) * (n - i));
+		memcpy(c + i, co, sizeof(float) * (n - i));
+	}
+}
+
+#else
+
+// exact fallback, element by element through libm
+
+static inline void pkmFastLog(const float *x, float *y, int n)
+{
+	for (int i = 0; i < n; i++)
+		y[i] = logf(x[i]);
+}
+
+static inline void pkmFastLog10(const float *x, float *y, int n)
+{
+	for (int i = 0; i < n; i++)
+		y[i] = log10f(x[i]);
+}
+
+static inline void pkmFastExp(const float *x, float *y, int n)
+{
+	for (int i = 0; i < n; i++)
+		y[i] = expf(x[i]);
+}
+
+static inline void pkmFastAtan2(const float *y, const float *x, float *out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = atan2f(y[i], x[i]);
+}
+
+static inline void pkmFastSinCos(const float *x, float *s, float *c, int n)
+{
+	for (int i = 0; i < n; i++) {
+		s[i] = sinf(x[i]);
+		c[i] = cosf(x[i]);
+	}
+}
+
+#endif
@@ -0,0 +1,6 @@
+/*
+ *  pkmFeatureStore.cpp
+ *
+ */
+
+#include "pkmFeatureStore.h"
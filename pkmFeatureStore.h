@@ -0,0 +1,303 @@
+/*
+ *  pkmFeatureStore.h
+ *
+ *  One growable, 64 byte aligned block of feature frames: rows of
+ *  getNumFeatures() values, stored row major (PKM_FEATURE_ROWS, what the
+ *  analyzer writes and the kd-tree reads in place) or column major
+ *  (PKM_FEATURE_COLUMNS, one contiguous array per coefficient for scans
+ *  that look at one dimension of every frame).
+ *
+ *  Growing doubles the capacity and moves the block, so pointers from
+ *  getData()/row()/column() only stay valid until the next append, unless
+ *  a release callback keeps the old block alive for whoever still reads it.
+ *  adopt() wraps a block the store doesn't own (a mapped database file)
+ *  without copying; it is copied into an owned block on the first append.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  pkmFeatureStore<pkmFeature> store(13);
+ *  pkmFeature *rows = store.appendRows(num_frames);	// write num_frames x 13
+ *  ...
+ *  pkmFeature *frame = store.row(i);
+ *
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <functional>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#define PKM_FEATURE_ALIGNMENT 64
+
+enum pkmFeatureLayout {
+	PKM_FEATURE_ROWS,				// frame i is getData() + i*numFeatures
+	PKM_FEATURE_COLUMNS				// coefficient j is getData() + j*capacity
+};
+
+static inline void * pkmAlignedMalloc(size_t bytes)
+{
+	void *p = NULL;
+#if defined(_WIN32)
+	p = _aligned_malloc(bytes, PKM_FEATURE_ALIGNMENT);
+#else
+	if (posix_memalign(&p, PKM_FEATURE_ALIGNMENT, bytes) != 0) {
+		p = NULL;
+	}
+#endif
+	return p;
+}
+
+static inline void pkmAlignedFree(void *p)
+{
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+template <typename T>
+class pkmFeatureStore
+{
+public:
+	pkmFeatureStore(int num_features = 0,
+					pkmFeatureLayout layout_type = PKM_FEATURE_ROWS)
+	{
+		data = NULL;
+		numFeatures = num_features;
+		numFrames = 0;
+		capacity = 0;
+		layout = layout_type;
+		bOwnsData = true;
+	}
+
+	~pkmFeatureStore()
+	{
+		if (bOwnsData) {
+			pkmAlignedFree(data);
+		}
+	}
+
+	// replaced blocks go to release(block) instead of being freed; it
+	// must pkmAlignedFree them eventually
+	void setReleaseCallback(std::function<void(void *)> release)
+	{
+		releaseBlock = release;
+	}
+
+	// frame width; only while empty
+	void setNumFeatures(int num_features)
+	{
+		if (numFrames) {
+			printf("[ERROR] pkmFeatureStore: cannot change the number of features of a non-empty store\n");
+			return;
+		}
+		numFeatures = num_features;
+	}
+
+	// frames frames laid out as getLayout() says (a column every frames
+	// values for PKM_FEATURE_COLUMNS), read in place and never written or
+	// freed; only while empty
+	bool adopt(T *block, int frames)
+	{
+		if (numFrames) {
+			printf("[ERROR] pkmFeatureStore: can only adopt into an empty store\n");
+			return false;
+		}
+		release();
+		data = block;
+		numFrames = frames;
+		capacity = frames;
+		bOwnsData = false;
+		return true;
+	}
+
+	bool reserve(int frames)
+	{
+		if (frames <= capacity) {
+			return true;
+		}
+		if (numFeatures <= 0) {
+			printf("[ERROR] pkmFeatureStore: set the number of features first\n");
+			return false;
+		}
+
+		T *grown = (T *)pkmAlignedMalloc(sizeof(T) * (size_t)frames * numFeatures);
+		if (grown == NULL) {
+			printf("[ERROR] pkmFeatureStore: could not allocate %d frames\n", frames);
+			return false;
+		}
+		if (numFrames) {
+			if (layout == PKM_FEATURE_ROWS) {
+				memcpy(grown, data, sizeof(T) * (size_t)numFrames * numFeatures);
+			}
+			else {
+				for (int j = 0; j < numFeatures; j++)
+					memcpy(grown + (size_t)j*frames, data + (size_t)j*capacity, sizeof(T) * numFrames);
+			}
+		}
+		release();
+		data = grown;
+		capacity = frames;
+		bOwnsData = true;
+		return true;
+	}
+
+	// n more frames; for row major stores a pointer to them (n x
+	// numFeatures) to be written in place, otherwise NULL (use append)
+	T * appendRows(int n)
+	{
+		if (layout != PKM_FEATURE_ROWS || !grow(n)) {
+			return NULL;
+		}
+		T *rows = data + (size_t)numFrames * numFeatures;
+		numFrames += n;
+		return rows;
+	}
+
+	// copy in n row major frames, whatever the layout
+	bool append(const T *rows, int n)
+	{
+		if (!grow(n)) {
+			return false;
+		}
+		if (layout == PKM_FEATURE_ROWS) {
+			memcpy(data + (size_t)numFrames * numFeatures, rows, sizeof(T) * (size_t)n * numFeatures);
+		}
+		else {
+			for (int i = 0; i < n; i++)
+				for (int j = 0; j < numFeatures; j++)
+					data[(size_t)j*capacity + numFrames + i] = rows[(size_t)i*numFeatures + j];
+		}
+		numFrames += n;
+		return true;
+	}
+
+	void clear()
+	{
+		numFrames = 0;
+		if (!bOwnsData) {
+			// the adopted block is read only
+			data = NULL;
+			capacity = 0;
+			bOwnsData = true;
+		}
+	}
+
+	// clear() that also lets go of the block (to the release callback),
+	// so the next append starts a fresh one
+	void reset()
+	{
+		release();
+		data = NULL;
+		numFrames = 0;
+		capacity = 0;
+		bOwnsData = true;
+	}
+
+	// row major only
+	inline T * row(int i)
+	{
+		return data + (size_t)i * numFeatures;
+	}
+
+	// column major only
+	inline T * column(int j)
+	{
+		return data + (size_t)j * capacity;
+	}
+
+	inline T get(int i, int j) const
+	{
+		return layout == PKM_FEATURE_ROWS ? data[(size_t)i*numFeatures + j] : data[(size_t)j*capacity + i];
+	}
+
+	// frame i into out (numFeatures values) for either layout
+	void getRow(int i, T *out) const
+	{
+		if (layout == PKM_FEATURE_ROWS) {
+			memcpy(out, data + (size_t)i*numFeatures, sizeof(T) * numFeatures);
+		}
+		else {
+			for (int j = 0; j < numFeatures; j++)
+				out[j] = data[(size_t)j*capacity + i];
+		}
+	}
+
+	inline T * getData()					{ return data; }
+	inline int size() const					{ return numFrames; }
+	inline int getNumFeatures() const		{ return numFeatures; }
+	inline int getCapacity() const			{ return capacity; }
+	inline pkmFeatureLayout getLayout() const	{ return layout; }
+	inline bool ownsData() const			{ return bOwnsData; }
+
+private:
+	// not copyable, the block is owned
+	pkmFeatureStore(const pkmFeatureStore &);
+	pkmFeatureStore & operator=(const pkmFeatureStore &);
+
+	// the current block, to the release callback if it is ours
+	void release()
+	{
+		if (!bOwnsData || data == NULL) {
+			return;
+		}
+		if (releaseBlock) {
+			releaseBlock(data);
+		}
+		else {
+			pkmAlignedFree(data);
+		}
+	}
+
+	bool grow(int n)
+	{
+		if (numFrames + n <= capacity) {
+			return true;
+		}
+		int frames = capacity ? capacity : 1024;
+		while (frames < numFrames + n) {
+			frames *= 2;
+		}
+		return reserve(frames);
+	}
+
+	T					*data;
+	int					numFeatures,
+						numFrames,
+						capacity;
+	pkmFeatureLayout	layout;
+	bool				bOwnsData;
+	std::function<void(void *)>	releaseBlock;
+};
@@ -0,0 +1,6 @@
+/*
+ *  pkmHNSW.cpp
+ *
+ */
+
+#include "pkmHNSW.h"
@@ -0,0 +1,365 @@
+/*
+ *  pkmHNSW.h
+ *
+ *  Hierarchical navigable small world graph (Malkov and Yashunin, 2016) as
+ *  a pkmIndexSegment.  Every frame gets a random top layer with
+ *  probability falling by 1/M per layer; a search walks greedily down the
+ *  sparse upper layers and then runs a best-first search of hnswEfSearch
+ *  candidates on the bottom one.  Neighbours are picked with the paper's
+ *  heuristic (skip a candidate that is closer to an already picked
+ *  neighbour than to the node), which keeps the graph navigable in the
+ *  ~13-40 dimensions the MFCCs live in.  Built once, searched read only.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <math.h>
+#include <random>
+#include <functional>
+#include "pkmIndexSegment.h"
+
+#define PKM_HNSW_MAX_LEVEL 16
+
+class pkmHNSW : public pkmIndexSegment
+{
+public:
+	typedef std::pair<pkmIndexDist, int> Entry;
+
+	pkmHNSW(const pkmIndexCoord *rows,
+			const std::vector<int> &frames,
+			int dimensions,
+			const pkmIndexParams &params)
+	{
+		dim = dimensions;
+		n = (int)frames.size();
+		M = std::max(params.hnswM, 2);
+		maxM0 = 2 * M;
+		entry = -1;
+		maxLevel = 0;
+
+		rowOf = frames;
+
+		// seeded by the size, so the same frames give the same graph
+		std::mt19937 rng(0x9e3779b9u ^ (unsigned int)n);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		double mult = 1.0 / log((double)M);
+		levels.resize(n);
+		for (int i = 0; i < n; i++)
+			levels[i] = std::min((int)(-log(1.0 - uniform(rng)) * mult), PKM_HNSW_MAX_LEVEL);
+
+		links0.assign((size_t)n * (maxM0 + 1), 0);
+		upper.resize(n);
+
+		pkmIndexScratch build;
+		build.visited.assign(n, 0);
+		int ef = std::max(params.hnswEfConstruction, M);
+		for (int i = 0; i < n; i++)
+			insert(rows, i, ef, build);
+	}
+
+	// as save() wrote it; in.ok is false if it doesn't fit these frames
+	// (the rows are only read when searching)
+	pkmHNSW(const pkmIndexCoord *,
+			const std::vector<int> &frames,
+			int dimensions,
+			pkmIndexReader &in)
+	{
+		dim = dimensions;
+		n = (int)frames.size();
+		rowOf = frames;
+
+		int32_t header[4] = {0, 0, 0, 0};
+		std::vector<int> flat;
+		for (int i = 0; i < 4; i++)
+			in.get(header[i]);
+		M = header[0];
+		maxM0 = 2 * M;
+		entry = header[1];
+		maxLevel = header[2];
+		in.getArray(levels);
+		in.getArray(links0);
+		in.getArray(flat);
+		// the search starts at entry on maxLevel, which has to be its top
+		if (!in.ok || M < 2 || header[3] != n || (n && (entry < 0 || entry >= n)) ||
+			(int)levels.size() != n || links0.size() != (size_t)n * (maxM0 + 1) ||
+			maxLevel < 0 || maxLevel > PKM_HNSW_MAX_LEVEL || (n && levels[entry] != maxLevel)) {
+			in.ok = false;
+			return;
+		}
+
+		// the upper layers were concatenated node by node
+		upper.resize(n);
+		size_t at = 0;
+		for (int i = 0; i < n && in.ok; i++) {
+			if (levels[i] < 0 || levels[i] > PKM_HNSW_MAX_LEVEL) {
+				in.ok = false;
+				break;
+			}
+			size_t count = (size_t)levels[i] * (M + 1);
+			if (at + count > flat.size()) {
+				in.ok = false;
+				break;
+			}
+			upper[i].assign(flat.begin() + at, flat.begin() + at + count);
+			at += count;
+			for (int l = 0; l <= levels[i] && in.ok; l++) {
+				const int *lk = links(i, l);
+				in.ok = lk[0] >= 0 && lk[0] <= (l ? M : maxM0);
+				for (int j = 1; j <= lk[0] && in.ok; j++)
+					in.ok = lk[j] >= 0 && lk[j] < n && levels[lk[j]] >= l;
+			}
+		}
+	}
+
+	bool save(pkmIndexBlob &out) const
+	{
+		out.put((int32_t)M);
+		out.put((int32_t)entry);
+		out.put((int32_t)maxLevel);
+		out.put((int32_t)n);
+		out.putArray(levels);
+		out.putArray(links0);
+		std::vector<int> flat;
+		for (int i = 0; i < n; i++)
+			flat.insert(flat.end(), upper[i].begin(), upper[i].end());
+		out.putArray(flat);
+		return true;
+	}
+
+	int search(const pkmIndexCoord *rows, const pkmIndexCoord *query, int k, int *local, pkmIndexDist *dists,
+			   const pkmIndexParams &params, pkmIndexScratch &scratch) const
+	{
+		if (n == 0 || k <= 0) {
+			return 0;
+		}
+		int ep = greedyDescend(rows, query, entry, maxLevel, 0);
+		searchLayer(rows, query, ep, std::max(params.hnswEfSearch, k), 0, scratch);
+
+		std::vector<Entry> &results = scratch.results;
+		std::sort_heap(results.begin(), results.end());
+		int found = std::min(k, (int)results.size());
+		for (int i = 0; i < found; i++) {
+			local[i] = results[i].second;
+			dists[i] = results[i].first;
+		}
+		results.clear();
+		return found;
+	}
+
+	void reserve(pkmIndexScratch &scratch, int k, const pkmIndexParams &params) const
+	{
+		if ((int)scratch.visited.size() < n) {
+			scratch.visited.resize(n, 0);
+		}
+		// every visited node can be a candidate at once
+		if ((int)scratch.candidates.capacity() < n + 1) {
+			scratch.candidates.reserve(n + 1);
+		}
+		int ef = std::max(params.hnswEfSearch, k);
+		if ((int)scratch.results.capacity() < ef + 1) {
+			scratch.results.reserve(ef + 1);
+		}
+	}
+
+private:
+	inline const pkmIndexCoord * point(const pkmIndexCoord *rows, int node) const
+	{
+		return rows + (size_t)rowOf[node]*dim;
+	}
+
+	inline pkmIndexDist distance(const pkmIndexCoord *rows, const pkmIndexCoord *q, int node) const
+	{
+		return pkmIndexDistance(q, point(rows, node), dim);
+	}
+
+	// count followed by the neighbour ids
+	inline int * links(int node, int level)
+	{
+		return level == 0 ? &links0[(size_t)node * (maxM0 + 1)] : &upper[node][(level - 1) * (M + 1)];
+	}
+	inline const int * links(int node, int level) const
+	{
+		return level == 0 ? &links0[(size_t)node * (maxM0 + 1)] : &upper[node][(level - 1) * (M + 1)];
+	}
+
+	// closest node on the layers from top down to (but not) bottom
+	int greedyDescend(const pkmIndexCoord *rows, const pkmIndexCoord *q, int ep, int top, int bottom) const
+	{
+		pkmIndexDist d = distance(rows, q, ep);
+		for (int level = top; level > bottom; level--) {
+			bool changed = true;
+			while (changed) {
+				changed = false;
+				const int *l = links(ep, level);
+				for (int i = 1; i <= l[0]; i++) {
+					pkmIndexDist dn = distance(rows, q, l[i]);
+					if (dn < d) {
+						d = dn;
+						ep = l[i];
+						changed = true;
+					}
+				}
+			}
+		}
+		return ep;
+	}
+
+	// best first search of one layer; leaves the ef closest in
+	// scratch.results as a max heap
+	void searchLayer(const pkmIndexCoord *rows, const pkmIndexCoord *q, int ep, int ef, int level,
+					 pkmIndexScratch &scratch) const
+	{
+		std::vector<Entry> &candidates = scratch.candidates;	// min heap
+		std::vector<Entry> &results = scratch.results;			// max heap
+		std::greater<Entry> closer;
+		unsigned int stamp = scratch.nextStamp();
+		candidates.clear();
+		results.clear();
+
+		pkmIndexDist d = distance(rows, q, ep);
+		scratch.visited[ep] = stamp;
+		candidates.push_back(Entry(d, ep));
+		results.push_back(Entry(d, ep));
+
+		while (!candidates.empty()) {
+			Entry c = candidates.front();
+			if ((int)results.size() >= ef && c.first > results.front().first) {
+				break;
+			}
+			std::pop_heap(candidates.begin(), candidates.end(), closer);
+			candidates.pop_back();
+
+			const int *l = links(c.second, level);
+			for (int i = 1; i <= l[0]; i++) {
+				int nb = l[i];
+				if (scratch.visited[nb] == stamp) {
+					continue;
+				}
+				scratch.visited[nb] = stamp;
+				pkmIndexDist dn = distance(rows, q, nb);
+				if ((int)results.size() < ef || dn < results.front().first) {
+					candidates.push_back(Entry(dn, nb));
+					std::push_heap(candidates.begin(), candidates.end(), closer);
+					results.push_back(Entry(dn, nb));
+					std::push_heap(results.begin(), results.end());
+					if ((int)results.size() > ef) {
+						std::pop_heap(results.begin(), results.end());
+						results.pop_back();
+					}
+				}
+			}
+		}
+	}
+
+	// up to m of the ascending (distance to base, id) candidates, skipping
+	// any closer to an already picked one than to base
+	void selectNeighbors(const pkmIndexCoord *rows, std::vector<Entry> &sorted, int m, std::vector<int> &picked) const
+	{
+		picked.clear();
+		for (size_t i = 0; i < sorted.size() && (int)picked.size() < m; i++) {
+			bool good = true;
+			for (size_t j = 0; j < picked.size(); j++) {
+				if (pkmIndexDistance(point(rows, sorted[i].second), point(rows, picked[j]), dim) < sorted[i].first) {
+					good = false;
+					break;
+				}
+			}
+			if (good) {
+				picked.push_back(sorted[i].second);
+			}
+		}
+	}
+
+	void insert(const pkmIndexCoord *rows, int q, int ef, pkmIndexScratch &scratch)
+	{
+		int level = levels[q];
+		if (level > 0) {
+			upper[q].assign(level * (M + 1), 0);
+		}
+		if (entry < 0) {
+			entry = q;
+			maxLevel = level;
+			return;
+		}
+
+		const pkmIndexCoord *p = point(rows, q);
+		int ep = greedyDescend(rows, p, entry, maxLevel, level);
+		std::vector<Entry> found;
+		std::vector<int> picked;
+		for (int l = std::min(level, maxLevel); l >= 0; l--) {
+			searchLayer(rows, p, ep, ef, l, scratch);
+			found.assign(scratch.results.begin(), scratch.results.end());
+			std::sort(found.begin(), found.end());
+			ep = found[0].second;
+
+			selectNeighbors(rows, found, M, picked);
+			int *lq = links(q, l);
+			lq[0] = (int)picked.size();
+			for (size_t i = 0; i < picked.size(); i++)
+				lq[i + 1] = picked[i];
+
+			// and back, re-selecting when a neighbour is full
+			int maxLinks = l == 0 ? maxM0 : M;
+			for (size_t i = 0; i < picked.size(); i++) {
+				int nb = picked[i];
+				int *ln = links(nb, l);
+				if (ln[0] < maxLinks) {
+					ln[++ln[0]] = q;
+					continue;
+				}
+				std::vector<Entry> all;
+				all.push_back(Entry(pkmIndexDistance(point(rows, nb), p, dim), q));
+				for (int j = 1; j <= ln[0]; j++)
+					all.push_back(Entry(pkmIndexDistance(point(rows, nb), point(rows, ln[j]), dim), ln[j]));
+				std::sort(all.begin(), all.end());
+				std::vector<int> kept;
+				selectNeighbors(rows, all, maxLinks, kept);
+				ln[0] = (int)kept.size();
+				for (size_t j = 0; j < kept.size(); j++)
+					ln[j + 1] = kept[j];
+			}
+		}
+		if (level > maxLevel) {
+			maxLevel = level;
+			entry = q;
+		}
+	}
+
+	std::vector<int>					rowOf,		// store row of each node
+										levels;
+	std::vector<int>					links0;		// bottom layer, maxM0 + 1 per node
+	std::vector<std::vector<int> >		upper;		// layers 1.., M + 1 per layer per node
+	int									dim,
+										n,
+										M,
+										maxM0,
+										entry,
+										maxLevel;
+};
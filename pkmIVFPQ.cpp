@@ -0,0 +1,6 @@
+/*
+ *  pkmIVFPQ.cpp
+ *
+ */
+
+#include "pkmIVFPQ.h"
@@ -0,0 +1,399 @@
+/*
+ *  pkmIVFPQ.h
+ *
+ *  Inverted file over product quantized residuals (Jegou, Douze and
+ *  Schmid, 2011) as a pkmIndexSegment.  A coarse k-means splits the frames
+ *  into ivfLists cells; each frame's residual from its cell centre is cut
+ *  into pqSubspaces runs of dimensions and every run is stored as the byte
+ *  index of its nearest of up to 256 sub-centroids.  A query visits the
+ *  ivfProbes closest cells, scores each code with a per cell lookup table
+ *  of sub-distances, and (with ivfRerank) re-ranks the best ivfRerank by
+ *  exact distance to the original rows.  Segments under ivfMinFrames frames
+ *  are not worth training and are scanned exactly instead.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <math.h>
+#include <float.h>
+#include <random>
+#include "pkmIndexSegment.h"
+
+#define PKM_IVFPQ_CODEBOOK 256
+#define PKM_IVFPQ_ITERATIONS 12
+#define PKM_IVFPQ_TRAIN_PER_CENTROID 64
+
+class pkmIVFPQ : public pkmIndexSegment
+{
+public:
+	pkmIVFPQ(const pkmIndexCoord *rows,
+			 const std::vector<int> &frames,
+			 int dimensions,
+			 const pkmIndexParams &params)
+	{
+		dim = dimensions;
+		n = (int)frames.size();
+		rowOf = frames;
+
+		nlist = 0;
+		m = 0;
+		ks = 0;
+		exhaustive = n < std::max(params.ivfMinFrames, 1);
+		if (exhaustive) {
+			return;
+		}
+
+		std::mt19937 rng(0x2545f491u ^ (unsigned int)n);
+
+		// coarse quantizer
+		nlist = params.ivfLists > 0 ? params.ivfLists : (int)sqrt((double)n);
+		nlist = std::max(1, std::min(nlist, n));
+		std::vector<float> sample;
+		int numSample = trainingSample(rows, nlist, rng, sample);
+		kmeans(&sample[0], numSample, dim, nlist, rng, coarse);
+
+		std::vector<int> cell(n);
+		std::vector<float> residuals((size_t)n * dim);
+		for (int i = 0; i < n; i++) {
+			const pkmIndexCoord *x = point(rows, i);
+			cell[i] = nearest(&coarse[0], nlist, x, dim);
+			float *r = &residuals[(size_t)i * dim];
+			const float *c = &coarse[(size_t)cell[i] * dim];
+			for (int j = 0; j < dim; j++)
+				r[j] = (float)x[j] - c[j];
+		}
+
+		// sub-quantizers over the residuals, runs as even as the dims allow
+		m = params.pqSubspaces > 0 ? params.pqSubspaces : (dim + 1) / 2;
+		m = std::max(1, std::min(m, dim));
+		ks = std::min(PKM_IVFPQ_CODEBOOK, n);
+		subStart.resize(m + 1);
+		for (int s = 0; s <= m; s++)
+			subStart[s] = s * dim / m;
+		codebookStart.resize(m + 1);
+		codebookStart[0] = 0;
+		codebooks.clear();
+		std::vector<unsigned char> codesByFrame((size_t)n * m);
+		for (int s = 0; s < m; s++) {
+			int sub = subStart[s + 1] - subStart[s];
+			int numSub = std::min(n, ks * PKM_IVFPQ_TRAIN_PER_CENTROID);
+			std::vector<float> subSample((size_t)numSub * sub);
+			for (int i = 0; i < numSub; i++) {
+				int pick = numSub == n ? i : (int)(rng() % (unsigned int)n);
+				std::copy(&residuals[(size_t)pick * dim + subStart[s]],
+						  &residuals[(size_t)pick * dim + subStart[s + 1]],
+						  &subSample[(size_t)i * sub]);
+			}
+			std::vector<float> book;
+			kmeans(&subSample[0], numSub, sub, ks, rng, book);
+			codebooks.insert(codebooks.end(), book.begin(), book.end());
+			codebookStart[s + 1] = (int)codebooks.size();
+
+			for (int i = 0; i < n; i++)
+				codesByFrame[(size_t)i * m + s] = (unsigned char)nearest(&codebooks[codebookStart[s]], ks,
+																		 &residuals[(size_t)i * dim + subStart[s]], sub);
+		}
+
+		// inverted lists, codes stored cell by cell
+		listStart.assign(nlist + 1, 0);
+		for (int i = 0; i < n; i++)
+			listStart[cell[i] + 1]++;
+		for (int c = 0; c < nlist; c++)
+			listStart[c + 1] += listStart[c];
+		std::vector<int> fill(listStart.begin(), listStart.end() - 1);
+		listIds.resize(n);
+		codes.resize((size_t)n * m);
+		for (int i = 0; i < n; i++) {
+			int at = fill[cell[i]]++;
+			listIds[at] = i;
+			std::copy(&codesByFrame[(size_t)i * m], &codesByFrame[(size_t)(i + 1) * m], &codes[(size_t)at * m]);
+		}
+	}
+
+	// as save() wrote it; in.ok is false if it doesn't fit these frames
+	// (the rows are only read when searching)
+	pkmIVFPQ(const pkmIndexCoord *,
+			 const std::vector<int> &frames,
+			 int dimensions,
+			 pkmIndexReader &in)
+	{
+		dim = dimensions;
+		n = (int)frames.size();
+		rowOf = frames;
+
+		int32_t header[6] = {0, 0, 0, 0, 0, 0};
+		for (int i = 0; i < 6; i++)
+			in.get(header[i]);
+		nlist = header[2];
+		m = header[3];
+		ks = header[4];
+		exhaustive = header[5] != 0;
+		in.getArray(coarse);
+		in.getArray(codebooks);
+		in.getArray(subStart);
+		in.getArray(codebookStart);
+		in.getArray(listStart);
+		in.getArray(listIds);
+		in.getArray(codes);
+		if (!in.ok || header[0] != dim || header[1] != n) {
+			in.ok = false;
+			return;
+		}
+		if (exhaustive) {
+			return;
+		}
+		bool fits = nlist > 0 && m > 0 && m <= dim && ks > 0 && ks <= PKM_IVFPQ_CODEBOOK &&
+					coarse.size() == (size_t)nlist * dim &&
+					(int)subStart.size() == m + 1 && subStart[0] == 0 && subStart[m] == dim &&
+					(int)codebookStart.size() == m + 1 && codebookStart[0] == 0 &&
+					(size_t)codebookStart[m] == codebooks.size() &&
+					(int)listStart.size() == nlist + 1 && listStart[0] == 0 && listStart[nlist] == n &&
+					(int)listIds.size() == n && codes.size() == (size_t)n * m &&
+					pkmIndexReader::inRange(listIds, n);
+		for (int s = 0; fits && s < m; s++)
+			fits = subStart[s + 1] > subStart[s] &&
+				   codebookStart[s + 1] - codebookStart[s] == ks * (subStart[s + 1] - subStart[s]);
+		for (int c = 0; fits && c < nlist; c++)
+			fits = listStart[c + 1] >= listStart[c];
+		for (size_t i = 0; fits && i < codes.size(); i++)
+			fits = codes[i] < ks;
+		in.ok = fits;
+	}
+
+	bool save(pkmIndexBlob &out) const
+	{
+		out.put((int32_t)dim);
+		out.put((int32_t)n);
+		out.put((int32_t)nlist);
+		out.put((int32_t)m);
+		out.put((int32_t)ks);
+		out.put((int32_t)exhaustive);
+		out.putArray(coarse);
+		out.putArray(codebooks);
+		out.putArray(subStart);
+		out.putArray(codebookStart);
+		out.putArray(listStart);
+		out.putArray(listIds);
+		out.putArray(codes);
+		return true;
+	}
+
+	int search(const pkmIndexCoord *rows, const pkmIndexCoord *query, int k, int *local, pkmIndexDist *dists,
+			   const pkmIndexParams &params, pkmIndexScratch &scratch) const
+	{
+		if (n == 0 || k <= 0) {
+			return 0;
+		}
+		std::vector<std::pair<pkmIndexDist, int> > &results = scratch.results;
+		results.clear();
+		if (exhaustive) {
+			for (int i = 0; i < n; i++)
+				pkmIndexKeepBest(results, k, pkmIndexDistance(query, point(rows, i), dim), i);
+			return pkmIndexDrainBest(results, local, dists);
+		}
+
+		// closest cells
+		float *cellDist = &scratch.table[0];
+		for (int c = 0; c < nlist; c++)
+			cellDist[c] = distance(&coarse[(size_t)c * dim], query, dim);
+		int probes = std::max(1, std::min(params.ivfProbes, nlist));
+		std::vector<int> &lists = scratch.lists;
+		for (int c = 0; c < nlist; c++)
+			lists[c] = c;
+		std::partial_sort(lists.begin(), lists.begin() + probes, lists.begin() + nlist,
+						  [cellDist](int a, int b) { return cellDist[a] < cellDist[b]; });
+
+		int rerank = params.ivfRerank > 0 ? std::max(params.ivfRerank, k) : k;
+		float *residual = cellDist + nlist;
+		float *lut = residual + dim;
+		for (int p = 0; p < probes; p++) {
+			int c = lists[p];
+			const float *centre = &coarse[(size_t)c * dim];
+			for (int j = 0; j < dim; j++)
+				residual[j] = (float)query[j] - centre[j];
+			for (int s = 0; s < m; s++) {
+				int sub = subStart[s + 1] - subStart[s];
+				const float *book = &codebooks[codebookStart[s]];
+				for (int t = 0; t < ks; t++)
+					lut[s * ks + t] = distance(book + t * sub, residual + subStart[s], sub);
+			}
+			for (int at = listStart[c]; at < listStart[c + 1]; at++) {
+				const unsigned char *code = &codes[(size_t)at * m];
+				float d = 0;
+				for (int s = 0; s < m; s++)
+					d += lut[s * ks + code[s]];
+				pkmIndexKeepBest(results, rerank, d, listIds[at]);
+			}
+		}
+
+		if (params.ivfRerank <= 0) {
+			return pkmIndexDrainBest(results, local, dists);
+		}
+		std::vector<std::pair<pkmIndexDist, int> > &exact = scratch.candidates;
+		exact.clear();
+		for (size_t i = 0; i < results.size(); i++) {
+			int id = results[i].second;
+			pkmIndexKeepBest(exact, k, pkmIndexDistance(query, point(rows, id), dim), id);
+		}
+		results.clear();
+		return pkmIndexDrainBest(exact, local, dists);
+	}
+
+	void reserve(pkmIndexScratch &scratch, int k, const pkmIndexParams &params) const
+	{
+		int rerank = std::max(params.ivfRerank, k);
+		if ((int)scratch.results.capacity() < rerank + 1) {
+			scratch.results.reserve(rerank + 1);
+		}
+		if ((int)scratch.candidates.capacity() < k + 1) {
+			scratch.candidates.reserve(k + 1);
+		}
+		int table = nlist + dim + m * ks;
+		if ((int)scratch.table.size() < table) {
+			scratch.table.resize(table);
+		}
+		if ((int)scratch.lists.size() < nlist) {
+			scratch.lists.resize(nlist);
+		}
+	}
+
+	inline bool isExhaustive() const		{ return exhaustive; }
+	inline int getNumLists() const			{ return nlist; }
+	inline int getNumSubspaces() const		{ return m; }
+
+private:
+	inline const pkmIndexCoord * point(const pkmIndexCoord *rows, int i) const
+	{
+		return rows + (size_t)rowOf[i]*dim;
+	}
+
+	template<class A, class B>
+	static inline float distance(const A *a, const B *b, int d)
+	{
+		float sum = 0;
+		for (int j = 0; j < d; j++) {
+			float diff = (float)a[j] - (float)b[j];
+			sum += diff*diff;
+		}
+		return sum;
+	}
+
+	template<class T>
+	static int nearest(const float *centroids, int K, const T *x, int d)
+	{
+		int best = 0;
+		float bestDist = FLT_MAX;
+		for (int c = 0; c < K; c++) {
+			float dc = distance(centroids + (size_t)c * d, x, d);
+			if (dc < bestDist) {
+				bestDist = dc;
+				best = c;
+			}
+		}
+		return best;
+	}
+
+	// up to K * PKM_IVFPQ_TRAIN_PER_CENTROID frames, as floats
+	int trainingSample(const pkmIndexCoord *rows, int K, std::mt19937 &rng, std::vector<float> &sample) const
+	{
+		int count = std::min(n, K * PKM_IVFPQ_TRAIN_PER_CENTROID);
+		sample.resize((size_t)count * dim);
+		for (int i = 0; i < count; i++) {
+			int pick = count == n ? i : (int)(rng() % (unsigned int)n);
+			for (int j = 0; j < dim; j++)
+				sample[(size_t)i * dim + j] = (float)point(rows, pick)[j];
+		}
+		return count;
+	}
+
+	// Lloyd's algorithm from K random samples; an empty cluster restarts
+	// on a random sample
+	static void kmeans(const float *x, int count, int d, int K, std::mt19937 &rng,
+					   std::vector<float> &centroids)
+	{
+		centroids.resize((size_t)K * d);
+		std::vector<int> order(count);
+		for (int i = 0; i < count; i++)
+			order[i] = i;
+		std::shuffle(order.begin(), order.end(), rng);
+		for (int c = 0; c < K; c++)
+			std::copy(x + (size_t)order[c % count] * d, x + (size_t)(order[c % count] + 1) * d,
+					  &centroids[(size_t)c * d]);
+
+		std::vector<int> assign(count, -1);
+		std::vector<double> sums((size_t)K * d);
+		std::vector<int> sizes(K);
+		for (int iter = 0; iter < PKM_IVFPQ_ITERATIONS; iter++) {
+			bool changed = false;
+			for (int i = 0; i < count; i++) {
+				int c = nearest(&centroids[0], K, x + (size_t)i * d, d);
+				if (c != assign[i]) {
+					assign[i] = c;
+					changed = true;
+				}
+			}
+			if (!changed) {
+				break;
+			}
+			std::fill(sums.begin(), sums.end(), 0.0);
+			std::fill(sizes.begin(), sizes.end(), 0);
+			for (int i = 0; i < count; i++) {
+				sizes[assign[i]]++;
+				for (int j = 0; j < d; j++)
+					sums[(size_t)assign[i] * d + j] += x[(size_t)i * d + j];
+			}
+			for (int c = 0; c < K; c++) {
+				float *centre = &centroids[(size_t)c * d];
+				if (sizes[c] == 0) {
+					int pick = (int)(rng() % (unsigned int)count);
+					std::copy(x + (size_t)pick * d, x + (size_t)(pick + 1) * d, centre);
+					continue;
+				}
+				for (int j = 0; j < d; j++)
+					centre[j] = (float)(sums[(size_t)c * d + j] / sizes[c]);
+			}
+		}
+	}
+
+	std::vector<int>					rowOf;			// store row of each frame
+	std::vector<float>					coarse,			// nlist x dim
+										codebooks;		// per subspace, ks x its dims
+	std::vector<int>					subStart,		// first dim of each subspace
+										codebookStart,
+										listStart,		// cell c is [listStart[c], listStart[c + 1])
+										listIds;		// frame (local) of each code
+	std::vector<unsigned char>			codes;			// m bytes per frame, cell by cell
+	int									dim,
+										n,
+										nlist,
+										m,
+										ks;
+	bool								exhaustive;
+};
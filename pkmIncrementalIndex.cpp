@@ -0,0 +1,6 @@
+/*
+ *  pkmIncrementalIndex.cpp
+ *
+ */
+
+#include "pkmIncrementalIndex.h"
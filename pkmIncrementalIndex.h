@@ -0,0 +1,488 @@
+/*
+ *  pkmIncrementalIndex.h
+ *
+ *  Nearest neighbour index over the rows of a feature store that grows
+ *  without rebuilding: a log structured set of immutable segments
+ *  (Bentley and Saxe's logarithmic method).  insert() adds the new frames
+ *  as a segment of their own and merges it with the previous one while
+ *  that is less than twice its size, so there are O(log n) segments and
+ *  every frame is rebuilt into a segment O(log n) times in total.  remove()
+ *  only tombstones frames; a segment is rebuilt without its dead frames
+ *  once they are half of it.
+ *
+ *  Frames are identified by their row in the store.  Segments keep row
+ *  numbers, not addresses, and are searched over the index's base of the
+ *  row major ANNcoords: if the rows move (the store grew, or a mapped
+ *  file was copied out), hand the new base to setRows(), nothing is
+ *  rebuilt.
+ *
+ *  What a segment is depends on the backend (pkmIndexSegment.h): a
+ *  kd-tree by default, an exact SIMD scan for small databases, or an HNSW
+ *  graph or IVF-PQ for approximate search over large corpora.  setBackend() rebuilds every segment as the new
+ *  kind; setParams() changes the search knobs in place.
+ *
+ *  save() flattens the segments, tombstones and knobs into a blob that
+ *  load() restores over the same rows: kd-tree, HNSW and IVF-PQ segments
+ *  come back as they were, brute force ones are repacked from the rows.
+ *
+ *  Segments are immutable and shared between copies of an index: copy,
+ *  update the copy and the original is untouched, so a published index
+ *  can be searched while the next one is built (pkmAudioFeatureDatabase
+ *  swaps them with pkmEpoch).  search() only reads the index.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  pkmIncrementalIndex index(13, PKM_INDEX_HNSW);
+ *  index.setRows(store.getData());
+ *  index.insert(first_new_frame, num_new_frames);
+ *  index.remove(first_frame_of_sound, num_frames_of_sound);
+ *  index.reserveScratch(scratch, k);
+ *  int found = index.search(query, k, frames, distances, scratch);
+ *
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include "ANN.h"
+#include "pkmIndexSegment.h"
+#include "pkmKDTree.h"
+#include "pkmHNSW.h"
+#include "pkmIVFPQ.h"
+#include "pkmBruteForce.h"
+
+class pkmIncrementalIndex
+{
+public:
+	pkmIncrementalIndex(int dimensions = 13,
+						pkmIndexBackend backend_type = PKM_INDEX_KDTREE,
+						const pkmIndexParams &index_params = pkmIndexParams())
+	{
+		dim = dimensions;
+		rows = NULL;
+		numLive = 0;
+		backend = backend_type;
+		params = index_params;
+	}
+
+	// base of the row major frames, which must hold the same rows as the
+	// last one did; only this copy of the index uses it
+	void setRows(ANNcoord *row_data)
+	{
+		rows = row_data;
+	}
+
+	// segments built from here on are of this kind; rebuilds the existing
+	// ones if the kind changed.  Search knobs apply at once.
+	void setBackend(pkmIndexBackend backend_type, const pkmIndexParams &index_params)
+	{
+		params = index_params;
+		if (backend_type != backend) {
+			backend = backend_type;
+			rebuild();
+		}
+	}
+
+	// search knobs (kdEpsilon, hnswEfSearch, ivfProbes, ivfRerank) without
+	// rebuilding; build ones only reach segments built later
+	void setParams(const pkmIndexParams &index_params)
+	{
+		params = index_params;
+	}
+
+	// frames [first, first + count), all newer than anything indexed
+	void insert(int first, int count)
+	{
+		if (count <= 0) {
+			return;
+		}
+
+		std::vector<int> frames(count);
+		for (int i = 0; i < count; i++)
+			frames[i] = first + i;
+		segments.push_back(buildSegment(frames));
+		numLive += count;
+
+		// keep sizes at least doubling towards the oldest segment
+		while (segments.size() > 1 &&
+			   segments[segments.size() - 2].size() < 2 * segments.back().size()) {
+			mergeLast();
+		}
+	}
+
+	// tombstone frames [first, first + count); search skips them
+	void remove(int first, int count)
+	{
+		for (size_t s = 0; s < segments.size(); ) {
+			Segment &seg = segments[s];
+			const std::vector<int> &frames = seg.engine->frames;
+			size_t lo = std::lower_bound(frames.begin(), frames.end(), first) - frames.begin();
+			size_t hi = std::lower_bound(frames.begin(), frames.end(), first + count) - frames.begin();
+			if (lo < hi) {
+				// copy on write, the old bitmap may be in a published index
+				std::shared_ptr<std::vector<unsigned char> > dead(seg.dead ? 
+					new std::vector<unsigned char>(*seg.dead) : new std::vector<unsigned char>(frames.size(), 0));
+				for (size_t i = lo; i < hi; i++) {
+					if (!(*dead)[i]) {
+						(*dead)[i] = 1;
+						seg.numDead++;
+						numLive--;
+					}
+				}
+				seg.dead = dead;
+			}
+
+			// rebuild the segments that are mostly tombstones, dropping empty ones
+			if (seg.numDead * 2 >= seg.size()) {
+				std::vector<int> live = liveFrames(seg);
+				if (live.empty()) {
+					segments.erase(segments.begin() + s);
+					continue;
+				}
+				seg = buildSegment(live);
+			}
+			s++;
+		}
+	}
+
+	// up to k nearest live frames, closest first; returns how many.  Does
+	// not allocate if scratch went through reserveScratch() for this k.
+	int search(const pkmIndexCoord *query, int k, int *frames, pkmIndexDist *distances,
+			   pkmIndexScratch &scratch) const
+	{
+		int found = 0;
+		if (k <= 0) {
+			return found;
+		}
+		for (size_t s = 0; s < segments.size(); s++) {
+			const Segment &seg = segments[s];
+			// enough extra to see k live frames past the tombstones
+			int kk = std::min(k + seg.numDead, seg.size());
+			scratch.reserveHits(kk);
+			int hits = seg.engine->segment->search(rows, query, kk, &scratch.idx[0], &scratch.dist[0], params, scratch);
+			merge(seg, &scratch.idx[0], &scratch.dist[0], hits, k, frames, distances, found);
+		}
+		return found;
+	}
+
+	// num_queries row major queries at once, each segment searching them
+	// as a batch; query q's nearest at frames and distances + q*k, how
+	// many in found[q].  Allocates.
+	void searchBatch(const pkmIndexCoord *queries, int num_queries, int k,
+					 int *frames, pkmIndexDist *distances, int *found) const
+	{
+		for (int q = 0; q < num_queries; q++)
+			found[q] = 0;
+		if (k <= 0) {
+			return;
+		}
+		std::vector<int> local, hits(num_queries);
+		std::vector<pkmIndexDist> dists;
+		for (size_t s = 0; s < segments.size(); s++) {
+			const Segment &seg = segments[s];
+			int kk = std::min(k + seg.numDead, seg.size());
+			local.resize((size_t)num_queries * kk);
+			dists.resize((size_t)num_queries * kk);
+			seg.engine->segment->searchBatch(rows, queries, num_queries, dim, kk, &local[0], &dists[0], &hits[0], params);
+			for (int q = 0; q < num_queries; q++)
+				merge(seg, &local[(size_t)q * kk], &dists[(size_t)q * kk], hits[q],
+					  k, frames + (size_t)q * k, distances + (size_t)q * k, found[q]);
+		}
+	}
+
+	// whether search() and searchBatch() may run on several threads at
+	// once, each with its own scratch
+	bool isReentrant() const
+	{
+		for (size_t s = 0; s < segments.size(); s++)
+			if (!segments[s].engine->segment->isReentrant())
+				return false;
+		return true;
+	}
+
+	// grow scratch to what search() needs for k neighbours, so it never has to
+	void reserveScratch(pkmIndexScratch &scratch, int k) const
+	{
+		for (size_t s = 0; s < segments.size(); s++) {
+			int kk = std::min(k + segments[s].numDead, segments[s].size());
+			scratch.reserveHits(kk);
+			segments[s].engine->segment->reserve(scratch, kk, params);
+		}
+	}
+
+	bool isRemoved(int frame) const
+	{
+		for (size_t s = 0; s < segments.size(); s++) {
+			const std::vector<int> &frames = segments[s].engine->frames;
+			std::vector<int>::const_iterator it = std::lower_bound(frames.begin(), frames.end(), frame);
+			if (it != frames.end() && *it == frame) {
+				return segments[s].dead && (*segments[s].dead)[it - frames.begin()];
+			}
+		}
+		return true;
+	}
+
+	// everything but the rows
+	void save(pkmIndexBlob &out) const
+	{
+		out.put((int32_t)backend);
+		out.put(params);
+		out.put((int32_t)dim);
+		out.put((int32_t)segments.size());
+		for (size_t s = 0; s < segments.size(); s++) {
+			const Segment &seg = segments[s];
+			out.putArray(seg.engine->frames);
+			out.put((int32_t)seg.numDead);
+			if (seg.dead) {
+				out.putArray(*seg.dead);
+			}
+			else {
+				out.putArray(std::vector<unsigned char>());
+			}
+			pkmIndexBlob engine;
+			bool saved = seg.engine->segment->save(engine);
+			out.put((int32_t)saved);
+			out.putArray(engine.bytes);
+		}
+	}
+
+	// replaces this index with a saved one over row_data, whose rows must
+	// be the ones it was saved with; frames must be below num_frames.
+	// Returns false (and is left empty) if the blob doesn't fit.
+	bool load(pkmIndexReader &in, ANNcoord *row_data, int num_frames)
+	{
+		segments.clear();
+		numLive = 0;
+		rows = row_data;
+
+		int32_t backend_type = 0, dimensions = 0, numSegments = 0;
+		in.get(backend_type);
+		in.get(params);
+		in.get(dimensions);
+		in.get(numSegments);
+		if (!in.ok || dimensions != dim || backend_type < PKM_INDEX_KDTREE ||
+			backend_type > PKM_INDEX_BRUTEFORCE || numSegments < 0) {
+			printf("[ERROR] pkmIncrementalIndex: saved index does not match\n");
+			return false;
+		}
+		backend = (pkmIndexBackend)backend_type;
+
+		int last = -1;
+		for (int s = 0; s < numSegments; s++) {
+			std::vector<int> frames;
+			std::vector<unsigned char> dead;
+			int32_t numDead = 0, saved = 0;
+			const char *engine = NULL;
+			size_t engineBytes = 0;
+			in.getArray(frames);
+			in.get(numDead);
+			in.getArray(dead);
+			in.get(saved);
+			in.getBlock(engine, engineBytes);
+
+			// ascending, disjoint and in the store
+			bool fits = in.ok && !frames.empty() && frames.back() < num_frames && frames[0] > last &&
+						(dead.empty() || dead.size() == frames.size());
+			for (size_t i = 1; fits && i < frames.size(); i++)
+				fits = frames[i] > frames[i - 1];
+			if (fits) {
+				fits = numDead == (dead.empty() ? 0 : (int)std::count(dead.begin(), dead.end(), 1));
+			}
+			if (!fits) {
+				printf("[ERROR] pkmIncrementalIndex: saved index does not match\n");
+				segments.clear();
+				numLive = 0;
+				return false;
+			}
+			last = frames.back();
+
+			Segment seg;
+			if (saved) {
+				pkmIndexReader engineIn(engine, engineBytes);
+				seg = loadSegment(frames, engineIn);
+			}
+			if (!seg.engine) {
+				seg = buildSegment(frames);
+			}
+			if (!dead.empty()) {
+				seg.dead = std::shared_ptr<std::vector<unsigned char> >(new std::vector<unsigned char>(dead));
+				seg.numDead = numDead;
+			}
+			numLive += seg.size() - seg.numDead;
+			segments.push_back(seg);
+		}
+		return true;
+	}
+
+	void setEpsilon(double eps)				{ params.kdEpsilon = eps; }
+	inline pkmIndexBackend getBackend() const			{ return backend; }
+	inline const pkmIndexParams & getParams() const		{ return params; }
+	inline int size() const					{ return numLive; }
+	inline int getNumSegments() const		{ return (int)segments.size(); }
+
+private:
+	// a search structure over some ascending store rows, shared by every
+	// index copy that has the segment
+	struct Engine
+	{
+		std::vector<int>	frames;
+		pkmIndexSegment		*segment;
+
+		~Engine()
+		{
+			delete segment;
+		}
+	};
+
+	struct Segment
+	{
+		std::shared_ptr<Engine>							engine;
+		std::shared_ptr<std::vector<unsigned char> >	dead;		// NULL until something is removed
+		int												numDead;
+
+		inline int size() const { return (int)engine->frames.size(); }
+	};
+
+	Segment buildSegment(const std::vector<int> &frames)
+	{
+		Segment seg;
+		seg.engine = std::shared_ptr<Engine>(new Engine);
+		seg.engine->frames = frames;
+		switch (backend) {
+			case PKM_INDEX_HNSW:
+				seg.engine->segment = new pkmHNSW(rows, frames, dim, params);
+				break;
+			case PKM_INDEX_IVFPQ:
+				seg.engine->segment = new pkmIVFPQ(rows, frames, dim, params);
+				break;
+			case PKM_INDEX_BRUTEFORCE:
+				seg.engine->segment = new pkmBruteForce(rows, frames, dim);
+				break;
+			default:
+				seg.engine->segment = new pkmKDTree(rows, frames, dim);
+				break;
+		}
+		seg.numDead = 0;
+		return seg;
+	}
+
+	// a segment's hits into the sorted k best so far, skipping tombstones
+	static void merge(const Segment &seg, const int *local, const pkmIndexDist *dists, int hits,
+					  int k, int *frames, pkmIndexDist *distances, int &found)
+	{
+		for (int i = 0; i < hits; i++) {
+			pkmIndexDist d = dists[i];
+			if ((seg.dead && (*seg.dead)[local[i]]) || (found == k && d >= distances[k - 1])) {
+				continue;
+			}
+			int j = found < k ? found++ : k - 1;
+			while (j > 0 && distances[j - 1] > d) {
+				distances[j] = distances[j - 1];
+				frames[j] = frames[j - 1];
+				j--;
+			}
+			distances[j] = d;
+			frames[j] = seg.engine->frames[local[i]];
+		}
+	}
+
+	// a saved segment of the current backend, or an empty one if it
+	// doesn't fit
+	Segment loadSegment(const std::vector<int> &frames, pkmIndexReader &in)
+	{
+		Segment seg;
+		seg.numDead = 0;
+		pkmIndexSegment *segment = NULL;
+		switch (backend) {
+			case PKM_INDEX_KDTREE:
+				segment = new pkmKDTree(rows, frames, dim, in);
+				break;
+			case PKM_INDEX_HNSW:
+				segment = new pkmHNSW(rows, frames, dim, in);
+				break;
+			case PKM_INDEX_IVFPQ:
+				segment = new pkmIVFPQ(rows, frames, dim, in);
+				break;
+			default:
+				return seg;
+		}
+		if (!in.ok) {
+			delete segment;
+			return seg;
+		}
+		seg.engine = std::shared_ptr<Engine>(new Engine);
+		seg.engine->frames = frames;
+		seg.engine->segment = segment;
+		return seg;
+	}
+
+	void rebuild()
+	{
+		for (size_t s = 0; s < segments.size(); s++)
+			segments[s] = buildSegment(liveFrames(segments[s]));
+	}
+
+	std::vector<int> liveFrames(const Segment &seg)
+	{
+		const std::vector<int> &frames = seg.engine->frames;
+		if (!seg.dead) {
+			return frames;
+		}
+		std::vector<int> live;
+		live.reserve(frames.size() - seg.numDead);
+		for (size_t i = 0; i < frames.size(); i++)
+			if (!(*seg.dead)[i])
+				live.push_back(frames[i]);
+		return live;
+	}
+
+	// the two newest segments into one, leaving out tombstones
+	void mergeLast()
+	{
+		std::vector<int> frames = liveFrames(segments[segments.size() - 2]);
+		std::vector<int> newer = liveFrames(segments.back());
+		frames.insert(frames.end(), newer.begin(), newer.end());
+		segments.pop_back();
+		if (frames.empty()) {
+			segments.pop_back();
+			return;
+		}
+		segments.back() = buildSegment(frames);
+	}
+
+	std::vector<Segment>		segments;		// ascending, disjoint frames, oldest first
+	ANNcoord					*rows;
+	int							dim,
+								numLive;
+	pkmIndexBackend				backend;
+	pkmIndexParams				params;
+};
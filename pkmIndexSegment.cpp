@@ -0,0 +1,6 @@
+/*
+ *  pkmIndexSegment.cpp
+ *
+ */
+
+#include "pkmIndexSegment.h"
@@ -0,0 +1,303 @@
+/*
+ *  pkmIndexSegment.h
+ *
+ *  The search engines behind pkmIncrementalIndex.  A segment is an
+ *  immutable nearest neighbour structure over some rows of the feature
+ *  store, built once from a list of row numbers and searched in squared
+ *  L2 distance over wherever the rows are at the time; pkmIncrementalIndex adds, merges, tombstones and
+ *  publishes segments, whatever kind they are:
+ *
+ *  PKM_INDEX_KDTREE	kd-tree (pkmKDTree.h), near exact
+ *  PKM_INDEX_HNSW		hierarchical navigable small world graph (pkmHNSW.h)
+ *  PKM_INDEX_IVFPQ		inverted file over product quantized residuals,
+ *						optionally re-ranked exactly (pkmIVFPQ.h)
+ *  PKM_INDEX_BRUTEFORCE	exact scan with SIMD distance kernels
+ *						(pkmBruteForce.h), for small databases
+ *
+ *  pkmIndexParams carries the build and search knobs; the search ones
+ *  (hnswEfSearch, ivfProbes, ivfRerank) trade recall for latency and can
+ *  be changed without rebuilding.  benchmark/pkmIndexBenchmark.cpp
+ *  measures recall against exact search (pkmBruteForce).
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  pkmIndexParams params;
+ *  params.hnswEfSearch = 128;
+ *  database->setIndexBackend(PKM_INDEX_HNSW, params);
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+// same as ANNcoord and ANNdist
+typedef double pkmIndexCoord;
+typedef double pkmIndexDist;
+
+enum pkmIndexBackend {
+	PKM_INDEX_KDTREE,
+	PKM_INDEX_HNSW,
+	PKM_INDEX_IVFPQ,
+	PKM_INDEX_BRUTEFORCE
+};
+
+struct pkmIndexParams
+{
+	// kd-tree
+	double		kdEpsilon;				// error bound, as ANN's
+
+	// HNSW
+	int			hnswM;					// links per node (2M on the bottom layer)
+	int			hnswEfConstruction;		// candidate list while building
+	int			hnswEfSearch;			// candidate list while searching, >= k
+
+	// IVF-PQ
+	int			ivfLists;				// coarse cells, 0 = sqrt(frames)
+	int			ivfProbes;				// cells visited per query
+	int			pqSubspaces;			// codes per frame (one byte each), 0 = (dim + 1) / 2
+	int			ivfRerank;				// candidates re-ranked by exact distance, 0 = none
+	int			ivfMinFrames;			// smaller segments are searched exhaustively
+
+	pkmIndexParams()
+	{
+		kdEpsilon = 0.0000001;
+		hnswM = 16;
+		hnswEfConstruction = 100;
+		hnswEfSearch = 64;
+		ivfLists = 0;
+		ivfProbes = 8;
+		pqSubspaces = 0;
+		ivfRerank = 64;
+		ivfMinFrames = 4096;
+	}
+};
+
+// per query thread search state; segments size it with reserve() up front
+// so a search never allocates
+struct pkmIndexScratch
+{
+	std::vector<int>							idx;			// one segment's hits
+	std::vector<pkmIndexDist>					dist;
+	std::vector<unsigned int>					visited;		// HNSW, stamp per node
+	unsigned int								stamp;
+	std::vector<std::pair<pkmIndexDist, int> >	candidates,		// heaps
+												results;
+	std::vector<float>							table;			// IVF coarse distances and PQ lookup
+	std::vector<pkmIndexDist>					offsets;		// kd-tree, per dimension
+	std::vector<int>							lists;
+
+	pkmIndexScratch() : stamp(0) {}
+
+	void reserveHits(int n)
+	{
+		if ((int)idx.size() < n) {
+			idx.resize(n);
+			dist.resize(n);
+		}
+	}
+
+	// a fresh visited stamp for n nodes
+	unsigned int nextStamp()
+	{
+		if (++stamp == 0) {
+			std::fill(visited.begin(), visited.end(), 0);
+			stamp = 1;
+		}
+		return stamp;
+	}
+};
+
+// flat binary for saving an index: values and arrays of plain types,
+// native byte order (the database file records it)
+struct pkmIndexBlob
+{
+	std::vector<char>	bytes;
+
+	template <typename T>
+	void put(const T &value)
+	{
+		const char *p = (const char *)&value;
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+
+	template <typename T>
+	void putArray(const T *values, size_t count)
+	{
+		put((uint64_t)count);
+		const char *p = (const char *)values;
+		bytes.insert(bytes.end(), p, p + sizeof(T) * count);
+	}
+
+	template <typename T>
+	void putArray(const std::vector<T> &values)
+	{
+		putArray(values.empty() ? NULL : &values[0], values.size());
+	}
+};
+
+// reads what pkmIndexBlob wrote; once anything is out of bounds ok is
+// false and every later read fails
+struct pkmIndexReader
+{
+	const char	*p,
+				*end;
+	bool		ok;
+
+	pkmIndexReader(const char *bytes, size_t count) : p(bytes), end(bytes + count), ok(true) {}
+
+	template <typename T>
+	bool get(T &value)
+	{
+		if (!ok || (size_t)(end - p) < sizeof(T)) {
+			return ok = false;
+		}
+		memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+		return true;
+	}
+
+	template <typename T>
+	bool getArray(std::vector<T> &values)
+	{
+		uint64_t count;
+		if (!get(count) || count > (uint64_t)(end - p) / sizeof(T)) {
+			return ok = false;
+		}
+		values.resize((size_t)count);
+		if (count) {
+			memcpy(&values[0], p, sizeof(T) * (size_t)count);
+		}
+		p += sizeof(T) * (size_t)count;
+		return true;
+	}
+
+	// an array's bytes, in place
+	bool getBlock(const char *&block, size_t &count)
+	{
+		uint64_t n;
+		if (!get(n) || n > (uint64_t)(end - p)) {
+			return ok = false;
+		}
+		block = p;
+		count = (size_t)n;
+		p += count;
+		return true;
+	}
+
+	// every value in [0, limit)
+	static bool inRange(const std::vector<int> &values, int limit)
+	{
+		for (size_t i = 0; i < values.size(); i++)
+			if (values[i] < 0 || values[i] >= limit)
+				return false;
+		return true;
+	}
+};
+
+class pkmIndexSegment
+{
+public:
+	virtual ~pkmIndexSegment() {}
+
+	// up to k nearest of this segment's rows, closest first, as positions
+	// in the list it was built from; returns how many.  rows is where the
+	// store's rows are now (they may have moved since the build, segments
+	// keep row numbers, not addresses)
+	virtual int search(const pkmIndexCoord *rows, const pkmIndexCoord *query, int k, int *local,
+					   pkmIndexDist *dists, const pkmIndexParams &params, pkmIndexScratch &scratch) const = 0;
+
+	// grow scratch for searches of up to k
+	virtual void reserve(pkmIndexScratch &scratch, int k, const pkmIndexParams &params) const = 0;
+
+	// num_queries row major queries of dim; query q's hits at local and
+	// dists + q*k, how many in found[q].  One search() after another
+	// unless a segment can do better.
+	virtual void searchBatch(const pkmIndexCoord *rows, const pkmIndexCoord *queries, int num_queries,
+							 int dim, int k, int *local, pkmIndexDist *dists, int *found,
+							 const pkmIndexParams &params) const
+	{
+		pkmIndexScratch scratch;
+		reserve(scratch, k, params);
+		scratch.reserveHits(k);
+		for (int q = 0; q < num_queries; q++)
+			found[q] = search(rows, queries + (size_t)q * dim, k, local + (size_t)q * k, dists + (size_t)q * k,
+							  params, scratch);
+	}
+
+	// whether several threads may search at once (each with its own scratch)
+	virtual bool isReentrant() const		{ return true; }
+
+	// appends what the segment's loading constructor needs besides the
+	// rows; false if it is cheaper to rebuild from the rows
+	virtual bool save(pkmIndexBlob &) const		{ return false; }
+};
+
+static inline pkmIndexDist pkmIndexDistance(const pkmIndexCoord *a, const pkmIndexCoord *b, int dim)
+{
+	pkmIndexDist sum = 0;
+	for (int j = 0; j < dim; j++) {
+		pkmIndexDist d = a[j] - b[j];
+		sum += d*d;
+	}
+	return sum;
+}
+
+// keep the k smallest (distance, id) pairs in a max heap of capacity k
+static inline void pkmIndexKeepBest(std::vector<std::pair<pkmIndexDist, int> > &heap, int k,
+									pkmIndexDist d, int id)
+{
+	if ((int)heap.size() < k) {
+		heap.push_back(std::make_pair(d, id));
+		std::push_heap(heap.begin(), heap.end());
+	}
+	else if (d < heap.front().first) {
+		std::pop_heap(heap.begin(), heap.end());
+		heap.back() = std::make_pair(d, id);
+		std::push_heap(heap.begin(), heap.end());
+	}
+}
+
+// empty a max heap into ascending local/dists; returns how many
+static inline int pkmIndexDrainBest(std::vector<std::pair<pkmIndexDist, int> > &heap,
+									int *local, pkmIndexDist *dists)
+{
+	std::sort_heap(heap.begin(), heap.end());
+	int n = (int)heap.size();
+	for (int i = 0; i < n; i++) {
+		local[i] = heap[i].second;
+		dists[i] = heap[i].first;
+	}
+	heap.clear();
+	return n;
+}
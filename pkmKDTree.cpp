@@ -0,0 +1,6 @@
+/*
+ *  pkmKDTree.cpp
+ *
+ */
+
+#include "pkmKDTree.h"
@@ -0,0 +1,234 @@
+/*
+ *  pkmKDTree.h
+ *
+ *  kd-tree as a pkmIndexSegment, the default backend: near exact (exact
+ *  when kdEpsilon is 0) like the ANN tree it replaces, but searched with
+ *  nothing but the caller's pkmIndexScratch, so the audio thread's query
+ *  never allocates and several threads can search at once.  Buckets of up
+ *  to PKM_KDTREE_BUCKET frames, split at the median of the dimension with
+ *  the largest spread; the search visits the nearer side first and the
+ *  other only if its incremental box distance (Arya and Mount), shrunk by
+ *  (1 + kdEpsilon)^2, can still beat the k-th best.  Built once, searched
+ *  read only.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <float.h>
+#include "pkmIndexSegment.h"
+
+#define PKM_KDTREE_BUCKET 8
+
+class pkmKDTree : public pkmIndexSegment
+{
+public:
+	pkmKDTree(const pkmIndexCoord *rows,
+			  const std::vector<int> &frames,
+			  int dimensions)
+	{
+		dim = dimensions;
+		n = (int)frames.size();
+		rowOf = frames;
+
+		order.resize(n);
+		for (int i = 0; i < n; i++)
+			order[i] = i;
+		if (n > 0) {
+			build(rows, 0, n);
+		}
+	}
+
+	// as save() wrote it; in.ok is false if it doesn't fit these frames
+	// (the rows are only read when searching)
+	pkmKDTree(const pkmIndexCoord *,
+			  const std::vector<int> &frames,
+			  int dimensions,
+			  pkmIndexReader &in)
+	{
+		dim = dimensions;
+		n = (int)frames.size();
+		rowOf = frames;
+
+		int32_t count = 0;
+		in.get(count);
+		in.getArray(order);
+		in.getArray(nodes);
+		if (!in.ok || count != n || (int)order.size() != n || (n > 0) != !nodes.empty() ||
+			!pkmIndexReader::inRange(order, std::max(n, 1))) {
+			in.ok = false;
+			return;
+		}
+		// a permutation, and children after their parents so a search ends
+		std::vector<unsigned char> seen(n, 0);
+		for (int i = 0; i < n && in.ok; i++) {
+			in.ok = !seen[order[i]];
+			seen[order[i]] = 1;
+		}
+		for (size_t i = 0; i < nodes.size() && in.ok; i++) {
+			const Node &node = nodes[i];
+			if (node.split < 0) {
+				in.ok = node.left >= 0 && node.left <= node.right && node.right <= n;
+			}
+			else {
+				in.ok = node.split < dim && node.left > (int)i && node.right > (int)i &&
+						node.left < (int)nodes.size() && node.right < (int)nodes.size();
+			}
+		}
+	}
+
+	bool save(pkmIndexBlob &out) const
+	{
+		out.put((int32_t)n);
+		out.putArray(order);
+		out.putArray(nodes);
+		return true;
+	}
+
+	int search(const pkmIndexCoord *rows, const pkmIndexCoord *query, int k, int *local, pkmIndexDist *dists,
+			   const pkmIndexParams &params, pkmIndexScratch &scratch) const
+	{
+		if (n == 0 || k <= 0) {
+			return 0;
+		}
+		std::vector<pkmIndexDist> &offsets = scratch.offsets;
+		std::fill(offsets.begin(), offsets.begin() + dim, (pkmIndexDist)0);
+		scratch.results.clear();
+		double shrink = (1.0 + params.kdEpsilon) * (1.0 + params.kdEpsilon);
+		descend(rows, 0, query, 0, k, shrink, scratch);
+		return pkmIndexDrainBest(scratch.results, local, dists);
+	}
+
+	void reserve(pkmIndexScratch &scratch, int k, const pkmIndexParams &) const
+	{
+		if ((int)scratch.offsets.size() < dim) {
+			scratch.offsets.resize(dim, 0);
+		}
+		if ((int)scratch.results.capacity() < k + 1) {
+			scratch.results.reserve(k + 1);
+		}
+	}
+
+private:
+	// split < 0: a bucket of order[left .. right)
+	struct Node
+	{
+		int				split;
+		pkmIndexCoord	cut;
+		int				left,
+						right;
+	};
+
+	inline const pkmIndexCoord * point(const pkmIndexCoord *rows, int i) const
+	{
+		return rows + (size_t)rowOf[i]*dim;
+	}
+
+	int build(const pkmIndexCoord *rows, int begin, int end)
+	{
+		int index = (int)nodes.size();
+		Node node;
+		node.split = -1;
+		node.cut = 0;
+		node.left = begin;
+		node.right = end;
+		nodes.push_back(node);
+		if (end - begin <= PKM_KDTREE_BUCKET) {
+			return index;
+		}
+
+		int split = 0;
+		pkmIndexCoord widest = -1;
+		for (int j = 0; j < dim; j++) {
+			pkmIndexCoord lo = point(rows, order[begin])[j], hi = lo;
+			for (int i = begin + 1; i < end; i++) {
+				pkmIndexCoord x = point(rows, order[i])[j];
+				lo = std::min(lo, x);
+				hi = std::max(hi, x);
+			}
+			if (hi - lo > widest) {
+				widest = hi - lo;
+				split = j;
+			}
+		}
+		int mid = (begin + end) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+						 [this, rows, split](int a, int b) { return point(rows, a)[split] < point(rows, b)[split]; });
+
+		node.split = split;
+		node.cut = point(rows, order[mid])[split];
+		node.left = build(rows, begin, mid);
+		node.right = build(rows, mid, end);
+		nodes[index] = node;
+		return index;
+	}
+
+	// rd is the squared distance from query to the node's cell so far
+	void descend(const pkmIndexCoord *rows, int index, const pkmIndexCoord *query, pkmIndexDist rd, int k, double shrink,
+				 pkmIndexScratch &scratch) const
+	{
+		const Node &node = nodes[index];
+		std::vector<std::pair<pkmIndexDist, int> > &heap = scratch.results;
+		if (node.split < 0) {
+			for (int i = node.left; i < node.right; i++) {
+				int id = order[i];
+				pkmIndexDist worst = (int)heap.size() < k ? DBL_MAX : heap.front().first;
+				// give up on a frame once it's further than the k-th best
+				const pkmIndexCoord *x = point(rows, id);
+				pkmIndexDist sum = 0;
+				for (int j = 0; j < dim && sum < worst; j++) {
+					pkmIndexDist d = query[j] - x[j];
+					sum += d*d;
+				}
+				if (sum < worst) {
+					pkmIndexKeepBest(heap, k, sum, id);
+				}
+			}
+			return;
+		}
+
+		pkmIndexDist diff = query[node.split] - node.cut;
+		descend(rows, diff < 0 ? node.left : node.right, query, rd, k, shrink, scratch);
+
+		pkmIndexDist &offset = scratch.offsets[node.split];
+		pkmIndexDist old = offset;
+		pkmIndexDist far = rd - old*old + diff*diff;
+		if ((int)heap.size() < k || far * shrink < heap.front().first) {
+			offset = diff;
+			descend(rows, diff < 0 ? node.right : node.left, query, far, k, shrink, scratch);
+			offset = old;
+		}
+	}
+
+	std::vector<int>					rowOf,		// store row of each frame
+										order;		// frames, grouped by bucket
+	std::vector<Node>					nodes;		// root first
+	int									dim,
+										n;
+};
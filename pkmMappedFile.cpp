@@ -0,0 +1,6 @@
+/*
+ *  pkmMappedFile.cpp
+ *
+ */
+
+#include "pkmMappedFile.h"
@@ -0,0 +1,154 @@
+/*
+ *  pkmMappedFile.h
+ *
+ *  A whole file mapped read only into memory: pages are read in by the OS
+ *  when first touched, so opening is immediate whatever the size, and
+ *  several processes mapping the same file share its pages.  Unmapped when
+ *  destroyed; nothing pointing into getData() may outlive it.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  pkmMappedFile file;
+ *  if (file.open("sounds.pkmdb")) {
+ *      const char *bytes = file.getData();
+ *      ...
+ *  }
+ *
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class pkmMappedFile
+{
+public:
+	pkmMappedFile()
+	{
+		data = NULL;
+		bytes = 0;
+	}
+
+	~pkmMappedFile()
+	{
+		close();
+	}
+
+	bool open(const char *path)
+	{
+		close();
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+								  FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			printf("[ERROR] pkmMappedFile: could not open %s\n", path);
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			CloseHandle(file);
+			printf("[ERROR] pkmMappedFile: %s is empty\n", path);
+			return false;
+		}
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		CloseHandle(file);
+		if (mapping == NULL) {
+			printf("[ERROR] pkmMappedFile: could not map %s\n", path);
+			return false;
+		}
+		data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (data == NULL) {
+			printf("[ERROR] pkmMappedFile: could not map %s\n", path);
+			return false;
+		}
+		bytes = (size_t)fileSize.QuadPart;
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			printf("[ERROR] pkmMappedFile: could not open %s\n", path);
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			printf("[ERROR] pkmMappedFile: %s is empty\n", path);
+			return false;
+		}
+		void *p = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) {
+			printf("[ERROR] pkmMappedFile: could not map %s\n", path);
+			return false;
+		}
+		data = (const char *)p;
+		bytes = (size_t)info.st_size;
+#endif
+		return true;
+	}
+
+	void close()
+	{
+		if (data == NULL) {
+			return;
+		}
+#if defined(_WIN32)
+		UnmapViewOfFile(data);
+#else
+		munmap((void *)data, bytes);
+#endif
+		data = NULL;
+		bytes = 0;
+	}
+
+	// whether p points into the mapping
+	inline bool contains(const void *p) const
+	{
+		return data && (const char *)p >= data && (const char *)p < data + bytes;
+	}
+
+	inline const char * getData() const		{ return data; }
+	inline size_t size() const				{ return bytes; }
+
+private:
+	pkmMappedFile(const pkmMappedFile &);
+	pkmMappedFile & operator=(const pkmMappedFile &);
+
+	const char		*data;
+	size_t			bytes;
+};
@@ -0,0 +1,6 @@
+/*
+ *  pkmMixedRadixFFT.cpp
+ *
+ */
+
+#include "pkmMixedRadixFFT.h"
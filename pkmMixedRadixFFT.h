@@ -0,0 +1,397 @@
+/*
+ *  pkmMixedRadixFFT.h
+ *
+ *  Complex FFT of any length, used by pkmRealFFT when N/2 is not a power of
+ *  two (e.g. 480, 960 or 1764 point frames).  Lengths whose only prime
+ *  factors are 2, 3 and 5 run as an in-place mixed radix (4, 2, 3, 5)
+ *  transform; any other length goes through Bluestein's algorithm on top
+ *  of a power of two transform.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  forward() is the unscaled forward DFT, X[k] = sum x[n] e^{-2 pi i nk/M},
+ *  in place on split arrays.  Passing (imagp, realp) instead gives the
+ *  unscaled inverse.  All tables are built in the constructor and never
+ *  written again, so one object can be shared between threads (Bluestein
+ *  keeps its scratch per thread).
+ *
+ *  Usage:
+ *
+ *  pkmMixedRadixFFT *fft = new pkmMixedRadixFFT(240);
+ *  fft->forward(realp, imagp);
+ *  delete fft;
+ *
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+class pkmMixedRadixFFT
+{
+public:
+
+	pkmMixedRadixFFT(int size)
+	{
+		M = size;
+		bluestein = NULL;
+		chirpr = chirpi = NULL;
+		kernelr = kerneli = NULL;
+		twr = twi = NULL;
+		cycles = NULL;
+		numCycleEntries = 0;
+
+		if (M < 1) {
+			printf("[ERROR] pkmMixedRadixFFT: size %d is not positive\n", M);
+			M = 1;
+		}
+
+		if (isFactorable(M)) {
+			setupMixedRadix();
+		}
+		else {
+			setupBluestein();
+		}
+	}
+
+	~pkmMixedRadixFFT()
+	{
+		free(twr);
+		free(twi);
+		free(cycles);
+		free(chirpr);
+		free(chirpi);
+		free(kernelr);
+		free(kerneli);
+		delete bluestein;
+	}
+
+	// true if size only has the prime factors 2, 3 and 5
+	static bool isFactorable(int size)
+	{
+		while (size % 2 == 0) size /= 2;
+		while (size % 3 == 0) size /= 3;
+		while (size % 5 == 0) size /= 5;
+		return size == 1;
+	}
+
+	// unscaled in-place forward DFT of M points
+	void forward(float *re, float *im)
+	{
+		if (bluestein) {
+			forwardBluestein(re, im);
+		}
+		else {
+			forwardMixedRadix(re, im);
+		}
+	}
+
+	inline bool isBluestein()
+	{
+		return bluestein != NULL;
+	}
+
+private:
+
+	void setupMixedRadix()
+	{
+		// radix 4 first, then whatever 2, 3 and 5 are left
+		int n = M;
+		while (n % 4 == 0) { radices.push_back(4); n /= 4; }
+		while (n % 2 == 0) { radices.push_back(2); n /= 2; }
+		while (n % 3 == 0) { radices.push_back(3); n /= 3; }
+		while (n % 5 == 0) { radices.push_back(5); n /= 5; }
+
+		// stage s works on blocks of length L = p*m, output r of butterfly j
+		// is multiplied by e^{-2 pi i r j / L}
+		int total = 0, L = M;
+		for (size_t s = 0; s < radices.size(); s++) {
+			int p = radices[s], m = L / p;
+			twiddleOffsets.push_back(total);
+			total += (p - 1) * m;
+			L = m;
+		}
+		twr = (float *)malloc(sizeof(float) * (total > 0 ? total : 1));
+		twi = (float *)malloc(sizeof(float) * (total > 0 ? total : 1));
+		L = M;
+		for (size_t s = 0; s < radices.size(); s++) {
+			int p = radices[s], m = L / p;
+			float *tr = twr + twiddleOffsets[s], *ti = twi + twiddleOffsets[s];
+			for (int r = 1; r < p; r++) {
+				for (int j = 0; j < m; j++) {
+					double theta = -2.0 * M_PI * (double)(r * j) / (double)L;
+					tr[(r - 1)*m + j] = (float)cos(theta);
+					ti[(r - 1)*m + j] = (float)sin(theta);
+				}
+			}
+			L = m;
+		}
+
+		// the passes leave X[r0 + p0*r1 + p0*p1*r2 ...] at position
+		// r0*m0 + r1*m1 + ..., store that digit reversal as cycles so it can
+		// be undone in place
+		std::vector<int> source(M);
+		for (int k = 0; k < M; k++) {
+			int rest = k, pos = 0;
+			L = M;
+			for (size_t s = 0; s < radices.size(); s++) {
+				int p = radices[s], m = L / p;
+				pos += (rest % p) * m;
+				rest /= p;
+				L = m;
+			}
+			source[k] = pos;
+		}
+
+		std::vector<bool> visited(M, false);
+		std::vector<int> list;
+		for (int k = 0; k < M; k++) {
+			if (visited[k] || source[k] == k) {
+				continue;
+			}
+			size_t head = list.size();
+			list.push_back(0);
+			int c = k;
+			while (!visited[c]) {
+				visited[c] = true;
+				list.push_back(c);
+				c = source[c];
+			}
+			list[head] = (int)(list.size() - head - 1);
+		}
+		numCycleEntries = (int)list.size();
+		cycles = (int *)malloc(sizeof(int) * (numCycleEntries > 0 ? numCycleEntries : 1));
+		for (int i = 0; i < numCycleEntries; i++) {
+			cycles[i] = list[i];
+		}
+	}
+
+	// decimation in frequency, one pass per radix, then the digit reversal
+	void forwardMixedRadix(float *re, float *im)
+	{
+		int L = M;
+		for (size_t s = 0; s < radices.size(); s++)
+		{
+			int p = radices[s], m = L / p;
+			const float *tr = twr + twiddleOffsets[s], *ti = twi + twiddleOffsets[s];
+			for (int b = 0; b < M; b += L)
+			{
+				float *r = re + b, *i = im + b;
+				switch (p) {
+					case 4: butterfly4(r, i, tr, ti, m); break;
+					case 2: butterfly2(r, i, tr, ti, m); break;
+					case 3: butterfly3(r, i, tr, ti, m); break;
+					case 5: butterfly5(r, i, tr, ti, m); break;
+				}
+			}
+			L = m;
+		}
+
+		for (int c = 0; c < numCycleEntries; )
+		{
+			int n = cycles[c];
+			const int *idx = cycles + c + 1;
+			float tr = re[idx[0]], ti = im[idx[0]];
+			for (int e = 0; e < n - 1; e++) {
+				re[idx[e]] = re[idx[e + 1]];
+				im[idx[e]] = im[idx[e + 1]];
+			}
+			re[idx[n - 1]] = tr;
+			im[idx[n - 1]] = ti;
+			c += n + 1;
+		}
+	}
+
+	static inline void twiddle(float *r, float *i, float yr, float yi, float wr, float wi)
+	{
+		*r = yr*wr - yi*wi;
+		*i = yr*wi + yi*wr;
+	}
+
+	static void butterfly2(float *re, float *im, const float *tr, const float *ti, int m)
+	{
+		float *r1 = re + m, *i1 = im + m;
+		for (int j = 0; j < m; j++)
+		{
+			float ar = re[j], ai = im[j], br = r1[j], bi = i1[j];
+			re[j] = ar + br;
+			im[j] = ai + bi;
+			twiddle(r1 + j, i1 + j, ar - br, ai - bi, tr[j], ti[j]);
+		}
+	}
+
+	static void butterfly3(float *re, float *im, const float *tr, const float *ti, int m)
+	{
+		const float s = 0.86602540378443864676f;		// sin(2 pi / 3)
+		float *r1 = re + m, *i1 = im + m, *r2 = re + 2*m, *i2 = im + 2*m;
+		for (int j = 0; j < m; j++)
+		{
+			float tr1 = r1[j] + r2[j], ti1 = i1[j] + i2[j];
+			float dr = r1[j] - r2[j], di = i1[j] - i2[j];
+			float ur = re[j] - 0.5f*tr1, ui = im[j] - 0.5f*ti1;
+			float vr = s*di, vi = -s*dr;					// -i s (x1 - x2)
+			re[j] += tr1;
+			im[j] += ti1;
+			twiddle(r1 + j, i1 + j, ur + vr, ui + vi, tr[j], ti[j]);
+			twiddle(r2 + j, i2 + j, ur - vr, ui - vi, tr[m + j], ti[m + j]);
+		}
+	}
+
+	static void butterfly4(float *re, float *im, const float *tr, const float *ti, int m)
+	{
+		float *r1 = re + m, *i1 = im + m, *r2 = re + 2*m, *i2 = im + 2*m, *r3 = re + 3*m, *i3 = im + 3*m;
+		for (int j = 0; j < m; j++)
+		{
+			float ar = re[j] + r2[j], ai = im[j] + i2[j];
+			float br = re[j] - r2[j], bi = im[j] - i2[j];
+			float cr = r1[j] + r3[j], ci = i1[j] + i3[j];
+			float dr = r1[j] - r3[j], di = i1[j] - i3[j];
+			re[j] = ar + cr;
+			im[j] = ai + ci;
+			twiddle(r1 + j, i1 + j, br + di, bi - dr, tr[j], ti[j]);			// b - i d
+			twiddle(r2 + j, i2 + j, ar - cr, ai - ci, tr[m + j], ti[m + j]);
+			twiddle(r3 + j, i3 + j, br - di, bi + dr, tr[2*m + j], ti[2*m + j]);	// b + i d
+		}
+	}
+
+	static void butterfly5(float *re, float *im, const float *tr, const float *ti, int m)
+	{
+		const float c1 = 0.30901699437494742410f,		// cos(2 pi / 5)
+					c2 = -0.80901699437494742410f,		// cos(4 pi / 5)
+					s1 = 0.95105651629515357212f,		// sin(2 pi / 5)
+					s2 = 0.58778525229247312917f;		// sin(4 pi / 5)
+		float *r1 = re + m, *i1 = im + m, *r2 = re + 2*m, *i2 = im + 2*m;
+		float *r3 = re + 3*m, *i3 = im + 3*m, *r4 = re + 4*m, *i4 = im + 4*m;
+		for (int j = 0; j < m; j++)
+		{
+			float t1r = r1[j] + r4[j], t1i = i1[j] + i4[j];
+			float t2r = r2[j] + r3[j], t2i = i2[j] + i3[j];
+			float d1r = r1[j] - r4[j], d1i = i1[j] - i4[j];
+			float d2r = r2[j] - r3[j], d2i = i2[j] - i3[j];
+			float a1r = re[j] + c1*t1r + c2*t2r, a1i = im[j] + c1*t1i + c2*t2i;
+			float a2r = re[j] + c2*t1r + c1*t2r, a2i = im[j] + c2*t1i + c1*t2i;
+			// b1 = -i (s1 d1 + s2 d2), b2 = -i (s2 d1 - s1 d2)
+			float b1r = s1*d1i + s2*d2i, b1i = -(s1*d1r + s2*d2r);
+			float b2r = s2*d1i - s1*d2i, b2i = -(s2*d1r - s1*d2r);
+			re[j] += t1r + t2r;
+			im[j] += t1i + t2i;
+			twiddle(r1 + j, i1 + j, a1r + b1r, a1i + b1i, tr[j], ti[j]);
+			twiddle(r2 + j, i2 + j, a2r + b2r, a2i + b2i, tr[m + j], ti[m + j]);
+			twiddle(r3 + j, i3 + j, a2r - b2r, a2i - b2i, tr[2*m + j], ti[2*m + j]);
+			twiddle(r4 + j, i4 + j, a1r - b1r, a1i - b1i, tr[3*m + j], ti[3*m + j]);
+		}
+	}
+
+	// X[k] = c[k] sum_n (x[n] c[n]) conj(c[k - n]) with c[n] = e^{-pi i n^2 / M},
+	// the convolution done with a power of two transform of P >= 2M - 1
+	void setupBluestein()
+	{
+		P = 1;
+		while (P < 2*M - 1)
+			P <<= 1;
+		bluestein = new pkmMixedRadixFFT(P);
+
+		chirpr = (float *)malloc(sizeof(float) * M);
+		chirpi = (float *)malloc(sizeof(float) * M);
+		for (int n = 0; n < M; n++) {
+			// n^2 mod 2M keeps the angle small for large n
+			long long q = ((long long)n * n) % (2LL * M);
+			double theta = -M_PI * (double)q / (double)M;
+			chirpr[n] = (float)cos(theta);
+			chirpi[n] = (float)sin(theta);
+		}
+
+		// transform of the conjugate chirp, wrapped for a circular
+		// convolution and pre-scaled by 1/P for the inverse
+		kernelr = (float *)calloc(P, sizeof(float));
+		kerneli = (float *)calloc(P, sizeof(float));
+		float scale = 1.0f / (float)P;
+		for (int n = 0; n < M; n++) {
+			kernelr[n] = chirpr[n] * scale;
+			kerneli[n] = -chirpi[n] * scale;
+			if (n) {
+				kernelr[P - n] = kernelr[n];
+				kerneli[P - n] = kerneli[n];
+			}
+		}
+		bluestein->forward(kernelr, kerneli);
+	}
+
+	void forwardBluestein(float *re, float *im)
+	{
+		// grow-only scratch, one per thread so the object stays shareable
+		static thread_local std::vector<float> scratch;
+		if ((int)scratch.size() < 2*P) {
+			scratch.resize(2*P);
+		}
+		float *ar = &scratch[0], *ai = &scratch[P];
+
+		for (int n = 0; n < M; n++) {
+			ar[n] = re[n]*chirpr[n] - im[n]*chirpi[n];
+			ai[n] = re[n]*chirpi[n] + im[n]*chirpr[n];
+		}
+		for (int n = M; n < P; n++) {
+			ar[n] = 0.0f;
+			ai[n] = 0.0f;
+		}
+
+		bluestein->forward(ar, ai);
+		for (int k = 0; k < P; k++) {
+			float r = ar[k]*kernelr[k] - ai[k]*kerneli[k];
+			ai[k] = ar[k]*kerneli[k] + ai[k]*kernelr[k];
+			ar[k] = r;
+		}
+		// swapped arrays give the inverse
+		bluestein->forward(ai, ar);
+
+		for (int k = 0; k < M; k++) {
+			re[k] = ar[k]*chirpr[k] - ai[k]*chirpi[k];
+			im[k] = ar[k]*chirpi[k] + ai[k]*chirpr[k];
+		}
+	}
+
+	int					M;
+
+	// mixed radix
+	std::vector<int>	radices,
+						twiddleOffsets;
+	float				*twr,
+						*twi;
+	int					*cycles,
+						numCycleEntries;
+
+	// Bluestein
+	pkmMixedRadixFFT	*bluestein;
+	int					P;
+	float				*chirpr,
+						*chirpi,
+						*kernelr,
+						*kerneli;
+};
@@ -0,0 +1,6 @@
+/*
+ *  pkmRealFFT.cpp
+ *
+ */
+
+#include "pkmRealFFT.h"
\ No newline at end of file
@@ -0,0 +1,312 @@
+/*
+ *  pkmRealFFT.h
+ *
+ *  Native real FFT engine with the same packing and scaling as Accelerate's
+ *  vDSP_fft_zrip, so it can sit underneath pkmFFT on platforms without
+ *  Accelerate.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Packing (identical to vDSP_fft_zrip):
+ *
+ *  An N point real signal x is held as N/2 complex values in split form,
+ *  evens in realp and odds in imagp (what vDSP_ctoz produces).  After
+ *  forward(), realp[0] holds the DC term, imagp[0] the Nyquist term and
+ *  (realp[k], imagp[k]) bin k for 0 < k < N/2, all scaled by 2 relative
+ *  to the mathematical DFT.  inverse() takes the same packing and returns
+ *  the signal scaled by N, so forward() followed by inverse() scales by 2N.
+ *
+ *  The N/2 point complex transform underneath is an in-place radix-2^2
+ *  decimation-in-frequency FFT whose butterfly passes are dispatched to
+ *  SSE, AVX2 or NEON kernels (pkmFFTKernels.h).  forwardLanes() runs the
+ *  same transform on 4 or 8 frames at once, one frame per vector lane.
+ *
+ *  Any other even N (480, 960, 1764, ...) uses pkmMixedRadixFFT for the
+ *  N/2 point complex transform instead, with the same packing and scaling;
+ *  getLanes() is 1 for those sizes.  Odd N cannot be packed this way and
+ *  is rejected: isValid() is false and the transforms leave the data as
+ *  it is.
+ *
+ *  Usage:
+ *
+ *  pkmRealFFT *engine = new pkmRealFFT(1024);
+ *  engine->forward(split_data.realp, split_data.imagp);
+ *  engine->inverse(split_data.realp, split_data.imagp);
+ *
+ *  // getLanes() frames, element k of frame l at [k*getLanes() + l]
+ *  engine->forwardLanes(lane_data.realp, lane_data.imagp);
+ *  delete engine;
+ *
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "pkmFFTKernels.h"
+#include "pkmMixedRadixFFT.h"
+
+class pkmRealFFT
+{
+public:
+
+	pkmRealFFT(int size, pkmFFTISA instruction_set = PKM_FFT_ISA_AUTO)
+	{
+		// odd N has no packed form, so there is no plan and the transforms
+		// do nothing (isValid() is false)
+		if (size < 2 || (size & 1)) {
+			printf("[ERROR] pkmRealFFT: size %d is not even\n", size);
+			size = 0;
+		}
+		fftSize = size;
+		fftSizeOver2 = fftSize/2;
+
+		if (instruction_set == PKM_FFT_ISA_AUTO || !pkmFFTISASupported(instruction_set)) {
+			isa = pkmFFTDetectISA();
+		}
+		else {
+			isa = instruction_set;
+		}
+		stage = pkmFFTGetStageKernel(isa);
+		stage4 = pkmFFTGetStage4Kernel(isa);
+		lanes = pkmFFTGetLanes(isa);
+		stageLanes = pkmFFTGetStageLanesKernel(isa);
+		stage4Lanes = pkmFFTGetStage4LanesKernel(isa);
+
+		// N/2 not a power of two goes through the mixed radix engine
+		mixed = NULL;
+		if (fftSizeOver2 && (fftSizeOver2 & (fftSizeOver2 - 1))) {
+			mixed = new pkmMixedRadixFFT(fftSizeOver2);
+			lanes = 1;
+		}
+
+		int M = fftSizeOver2;
+
+		// real <-> complex split twiddles, e^{-2 pi i k / N} for k <= N/4
+		splitCos = (float *)malloc(sizeof(float) * (M/2 + 1));
+		splitSin = (float *)malloc(sizeof(float) * (M/2 + 1));
+		for (int k = 0; k <= M/2; k++) {
+			double theta = 2.0 * M_PI * (double)k / (double)fftSize;
+			splitCos[k] = (float)cos(theta);
+			splitSin[k] = (float)sin(theta);
+		}
+
+		// power of two tables
+		twr = twi = NULL;
+		swaps = NULL;
+		numSwaps = 0;
+		log2M = 0;
+		if (fftSizeOver2 && !mixed) {
+			// complex twiddles, stage with half-length h uses tw[h .. 2h-1]
+			twr = (float *)malloc(sizeof(float) * (M > 1 ? M : 2));
+			twi = (float *)malloc(sizeof(float) * (M > 1 ? M : 2));
+			for (int h = 1; h < M; h <<= 1) {
+				for (int j = 0; j < h; j++) {
+					double theta = M_PI * (double)j / (double)h;
+					twr[h + j] = (float)cos(theta);
+					twi[h + j] = (float)-sin(theta);
+				}
+			}
+
+			// bit reversal swap list
+			while ((1 << log2M) < M)
+				log2M++;
+			swaps = (int *)malloc(sizeof(int) * (M > 1 ? M : 2));
+			for (int i = 0; i < M; i++) {
+				int r = 0;
+				for (int b = 0; b < log2M; b++)
+					r |= ((i >> b) & 1) << (log2M - 1 - b);
+				if (i < r) {
+					swaps[numSwaps++] = i;
+					swaps[numSwaps++] = r;
+				}
+			}
+		}
+	}
+
+	~pkmRealFFT()
+	{
+		free(twr);
+		free(twi);
+		free(splitCos);
+		free(splitSin);
+		free(swaps);
+		delete mixed;
+	}
+
+	// in-place forward transform of vDSP_ctoz packed data
+	void forward(float *realp, float *imagp)
+	{
+		if (!fftSizeOver2)
+			return;
+		complexTransform(realp, imagp, 1, stage, stage4);
+		untangle(realp, imagp, 1);
+	}
+
+	// in-place forward transform of getLanes() frames at once, interleaved so
+	// that element k of frame l is at realp[k*getLanes() + l] (and imagp)
+	void forwardLanes(float *realp, float *imagp)
+	{
+		if (!fftSizeOver2)
+			return;
+		complexTransform(realp, imagp, lanes, stageLanes, stage4Lanes);
+		untangle(realp, imagp, lanes);
+	}
+
+	// in-place inverse transform back to vDSP_ctoz packed data
+	void inverse(float *realp, float *imagp)
+	{
+		int M = fftSizeOver2;
+		if (!M)
+			return;
+
+		float dc = realp[0], ny = imagp[0];
+		realp[0] = dc + ny;
+		imagp[0] = dc - ny;
+
+		for (int k = 1; k <= M/2; k++)
+		{
+			int nk = M - k;
+			float c = splitCos[k], s = splitSin[k];
+			float sr = realp[k] + realp[nk], si = imagp[k] - imagp[nk];
+			float dr = realp[k] - realp[nk], di = imagp[k] + imagp[nk];
+			float tr = -(c*di + s*dr), ti = c*dr - s*di;
+			realp[k] = sr + tr;
+			imagp[k] = si + ti;
+			realp[nk] = sr - tr;
+			imagp[nk] = -(si - ti);
+		}
+
+		// conj(FFT(conj(z))) is the unscaled inverse, and swapping the real
+		// and imaginary arrays is the same as conjugating (up to a factor i
+		// which the second swap cancels)
+		complexTransform(imagp, realp, 1, stage, stage4);
+	}
+
+	// false for a size that was rejected
+	inline bool isValid()
+	{
+		return fftSizeOver2 > 0;
+	}
+
+	inline pkmFFTISA getISA()
+	{
+		return isa;
+	}
+
+	inline int getLanes()
+	{
+		return lanes;
+	}
+
+	int					fftSize,
+						fftSizeOver2;
+
+private:
+
+	// unscaled in-place forward complex FFT of N/2 points, on L interleaved
+	// frames when L > 1
+	void complexTransform(float *re, float *im, int L,
+						  pkmFFTStageFn radix2, pkmFFTStage4Fn radix4)
+	{
+		if (mixed) {
+			mixed->forward(re, im);
+			return;
+		}
+
+		int M = fftSizeOver2;
+
+		int h = M/2;
+		if (log2M & 1) {
+			radix2(re, im, twr, twi, M, h);
+			h >>= 1;
+		}
+		for (; h >= 2; h >>= 2)
+			radix4(re, im, twr, twi, M, h/2);
+
+		for (int s = 0; s < numSwaps; s += 2)
+		{
+			float *ra = re + swaps[s]*L, *rb = re + swaps[s+1]*L;
+			float *ia = im + swaps[s]*L, *ib = im + swaps[s+1]*L;
+			for (int l = 0; l < L; l++) {
+				float t = ra[l]; ra[l] = rb[l]; rb[l] = t;
+				t = ia[l]; ia[l] = ib[l]; ib[l] = t;
+			}
+		}
+	}
+
+	// turn the N/2 point complex spectrum of the even/odd samples into the
+	// packed N point real spectrum, bins k and M-k together
+	void untangle(float *realp, float *imagp, int L)
+	{
+		int M = fftSizeOver2;
+
+		// DC and Nyquist share the first bin
+		for (int l = 0; l < L; l++) {
+			float r0 = realp[l], i0 = imagp[l];
+			realp[l] = 2.0f * (r0 + i0);
+			imagp[l] = 2.0f * (r0 - i0);
+		}
+
+		for (int k = 1; k <= M/2; k++)
+		{
+			float c = splitCos[k], s = splitSin[k];
+			float *rk = realp + k*L, *ik = imagp + k*L;
+			float *rn = realp + (M - k)*L, *in = imagp + (M - k)*L;
+			for (int l = 0; l < L; l++)
+			{
+				float sr = rk[l] + rn[l], si = ik[l] - in[l];
+				float dr = rk[l] - rn[l], di = ik[l] + in[l];
+				float tr = s*dr - c*di, ti = c*dr + s*di;
+				rk[l] = sr - tr;
+				ik[l] = si - ti;
+				rn[l] = sr + tr;
+				in[l] = -(si + ti);
+			}
+		}
+	}
+
+	pkmFFTISA			isa;
+	pkmFFTStageFn		stage;
+	pkmFFTStage4Fn		stage4;
+	pkmFFTStageFn		stageLanes;
+	pkmFFTStage4Fn		stage4Lanes;
+	int					lanes;
+
+	pkmMixedRadixFFT	*mixed;
+
+	float				*twr,
+						*twi,
+						*splitCos,
+						*splitSin;
+
+	int					*swaps,
+						numSwaps,
+						log2M;
+};
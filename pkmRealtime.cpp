@@ -0,0 +1,80 @@
+/*
+ *  pkmRealtime.cpp
+ *
+ */
+
+#include "pkmRealtime.h"
+
+#ifdef PKM_REALTIME_DEBUG
+
+#include <stdlib.h>
+#include <assert.h>
+#include <new>
+
+// initial-exec so that reading it never allocates, even from a shared library
+#if defined(__GNUC__)
+static thread_local int realtimeDepth __attribute__((tls_model("initial-exec"))) = 0;
+static thread_local int realtimeSuspended __attribute__((tls_model("initial-exec"))) = 0;
+#else
+static thread_local int realtimeDepth = 0;
+static thread_local int realtimeSuspended = 0;
+#endif
+
+void pkmRealtimeEnter()		{ realtimeDepth++; }
+void pkmRealtimeLeave()		{ realtimeDepth--; }
+void pkmRealtimeSuspend()	{ realtimeSuspended++; }
+void pkmRealtimeResume()	{ realtimeSuspended--; }
+
+static inline void checkRealtime()
+{
+	if (realtimeDepth > 0 && realtimeSuspended == 0) {
+		// off first, assert's own message may allocate
+		realtimeDepth = 0;
+		assert(!"heap used inside a pkmRealtimeScope");
+		abort();
+	}
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size)				{ checkRealtime(); return __libc_malloc(size); }
+void *calloc(size_t count, size_t size)	{ checkRealtime(); return __libc_calloc(count, size); }
+void *realloc(void *ptr, size_t size)	{ checkRealtime(); return __libc_realloc(ptr, size); }
+void free(void *ptr)					{ if (ptr) checkRealtime(); __libc_free(ptr); }
+}
+#endif
+
+void *operator new(size_t size)
+{
+	checkRealtime();
+	void *p = malloc(size ? size : 1);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	if (ptr) {
+		checkRealtime();
+	}
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	operator delete(ptr);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ *  pkmRealtime.h
+ *
+ *  Marks code that runs in the audio callback.  Built with
+ *  -DPKM_REALTIME_DEBUG (and pkmRealtime.cpp linked in), any operator
+ *  new/delete, or malloc/calloc/realloc/free on glibc, made on a thread
+ *  while a pkmRealtimeScope is alive on it asserts.  Otherwise the scopes
+ *  are empty and compile away.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  void audioCallback(...)
+ *  {
+ *      pkmRealtimeScope realtime;		// no heap from here on
+ *      ...
+ *      {
+ *          pkmRealtimeAllow known;		// a third party call that allocates
+ *          ...
+ *      }
+ *  }
+ *
+ */
+
+#pragma once
+
+#ifdef PKM_REALTIME_DEBUG
+
+// defined in pkmRealtime.cpp
+void pkmRealtimeEnter();
+void pkmRealtimeLeave();
+void pkmRealtimeSuspend();
+void pkmRealtimeResume();
+
+struct pkmRealtimeScope
+{
+	pkmRealtimeScope()		{ pkmRealtimeEnter(); }
+	~pkmRealtimeScope()		{ pkmRealtimeLeave(); }
+};
+
+// lifts the check for a known allocating call inside a scope
+struct pkmRealtimeAllow
+{
+	pkmRealtimeAllow()		{ pkmRealtimeSuspend(); }
+	~pkmRealtimeAllow()		{ pkmRealtimeResume(); }
+};
+
+#else
+
+struct pkmRealtimeScope
+{
+	pkmRealtimeScope()		{}
+};
+
+struct pkmRealtimeAllow
+{
+	pkmRealtimeAllow()		{}
+};
+
+#endif
@@ -43,18 +43,26 @@
  *  fft.ISTFT(sample_data, buffer_size, magnitude_matrix, phase_matrix);
  *  delete stft;
  *
+ *  For long buffers, spread the windows over 8 cores (output is identical
+ *  to the serial path, bit for bit):
+ *
+ *  stft = new pkmSTFT(512, 8);
+ *
  */
 #pragma once
 
-#include <Accelerate/Accelerate.h>
+#include "pkmDSP.h"
 #include "pkmFFT.h"
 #include "pkmMatrix.h"
+#include "pkmThreadPool.h"
+#include <vector>
+using namespace std;
 
 class pkmSTFT
 {
 public:
 
-	pkmSTFT(int size)
+	pkmSTFT(int size, int num_threads = 1)
 	{
 		fftSize = size;
 		numFFTs = 0;
@@ -63,11 +71,35 @@ public:
 		windowSize = fftSize;
 		bufferSize = 0;
 		
+		pool = NULL;
+		numThreads = 1;
+		seamTileSize = 0;
+		
 		initializeFFTParameters(fftSize, windowSize, hopSize);
+		setNumThreads(num_threads);
 	}
 	~pkmSTFT()
 	{
-		free(FFT);
+		releaseWorkers();
+		delete FFT;
+	}
+	
+	// split the windows of STFT/ISTFT over num_threads cores (1 is serial),
+	// each thread with its own pkmFFT scratch
+	void setNumThreads(int num_threads)
+	{
+		releaseWorkers();
+		if (num_threads <= 1) {
+			return;
+		}
+		
+		pool = new pkmThreadPool(num_threads);
+		numThreads = pool->getNumThreads();
+		for (int i = 0; i < numThreads; i++) {
+			workerFFTs.push_back(new pkmFFT(fftSize));
+			workerFrames.push_back((float *)malloc(sizeof(float) * fftSize));
+			seamTiles.push_back((float *)NULL);
+		}
 	}
 	
 	void initializeFFTParameters(int _fftSize, int _windowSize, int _hopSize)
@@ -90,9 +122,9 @@ public:
 			printf("Padding %d sample buffer with %d samples\n", bufSize, padding);
 			padBufferSize = bufSize + padding;
 			padBuf = (float *)malloc(sizeof(float)*padBufferSize);
-			// set padding to 0
+			// set padding to 0 (on both sides, the signal is centered at shift)
 			//memset(&(padBuf[bufSize]), 0, sizeof(float)*padding);
-			vDSP_vclr(padBuf + bufSize, 1, padding);
+			vDSP_vclr(padBuf, 1, padBufferSize);
 			// copy original buffer into padded one
 			//memcpy(padBuf, buf, sizeof(float)*bufSize);	
 		
@@ -106,22 +138,30 @@ public:
 		// create output fft matrix
 		numWindows = (padBufferSize - fftSize)/hopSize + 1;
 		
-		if (M_magnitudes.rows != numWindows && M_magnitudes.cols != fftBins) {
+		if (M_magnitudes.rows != numWindows || M_magnitudes.cols != fftBins) {
 			M_magnitudes.reset(numWindows, fftBins, true);
 			M_phases.reset(numWindows, fftBins, true);
 		}
 		
-		// stft
-		for (int i = 0; i < numWindows; i++) {
-			
-			// get current col of freq mat
-			float *magnitudes = M_magnitudes.row(i);
-			float *phases = M_phases.row(i);
-			float *buffer = padBuf + i*hopSize;
-			
-			FFT->forward(0, buffer, magnitudes, phases);	
-			
+		// stft, every hop straight into its row of the output matrices
+		if (pool && numWindows > FFT->lanes) 
+		{
+			// chunks of whole lane groups so every frame is transformed 
+			// exactly as in the serial path
+			int lanes = FFT->lanes;
+			int chunk = (numWindows + numThreads - 1) / numThreads;
+			chunk = ((chunk + lanes - 1) / lanes) * lanes;
+			int numTasks = (numWindows + chunk - 1) / chunk;
 			
+			pool->run(numTasks, [&](int task, int worker) {
+				int begin = task * chunk;
+				int count = MIN(chunk, numWindows - begin);
+				workerFFTs[worker]->forwardBatch(padBuf + begin*hopSize, hopSize, count, 
+												 M_magnitudes.row(begin), M_phases.row(begin));
+			});
+		}
+		else {
+			FFT->forwardBatch(padBuf, hopSize, numWindows, M_magnitudes.row(0), M_phases.row(0));
 		}
 		// release padded buffer
 		if (padding) {
@@ -149,13 +189,24 @@ public:
 		
 		pkm::Mat M_istft(padBufferSize, 1, padBuf, false);
 		
-		for(int i = 0; i < numWindows; i++)
+		// windows overlapping the start of a later window's span
+		int overlapWindows = (fftSize + hopSize - 1) / hopSize - 1;
+		int numTasks = pool ? MIN(numThreads, numWindows / (overlapWindows + 1)) : 1;
+		
+		if (numTasks > 1) 
 		{
-			float *buffer = padBuf + i*hopSize;
-			float *magnitudes = M_magnitudes.row(i);
-			float *phases = M_phases.row(i);
-			
-			FFT->inverse(0, buffer, magnitudes, phases);
+			parallelOverlapAdd(padBuf, M_magnitudes, M_phases, numTasks, overlapWindows);
+		}
+		else 
+		{
+			for(int i = 0; i < numWindows; i++)
+			{
+				float *buffer = padBuf + i*hopSize;
+				float *magnitudes = M_magnitudes.row(i);
+				float *phases = M_phases.row(i);
+				
+				FFT->inverse(0, buffer, magnitudes, phases);
+			}
 		}
 
 		//memcpy(buf, padBuf, sizeof(float)*bufSize);
@@ -170,6 +221,94 @@ public:
 	
 private:
 	
+	// Overlap-add of numWindows inverse frames split into numTasks runs of
+	// consecutive windows.  Every sample is added to directly by the first
+	// task whose windows cover it, in window order, just as in the serial 
+	// loop.  The first overlapWindows frames of every later task also land
+	// on samples the previous task is still adding to (the seam), so those 
+	// frames are kept in a per-task tile and added afterwards, again in 
+	// window order.  Each sample therefore sees the same sequence of float 
+	// additions as in the serial path and the result is bit-identical.
+	void parallelOverlapAdd(float *padBuf, 
+							pkm::Mat &M_magnitudes, 
+							pkm::Mat &M_phases, 
+							int numTasks, 
+							int overlapWindows)
+	{
+		if (seamTileSize < overlapWindows * fftSize) {
+			seamTileSize = overlapWindows * fftSize;
+			for (int t = 0; t < numThreads; t++) {
+				free(seamTiles[t]);
+				seamTiles[t] = (float *)malloc(sizeof(float) * seamTileSize);
+			}
+		}
+		
+		pool->run(numTasks, [&](int task, int worker) {
+			int begin = task * numWindows / numTasks;
+			int end = (task + 1) * numWindows / numTasks;
+			
+			// samples before this belong to the previous task's seam
+			int seamEnd = task ? (begin - 1)*hopSize + fftSize : 0;
+			
+			for (int i = begin; i < end; i++) 
+			{
+				bool inSeam = task && (i - begin) < overlapWindows;
+				float *frame = inSeam ? seamTiles[task] + (i - begin)*fftSize : workerFrames[worker];
+				
+				workerFFTs[worker]->inverseFrame(M_magnitudes.row(i), M_phases.row(i), frame);
+				
+				int start = i*hopSize;
+				int skip = MAX(0, seamEnd - start);
+				if (skip < fftSize) {
+					vDSP_vadd(padBuf + start + skip, 1, frame + skip, 1, 
+							  padBuf + start + skip, 1, fftSize - skip);
+				}
+			}
+		});
+		
+		// seam merge, in window order
+		for (int task = 1; task < numTasks; task++)
+		{
+			int begin = task * numWindows / numTasks;
+			int end = (task + 1) * numWindows / numTasks;
+			int seamEnd = (begin - 1)*hopSize + fftSize;
+			
+			for (int i = begin; i < end && (i - begin) < overlapWindows; i++)
+			{
+				int start = i*hopSize;
+				int n = MIN(fftSize, seamEnd - start);
+				if (n > 0) {
+					vDSP_vadd(padBuf + start, 1, seamTiles[task] + (i - begin)*fftSize, 1, 
+							  padBuf + start, 1, n);
+				}
+			}
+		}
+	}
+	
+	void releaseWorkers()
+	{
+		for (size_t i = 0; i < workerFFTs.size(); i++) {
+			delete workerFFTs[i];
+			free(workerFrames[i]);
+			free(seamTiles[i]);
+		}
+		workerFFTs.clear();
+		workerFrames.clear();
+		seamTiles.clear();
+		seamTileSize = 0;
+		
+		delete pool;
+		pool = NULL;
+		numThreads = 1;
+	}
+	
+	pkmThreadPool		*pool;
+	vector<pkmFFT *>	workerFFTs;
+	vector<float *>		workerFrames,
+						seamTiles;
+	int					seamTileSize,
+						numThreads;
+	
 	
 	int				sampleRate,
 						numFFTs,
@@ -0,0 +1,6 @@
+/*
+ *  pkmSampleTypes.cpp
+ *
+ */
+
+#include "pkmSampleTypes.h"
@@ -0,0 +1,169 @@
+/*
+ *  pkmSampleTypes.h
+ *
+ *  Sample types for the feature pipeline.  float and double are computed
+ *  in directly; pkmHalf (IEEE 754 binary16) and pkmBFloat16 are storage
+ *  only, e.g. to keep a large feature database in a quarter of the memory
+ *  of doubles, and are computed in float.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  The feature database stores pkmFeature, double unless PKM_FEATURE_TYPE
+ *  is defined before including anything, e.g. -DPKM_FEATURE_TYPE=pkmHalf.
+ *
+ */
+
+#pragma once
+
+#include <string.h>
+#include <stdint.h>
+
+// IEEE 754 half precision, round to nearest even on the way in
+struct pkmHalf
+{
+	uint16_t			bits;
+
+	pkmHalf() : bits(0) {}
+	pkmHalf(float f) : bits(fromFloat(f)) {}
+
+	operator float() const
+	{
+		return toFloat(bits);
+	}
+
+	static uint16_t fromFloat(float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+
+		uint32_t sign = (x >> 16) & 0x8000;
+		uint32_t mantissa = x & 0x007fffff;
+		int exponent = (int)((x >> 23) & 0xff) - 127 + 15;
+
+		// inf and nan (keep nan quiet)
+		if (((x >> 23) & 0xff) == 0xff) {
+			return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+		}
+		// overflow to inf
+		if (exponent >= 0x1f) {
+			return (uint16_t)(sign | 0x7c00);
+		}
+		// subnormal or zero
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return (uint16_t)sign;
+			}
+			mantissa |= 0x00800000;
+			int shift = 14 - exponent;
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1))) {
+				half++;
+			}
+			return (uint16_t)(sign | half);
+		}
+
+		uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+		uint32_t rest = mantissa & 0x1fff;
+		// a carry out of the mantissa bumps the exponent, which is right
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+			half++;
+		}
+		return (uint16_t)half;
+	}
+
+	static float toFloat(uint16_t h)
+	{
+		uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		uint32_t exponent = (h >> 10) & 0x1f;
+		uint32_t mantissa = h & 0x3ff;
+		uint32_t x;
+
+		if (exponent == 0x1f) {
+			x = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else if (exponent) {
+			x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		}
+		else if (mantissa) {
+			// renormalize the subnormal
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				exponent--;
+			}
+			x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+		}
+		else {
+			x = sign;
+		}
+
+		float f;
+		memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+};
+
+// bfloat16, the top half of a float rounded to nearest even; same range as
+// float with 8 bits of mantissa
+struct pkmBFloat16
+{
+	uint16_t			bits;
+
+	pkmBFloat16() : bits(0) {}
+	pkmBFloat16(float f) : bits(fromFloat(f)) {}
+
+	operator float() const
+	{
+		uint32_t x = (uint32_t)bits << 16;
+		float f;
+		memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+
+	static uint16_t fromFloat(float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		if ((x & 0x7fffffff) > 0x7f800000) {
+			return (uint16_t)((x >> 16) | 0x40);
+		}
+		x += 0x7fff + ((x >> 16) & 1);
+		return (uint16_t)(x >> 16);
+	}
+};
+
+// type the pipeline computes in for a given storage type
+template <typename T> struct pkmComputeType		{ typedef float type; };
+template <> struct pkmComputeType<double>		{ typedef double type; };
+
+#ifndef PKM_FEATURE_TYPE
+#define PKM_FEATURE_TYPE double
+#endif
+
+typedef PKM_FEATURE_TYPE pkmFeature;
@@ -29,7 +29,7 @@
 
 #pragma once
 
-#include <Accelerate/Accelerate.h>
+#include "pkmDSP.h"
 #include "pkmAudioFeatures.h"
 #include "pkmMatrix.h"
 #include "pkmRecorder.h"
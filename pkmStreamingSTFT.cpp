@@ -0,0 +1,6 @@
+/*
+ *  pkmStreamingSTFT.cpp
+ *
+ */
+
+#include "pkmStreamingSTFT.h"
@@ -0,0 +1,323 @@
+/*
+ *  pkmStreamingSTFT.h
+ *
+ *  Block-at-a-time STFT and ISTFT (pkmFFT) for signals that are too long to
+ *  hold in memory or that arrive live.  Only O(fftSize) samples of history
+ *  are ever kept.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Frame k covers samples [k*hopSize, k*hopSize + fftSize) of everything
+ *  pushed so far, the same framing as pkmSTFT on an unpadded buffer.
+ *
+ *  Usage:
+ *
+ *  pkmStreamingSTFT *stft = new pkmStreamingSTFT(2048, 512);
+ *
+ *  // either get a callback per frame
+ *  stft->setCallback([&](float *magnitudes, float *phases, long frame) {
+ *		...
+ *  });
+ *
+ *  // or have the frames inserted into rings of the last 64 frames
+ *  pkm::Mat magnitude_ring(64, 1024), phase_ring(64, 1024);
+ *  stft->setOutput(&magnitude_ring, &phase_ring);
+ *
+ *  while (reading)
+ *		stft->push(block, block_size);		// any block size
+ *  stft->flush();							// zero pad the last samples
+ *
+ *  pkmStreamingISTFT *istft = new pkmStreamingISTFT(2048, 512);
+ *  float *out = (float *)malloc(sizeof(float) * 2048);
+ *  int n = istft->push(magnitudes, phases, out);	// n = 512 samples done
+ *  n = istft->flush(out);							// the overlap-add tail
+ *
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include "pkmDSP.h"
+#include "pkmFFT.h"
+#include "pkmMatrix.h"
+#include <functional>
+
+class pkmStreamingSTFT
+{
+public:
+	typedef std::function<void(float *magnitudes, float *phases, long frame)> FrameCallback;
+
+	pkmStreamingSTFT(int fft_size = 512, int hop_size = 0)
+	{
+		fftSize = fft_size;
+		fftBins = fftSize/2;
+		hopSize = hop_size > 0 ? hop_size : MAX(fftSize/4, 1);
+		// frames have to overlap or touch, the history doesn't skip gaps
+		if (hopSize > fftSize) {
+			printf("[ERROR] pkmStreamingSTFT: hop size %d is longer than a frame, using %d\n", hopSize, fftSize);
+			hopSize = fftSize;
+		}
+
+		FFT = new pkmFFT(fftSize);
+
+		// room for one frame plus a few hops, so several frames can go
+		// through forwardBatch together (and the overlap is moved back less
+		// often)
+		capacity = fftSize + MAX(fftSize, 15*hopSize);
+		maxFrames = (capacity - fftSize)/hopSize + 1;
+		history = (float *)malloc(sizeof(float) * capacity);
+		magnitudes = (float *)malloc(sizeof(float) * maxFrames * fftBins);
+		phases = (float *)malloc(sizeof(float) * maxFrames * fftBins);
+
+		M_magnitudes = NULL;
+		M_phases = NULL;
+		bPhases = true;
+
+		reset();
+	}
+
+	~pkmStreamingSTFT()
+	{
+		delete FFT;
+		free(history);
+		free(magnitudes);
+		free(phases);
+	}
+
+	void setCallback(FrameCallback callback)
+	{
+		frameCallback = callback;
+	}
+
+	// frames are added with insertRowCircularly, rings need fftSize/2 columns
+	void setOutput(pkm::Mat *magnitude_ring, pkm::Mat *phase_ring)
+	{
+		M_magnitudes = magnitude_ring;
+		M_phases = phase_ring;
+	}
+
+	// skip the phases (the callback gets NULL), e.g. for features
+	void setPhases(bool compute_phases)
+	{
+		bPhases = compute_phases;
+	}
+
+	void reset()
+	{
+		filled = 0;
+		readPos = 0;
+		numFrames = 0;
+		numSamples = 0;
+	}
+
+	// analyze a block of any size
+	void push(const float *samples, int n)
+	{
+		numSamples += n;
+		append(samples, n);
+	}
+
+	// zero pad until every pushed sample has been in at least one frame
+	void flush()
+	{
+		if (numSamples == 0) {
+			return;
+		}
+		long needed = numSamples <= fftSize ? 1 : (numSamples - fftSize + hopSize - 1)/hopSize + 1;
+		if (needed <= numFrames) {
+			return;
+		}
+		append(NULL, (int)((needed - 1)*hopSize + fftSize - numSamples));
+	}
+
+	inline long getNumFrames()
+	{
+		return numFrames;
+	}
+
+	inline int getNumBins()
+	{
+		return fftBins;
+	}
+
+	inline int getHopSize()
+	{
+		return hopSize;
+	}
+
+	pkmFFT				*FFT;
+
+private:
+
+	// copy n samples (zeros if samples is NULL) into the history, emitting
+	// frames as they complete
+	void append(const float *samples, int n)
+	{
+		while (n > 0)
+		{
+			int count = MIN(n, capacity - filled);
+			if (samples) {
+				cblas_scopy(count, samples, 1, history + filled, 1);
+				samples += count;
+			}
+			else {
+				vDSP_vclr(history + filled, 1, count);
+			}
+			filled += count;
+			n -= count;
+
+			processFrames();
+
+			// keep only what later frames still need
+			if (readPos > 0) {
+				memmove(history, history + readPos, sizeof(float) * (filled - readPos));
+				filled -= readPos;
+				readPos = 0;
+			}
+		}
+	}
+
+	// transform every complete frame in the history
+	void processFrames()
+	{
+		int count = (filled - readPos - fftSize) / hopSize + 1;
+		if (filled - readPos < fftSize || count <= 0) {
+			return;
+		}
+
+		FFT->forwardBatch(history + readPos, hopSize, count, magnitudes, bPhases ? phases : NULL);
+
+		for (int i = 0; i < count; i++)
+		{
+			float *m = magnitudes + i*fftBins, *p = bPhases ? phases + i*fftBins : NULL;
+			if (M_magnitudes) {
+				M_magnitudes->insertRowCircularly(m);
+			}
+			if (M_phases && p) {
+				M_phases->insertRowCircularly(p);
+			}
+			if (frameCallback) {
+				frameCallback(m, p, numFrames);
+			}
+			numFrames++;
+		}
+		readPos += count*hopSize;
+	}
+
+	FrameCallback		frameCallback;
+	pkm::Mat			*M_magnitudes,
+						*M_phases;
+
+	float				*history,
+						*magnitudes,
+						*phases;
+
+	int					fftSize,
+						fftBins,
+						hopSize,
+						capacity,
+						maxFrames,
+						filled,
+						readPos;
+
+	long				numFrames,
+						numSamples;
+	bool				bPhases;
+};
+
+class pkmStreamingISTFT
+{
+public:
+
+	pkmStreamingISTFT(int fft_size = 512, int hop_size = 0)
+	{
+		fftSize = fft_size;
+		hopSize = hop_size > 0 ? hop_size : MAX(fftSize/4, 1);
+		// a longer hop would leave gaps the overlap-add can't fill
+		if (hopSize > fftSize) {
+			printf("[ERROR] pkmStreamingISTFT: hop size %d is longer than a frame, using %d\n", hopSize, fftSize);
+			hopSize = fftSize;
+		}
+
+		FFT = new pkmFFT(fftSize);
+
+		accumulator = (float *)malloc(sizeof(float) * fftSize);
+		frame = (float *)malloc(sizeof(float) * fftSize);
+
+		reset();
+	}
+
+	~pkmStreamingISTFT()
+	{
+		delete FFT;
+		free(accumulator);
+		free(frame);
+	}
+
+	void reset()
+	{
+		vDSP_vclr(accumulator, 1, fftSize);
+	}
+
+	// overlap-add one frame, writes the hopSize samples that no later frame
+	// can touch anymore to output and returns how many that is
+	int push(float *magnitudes, float *phases, float *output)
+	{
+		FFT->inverseFrame(magnitudes, phases, frame);
+		vDSP_vadd(accumulator, 1, frame, 1, accumulator, 1, fftSize);
+
+		cblas_scopy(hopSize, accumulator, 1, output, 1);
+		memmove(accumulator, accumulator + hopSize, sizeof(float) * (fftSize - hopSize));
+		vDSP_vclr(accumulator + fftSize - hopSize, 1, hopSize);
+
+		return hopSize;
+	}
+
+	// the remaining overlap-add tail after the last frame
+	int flush(float *output)
+	{
+		int n = fftSize - hopSize;
+		cblas_scopy(n, accumulator, 1, output, 1);
+		reset();
+		return n;
+	}
+
+	inline int getHopSize()
+	{
+		return hopSize;
+	}
+
+	pkmFFT				*FFT;
+
+private:
+
+	float				*accumulator,
+						*frame;
+
+	int					fftSize,
+						hopSize;
+};
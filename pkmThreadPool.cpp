@@ -0,0 +1,6 @@
+/*
+ *  pkmThreadPool.cpp
+ *
+ */
+
+#include "pkmThreadPool.h"
\ No newline at end of file
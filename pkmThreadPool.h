@@ -0,0 +1,223 @@
+/*
+ *  pkmThreadPool.h
+ *
+ *  Small fixed-size worker pool for splitting long offline jobs (e.g. the
+ *  windows of an STFT) across cores.  Requires C++11 threads.
+ *
+ *  Created by Parag K. Mital - http://pkmital.com
+ *  Contact: parag@pkmital.com
+ *
+ *  Copyright 2011 Parag K. Mital. All rights reserved.
+ *
+ *	Permission is hereby granted, free of charge, to any person
+ *	obtaining a copy of this software and associated documentation
+ *	files (the "Software"), to deal in the Software without
+ *	restriction, including without limitation the rights to use,
+ *	copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the
+ *	Software is furnished to do so, subject to the following
+ *	conditions:
+ *
+ *	The above copyright notice and this permission notice shall be
+ *	included in all copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *	OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *  Usage:
+ *
+ *  pkmThreadPool *pool = new pkmThreadPool(8);
+ *
+ *  // task is in [0, 100), worker in [0, pool->getNumThreads()) and can be
+ *  // used to pick per-thread scratch; the calling thread is worker 0
+ *  pool->run(100, [&](int task, int worker) {
+ *		process(task, scratch[worker]);
+ *  });
+ *
+ *  // or the other threads start on them while the caller does something
+ *  // else, and wait() joins in and returns once all are done
+ *  pool->start(100, job);
+ *  ...
+ *  pool->wait();
+ *  delete pool;
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+class pkmThreadPool
+{
+public:
+	typedef std::function<void(int task, int worker)> Job;
+
+	// num_threads includes the calling thread, 0 uses every core
+	pkmThreadPool(int num_threads = 0)
+	{
+		if (num_threads <= 0) {
+			num_threads = std::thread::hardware_concurrency();
+		}
+		if (num_threads <= 0) {
+			num_threads = 1;
+		}
+		numThreads = num_threads;
+
+		job = NULL;
+		numTasks = 0;
+		nextTask = 0;
+		pendingWorkers = 0;
+		generation = 0;
+		bQuit = false;
+
+		for (int i = 1; i < numThreads; i++) {
+			workers.push_back(std::thread(&pkmThreadPool::workerLoop, this, i));
+		}
+	}
+
+	~pkmThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			bQuit = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+
+	inline int getNumThreads()
+	{
+		return numThreads;
+	}
+
+	// run fn for every task in [0, num_tasks) and return once all are done
+	void run(int num_tasks, const Job &fn)
+	{
+		if (num_tasks <= 0) {
+			return;
+		}
+
+		// not worth waking anyone
+		if (num_tasks == 1 || numThreads == 1) {
+			for (int t = 0; t < num_tasks; t++) {
+				fn(t, 0);
+			}
+			return;
+		}
+
+		start(num_tasks, fn);
+		wait();
+	}
+
+	// fn for every task in [0, num_tasks) on the other threads, returning
+	// at once; fn has to live until wait(), which comes before the next
+	// start or run.  With a single thread the tasks run here and now.
+	void start(int num_tasks, const Job &fn)
+	{
+		if (num_tasks <= 0) {
+			return;
+		}
+		if (workers.empty()) {
+			for (int t = 0; t < num_tasks; t++) {
+				fn(t, 0);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			numTasks = num_tasks;
+			nextTask = 0;
+			pendingWorkers = (int)workers.size();
+			generation++;
+		}
+		wake.notify_all();
+	}
+
+	// the caller takes what is left of start()'s tasks, as worker 0, and
+	// returns once all are done
+	void wait()
+	{
+		const Job *fn;
+		int n;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (job == NULL) {
+				return;
+			}
+			fn = job;
+			n = numTasks;
+		}
+
+		int t;
+		while ((t = nextTask++) < n) {
+			(*fn)(t, 0);
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return pendingWorkers == 0; });
+		job = NULL;
+	}
+
+private:
+
+	void workerLoop(int worker)
+	{
+		unsigned int seen = 0;
+		while (true)
+		{
+			const Job *fn;
+			int n;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return bQuit || generation != seen; });
+				if (bQuit) {
+					return;
+				}
+				seen = generation;
+				fn = job;
+				n = numTasks;
+			}
+
+			int t;
+			while ((t = nextTask++) < n) {
+				(*fn)(t, worker);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pendingWorkers == 0) {
+					done.notify_all();
+				}
+			}
+		}
+	}
+
+	std::vector<std::thread>	workers;
+	std::mutex					mutex;
+	std::condition_variable		wake,
+								done;
+
+	const Job					*job;
+	int							numTasks;
+	std::atomic<int>			nextTask;
+	int							pendingWorkers;
+	unsigned int				generation;
+	bool						bQuit;
+
+	int							numThreads;
+};
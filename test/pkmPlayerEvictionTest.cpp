@@ -0,0 +1,90 @@
+/*
+ *  pkmPlayerEvictionTest.cpp
+ *
+ *  A pkmAudioPlayer made from a matched frame keeps playing its sound
+ *  after the sound is evicted and compacted away in the background: the
+ *  player pins the buffer, and it is only freed once the player is gone.
+ *  Best run under AddressSanitizer, which reports a freed buffer read.
+ *
+ *  Build (from the repository root, with ANN and pkmMatrix.h on the
+ *  include path):
+ *
+ *  c++ -g -std=c++11 -fsanitize=address -I. test/pkmPlayerEvictionTest.cpp -o pkmPlayerEvictionTest -lpthread
+ *
+ *  ./pkmPlayerEvictionTest
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "pkmAudioFeatureDatabase.h"
+#include "pkmAudioPlayer.h"
+
+#define SOUND_FRAMES 20
+
+static float * makeSound(int sound, int size)
+{
+	float *buffer = (float *)malloc(sizeof(float) * size);
+	for (int i = 0; i < size; i++)
+		buffer[i] = 0.3f * sinf(i * 0.007f * (sound + 1));
+	return buffer;
+}
+
+int main()
+{
+	const int frameSize = 512, size = frameSize * SOUND_FRAMES;
+	pkmAudioFeatureDatabase database(44100, frameSize, 1);
+
+	float *first = makeSound(0, size);
+	std::vector<float> original(first, first + size);
+	database.addSound(first, size);
+	database.buildIndex();
+
+	pkmAudioFile nearest[1];
+	if (database.getNearestFrames(&original[frameSize * 3], frameSize, nearest, 1) != 1) {
+		printf("FAIL: no match for the first sound\n");
+		return 1;
+	}
+	pkmAudioPlayer *player = new pkmAudioPlayer(nearest[0], frameSize, 0, true);
+	player->initialize();
+
+	// a second sound over the limit evicts the first, and the compactor
+	// reclaims it in the background
+	database.setEvictionLimits(SOUND_FRAMES + 5);
+	float *second = makeSound(1, size);
+	database.addSound(second, size);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	if (database.size() != 1) {
+		printf("FAIL: %d sounds left, expected the first evicted\n", database.size());
+		return 1;
+	}
+
+	int failures = 0;
+	for (int f = 0; f < SOUND_FRAMES; f++) {
+		int at = player->audioFile.offset + player->currentFrame * frameSize;
+		const float *frame = player->getNextFrame();
+		// the ramped first and last frames aren't the samples as they are
+		if (player->currentFrame == 0 || player->currentFrame == player->framesToPlay - 1) {
+			continue;
+		}
+		for (int i = 0; i < frameSize; i++) {
+			if (frame[i] != original[at + i]) {
+				failures++;
+				break;
+			}
+		}
+	}
+	delete player;
+
+	// the buffer goes once the query thread moves on and a writer runs
+	database.getNearestFrames(&original[frameSize * 3], frameSize, nearest, 1);
+	float *third = makeSound(2, size);
+	database.addSound(third, size);
+
+	printf("%s: %d frames differed after eviction\n", failures ? "FAIL" : "OK", failures);
+	return failures ? 1 : 0;
+}